@@ -0,0 +1,41 @@
+#pragma once
+/*
+  Buzzer patterns played by hardware.
+
+  A pattern is a list of beep/pause steps, optionally repeated. Beeps are
+  compiled into RMT items and clocked out by the RMT peripheral (with its
+  carrier generating the tone for a passive buzzer), so no code runs per edge
+  and the length does not depend on how busy any task is. Steps with their
+  own toneHz form a melody: on a passive buzzer each note is a ledcWriteTone()
+  (the square wave itself is still LEDC hardware), stepped by an esp_timer
+  once per note. An active buzzer cannot change pitch and plays the rhythm only.
+*/
+
+#include <stdint.h>
+
+struct BuzzerStep {
+  uint16_t onMs;
+  uint16_t offMs;
+  uint16_t toneHz; // 0 = the default tone given to buzzerBegin()
+};
+
+struct BuzzerPattern {
+  const BuzzerStep* steps;
+  uint8_t count;
+  uint8_t repeat; // times the steps are played, at least 1
+};
+
+// Whole pattern (steps * repeat) must fit one RMT memory block; longer ones
+// are cut at a step boundary.
+const uint8_t buzzerMaxItems = 63;
+
+// onNoteDue is called from the esp_timer task when a melody note is due; the
+// task that plays patterns should then call buzzerService().
+void buzzerBegin(uint8_t pin, bool passive, uint16_t toneHz, void (*onNoteDue)());
+
+// Replaces whatever is playing. Call play/stop/service from one task only.
+void buzzerPlay(const BuzzerPattern& pattern);
+void buzzerStop();
+void buzzerService();
+
+bool buzzerPlaying();
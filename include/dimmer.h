@@ -0,0 +1,36 @@
+#pragma once
+/*
+  PWM brightness and fades for output channels, on the LEDC fade unit.
+
+  A pin is attached to LEDC only while it is dimmed or fading; fully on and
+  fully off stay plain GPIO, so OutputBank's batched register writes keep
+  working. Fades run entirely in hardware and raise one interrupt at the
+  end. The IDF 4.4 driver blocks any duty change on a channel until its fade
+  has finished, so a change requested mid-fade is deferred (latest wins)
+  and started from dimmerService() once the fade ends.
+
+  Levels are 0..255, mapped to 12-bit duty through a gamma 2 curve. A fade
+  steps linearly in duty.
+*/
+
+#include <stdint.h>
+
+const uint8_t dimmerMaxChannels = 8; // LEDC low-speed channels
+
+constexpr uint16_t dimmerDuty(uint8_t level) {
+  return (uint16_t)(((uint32_t)level * level * 4095 + 255 * 255 / 2) / (255 * 255));
+}
+
+// onFadeEnd runs in the LEDC interrupt; return true if it woke a task that
+// should run immediately (as from xTaskNotifyFromISR).
+void dimmerBegin(const uint8_t* pins, uint8_t count, bool (*onFadeEnd)());
+
+// All of these from one task only.
+bool dimmerAttached(uint8_t ch);
+// from: the channel's current level, needed when the pin is still on GPIO
+void dimmerSet(uint8_t ch, uint8_t from, uint8_t level, uint16_t fadeMs);
+void dimmerRelease(uint8_t ch); // pin back to GPIO; the caller sets its level first
+
+// After onFadeEnd: starts deferred changes and returns the channels that are
+// now idle at 0 or 255, which the caller can hand back to GPIO.
+uint32_t dimmerService();
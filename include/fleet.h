@@ -0,0 +1,55 @@
+#pragma once
+/*
+  Fleet sync over ESP-NOW: one master unit broadcasts its alarm table and
+  its wall clock, and every peer within radio range adopts both. One edit
+  on the master (any UI, /setAlarms included) reaches the whole site within
+  a beacon period, with no HTTP request to the peers.
+
+  Frames are fleet_frame.h, signed with a shared HMAC-SHA256 key (ESP-NOW
+  only encrypts unicast). While its clock is synced the master broadcasts
+  a beacon every periodMs. The table follows in fragments on the next few
+  beacons after it changed, and on every tenth otherwise, so a peer that
+  boots later catches up. A peer whose own table differs from the one a
+  fragment belongs to reassembles and applies it: local edits on a peer
+  last until the next refresh.
+
+  Time goes in two steps, as in PTP: each beacon carries the moment the
+  previous one left the master's radio (its send callback), which the peer
+  pairs with the moment it received that beacon. Both stamps are taken in
+  the Wi-Fi task, so queueing before the send does not count, and peers
+  follow the master to well under a millisecond. Alarms are scheduled on
+  wall time, so they fire together.
+
+  Beacons are built and sent, and received frames checked and applied, on
+  the server task (httpQueueWork()), like UDP control: the table goes
+  through the same path as an HTTP edit, and the beacon timer only queues
+  the work, so the esp_timer task stays free for the alarm and timer
+  one-shots. The table is re-encoded only when its version moves. A peer accepts only frames sent after the last one
+  it accepted; until its first, a replay could set an old table or time
+  for one beacon period. A master clock stepped back is followed again
+  once it passes where it was.
+
+  ESP-NOW sends and receives on the current channel, so every unit must be
+  on the same one: softAP-only units are, a station connection moves the
+  softAP to the router's channel.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include "metrics.h"
+
+enum FleetRole : uint8_t { FLEET_OFF, FLEET_MASTER, FLEET_PEER };
+
+// This unit's binary alarm table (alarm_blob.h) into buf: its length, 0 on
+// failure. Server task.
+typedef size_t (*FleetTableSource)(uint8_t* buf, size_t size);
+// Peer, server task: a complete table from the master, CRC checked. False
+// if it does not decode.
+typedef bool (*FleetTableSink)(const uint8_t* table, size_t len);
+
+// Wi-Fi must be started. key must stay valid. *version changes with every
+// edit of the table (server task).
+bool fleetBegin(FleetRole role, const char* key, FleetTableSource source, FleetTableSink sink,
+                const volatile uint32_t* version, uint32_t periodMs);
+
+void fleetWriteMetrics(MetricsWriter& w);
@@ -0,0 +1,163 @@
+#pragma once
+/*
+  Thin HTTP layer so the same route handlers run on either server stack:
+
+  - default:    Arduino WebServer, polled from its own task, one client at a
+                time, Connection: close.
+  - HTTP_ASYNC: ESP-IDF esp_http_server. Event driven (select() over all
+                sockets in one task), HTTP/1.1 keep-alive and pipelined
+                requests, bounded socket pool with LRU purge.
+
+  Either way every handler runs in one task, so handlers may act as the
+  single producer of controlQueue.
+*/
+
+#include <Arduino.h>
+#include <functional>
+#include "json_writer.h"
+#include "metrics.h"
+
+#ifdef HTTP_ASYNC
+#include "esp_http_server.h"
+typedef enum http_method HTTPMethod; // same enum WebServer uses
+#else
+#include <WebServer.h>
+#endif
+
+class HttpRequest;
+typedef std::function<void(HttpRequest&)> HttpHandler;
+
+// Register before httpBegin(). Returns false when the route table is full.
+// A trailing "*" matches the rest of the path (see HttpRequest::pathArg()).
+bool httpOn(const char* uri, HTTPMethod method, HttpHandler handler);
+void httpOnNotFound(HttpHandler handler);
+
+// Registered routes by index (in order of registration), e.g. to name the
+// TRACE_REQUEST_* records of trace.h. nullptr past the end.
+const char* httpRouteUri(uint16_t index);
+const char* httpRouteMethod(uint16_t index);
+
+// Request body handed over in pieces as it arrives, for uploads larger
+// than RAM: BEGIN, DATA any number of times, END, then the route's handler
+// sends the response. ABORT instead of END when the client goes away (the
+// handler is not called then). Pieces are at most httpUploadChunkSize.
+enum HttpUploadStage : uint8_t { HTTP_UPLOAD_BEGIN, HTTP_UPLOAD_DATA, HTTP_UPLOAD_END, HTTP_UPLOAD_ABORT };
+typedef std::function<void(HttpRequest&, HttpUploadStage, const uint8_t* data, size_t len)> HttpUploadHandler;
+const size_t httpUploadChunkSize = 1436; // WebServer's HTTP_RAW_BUFLEN, one TCP segment
+bool httpOnUpload(const char* uri, HTTPMethod method, HttpUploadHandler upload, HttpHandler handler);
+
+// Request headers handlers may read via HttpRequest::header().
+void httpCollectHeaders(const char* keys[], size_t count);
+
+// Starts the server and the task serving it, pinned to core. maxSockets
+// bounds concurrent connections (async stack only). False if the server,
+// its task or a route could not be set up.
+bool httpBegin(uint16_t port, BaseType_t core, UBaseType_t priority, uint8_t maxSockets);
+
+// Run fn on the server task. Safe from any task; event streams may only be
+// written from there. Returns false if the work queue is full.
+bool httpQueueWork(void (*fn)(void*), void* arg);
+
+// Server-Sent Events. Streams are opened with HttpRequest::beginEventStream();
+// these send one message to every open stream (server task only).
+const uint8_t httpMaxEventStreams = 4;
+void httpBroadcastEvent(const char* event, const char* data, size_t len);
+uint8_t httpEventStreamCount();
+
+// The same with the data written piecewise, e.g. by a JsonWriter on
+// httpEventSink: httpBroadcastBegin() (or HttpRequest::beginEvent()), any
+// number of sink calls, httpEventEnd(). One event at a time.
+void httpBroadcastBegin(const char* event);
+bool httpEventSink(void*, const char* data, size_t len);
+void httpEventEnd();
+
+// Staging buffer for streamed responses and events: the most any one
+// response holds in RAM, however long the document.
+const size_t httpChunkSize = 512;
+bool httpStreamSink(void* req, const char* data, size_t len); // req: HttpRequest*
+
+// Per-route latency histograms (and, on WebServer, handleClient() time),
+// and how long after boot the server was listening and first answered
+// (esp_timer time, so from app start; the bootloader's ~0.3 s is not in it).
+void httpWriteMetrics(MetricsWriter& w);
+
+class HttpRequest {
+ public:
+#ifdef HTTP_ASYNC
+  HttpRequest(httpd_req_t* r, const char* routeUri);
+#else
+  explicit HttpRequest(const char* routeUri = nullptr) : routeUri(routeUri) {}
+#endif
+
+  // Query arguments, plus form fields of url-encoded POST bodies (URL-decoded)
+  bool hasArg(const char* name);
+  String arg(const char* name);
+  int args();
+  String argName(int i);
+  String arg(int i);
+
+  String header(const char* name);
+
+  // Raw body of a POST that is not a form, copied into buf. Returns its
+  // length, or -1 if it does not fit (or was a form, read as args above).
+  int body(char* buf, size_t size);
+
+  // Path without the query string, and the URL-decoded part of it matched by
+  // the route's trailing "*" ("/alarms/*" + "/alarms/07:30" -> "07:30").
+  String path();
+  String pathArg();
+
+  // Response. Headers must be set before send(); body is sent without copying.
+  void sendHeader(const char* name, const char* value);
+  void send(int code, const char* contentType, const char* body, size_t len);
+  void send(int code, const char* contentType, const String& body) { send(code, contentType, body.c_str(), body.length()); }
+  void send(int code) { send(code, "text/plain", "", 0); }
+  void redirect(const char* location);
+
+  // Response of unknown length, sent chunked: headers first, then
+  // beginStream(), write() as often as needed, endStream(). write() returns
+  // false once the client is gone.
+  void beginStream(int code, const char* contentType);
+  bool write(const char* data, size_t len);
+  void endStream();
+
+  // Keep the connection open as a text/event-stream. Returns false (and
+  // sends nothing) when all httpMaxEventStreams slots are taken.
+  bool beginEventStream();
+  void sendEvent(const char* event, const char* data, size_t len); // to this stream only
+  void beginEvent(const char* event); // piecewise, see httpBroadcastBegin()
+
+  bool sent() const { return responded; }
+
+ private:
+  const char* routeUri;
+  bool responded = false;
+  int eventSlot = -1;
+#ifdef HTTP_ASYNC
+  bool queryAt(int index, String* name, String* value);
+  httpd_req_t* r;
+  char query[1152]; // query string, then any form body after '&' (fits a full /setAlarms)
+  char headerStore[256]; // httpd keeps pointers to header strings until send
+  size_t headerUsed = 0;
+#endif
+};
+
+// JSON response streamed through httpChunkSize bytes of stack. Set headers
+// first; the tail is sent when it goes out of scope.
+//
+//   { JsonResponse w(req); w.beginObject(); w.number("n", 1); w.endObject(); }
+class JsonResponse : public JsonWriter {
+ public:
+  explicit JsonResponse(HttpRequest& req, int code = 200)
+      : JsonWriter(chunk, sizeof(chunk), httpStreamSink, &req), req(req) {
+    req.beginStream(code, "application/json");
+  }
+  ~JsonResponse() {
+    flush();
+    req.endStream();
+  }
+
+ private:
+  HttpRequest& req;
+  char chunk[httpChunkSize];
+};
@@ -0,0 +1,55 @@
+#pragma once
+/*
+  Fixed-size latency histograms and a Prometheus text-format writer.
+
+  Every histogram has the same microsecond bucket bounds, so observing is a
+  few compares and adds under a spinlock: no allocation, safe from any task.
+  MetricsWriter formats into a caller-supplied ChunkBuffer like JsonWriter:
+  bounded with overflowed() on its own, streamed with a sink.
+
+    char buf[1024];
+    MetricsWriter w(buf, sizeof(buf));
+    w.gauge("esp32_heap_free_bytes", "Free heap", ESP.getFreeHeap());
+    w.histogramHelp("alarm_lateness_seconds", "Alarm fire delay");
+    w.histogram("alarm_lateness_seconds", nullptr, alarmLateness);
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "chunk_buffer.h"
+
+const uint8_t metricsBucketCount = 8; // finite bounds, +Inf is implicit
+extern const uint32_t metricsBucketUs[metricsBucketCount];
+
+struct LatencyHistogram {
+  uint32_t buckets[metricsBucketCount + 1]; // non-cumulative, last is +Inf
+  uint32_t count;
+  uint64_t sumUs;
+};
+
+void metricsObserve(LatencyHistogram& h, int64_t us); // negative counts as 0
+void metricsSnapshot(const LatencyHistogram& h, LatencyHistogram* out);
+
+class MetricsWriter {
+ public:
+  MetricsWriter(char* buf, size_t size, ChunkSink sink = nullptr, void* ctx = nullptr);
+
+  void gauge(const char* name, const char* help, int64_t value);
+  void counter(const char* name, const char* help, uint64_t value);
+
+  // Labelled families: one help/type header, then one series per label set.
+  // labels is the inside of {...}, e.g. route="/status",method="GET".
+  void help(const char* name, const char* type, const char* help);
+  void seconds(const char* name, const char* labels, uint64_t us); // as seconds, us precision
+  void histogramHelp(const char* name, const char* help) { this->help(name, "histogram", help); }
+  void histogram(const char* name, const char* labels, const LatencyHistogram& h);
+
+  bool flush() { return out.flush(); }
+  const char* c_str() const { return out.c_str(); }
+  size_t length() const { return out.length(); }
+  bool overflowed() const { return out.overflowed(); }
+
+ private:
+  ChunkBuffer out;
+};
@@ -0,0 +1,49 @@
+#pragma once
+/*
+  Firmware update streamed into the inactive OTA app partition.
+
+  The image goes to flash as it arrives, piece by piece from the HTTP
+  server's upload buffer, so it is never held in RAM; sectors are erased
+  as the writes reach them rather than all up front, which would stall the
+  server for seconds. A SHA-256 of the upload (hardware accelerated) must
+  match the one the client gave, and the IDF must accept the image, before
+  its partition becomes the boot one.
+
+  Only signed uploads are taken: the client sends an HMAC-SHA256, under the
+  device key, of "<sha256>:<release>", the digest as it sent it and the
+  image's release counter. It is checked before the partition is opened,
+  so without the key nothing reaches flash, and the digest it vouches for
+  is then checked against what arrived. The release must be above the
+  running image's, so an old signature cannot put an old (known bad) build
+  back. No key, no updates.
+
+  Rollback: a new image boots "pending verify". Unless it calls otaConfirm()
+  (the firmware does once its HTTP server has answered a request it sent
+  itself) within confirmTimeoutMs,
+  it is marked invalid and the previous image is booted; a reset before
+  that also rolls back, in the bootloader. That needs a bootloader built
+  with CONFIG_BOOTLOADER_APP_ROLLBACK_ENABLE, as Arduino-ESP32 2.x ships it;
+  without it images are still verified, just never rolled back.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Early in setup(): arms the rollback timer if this image is on trial. key
+// must stay valid; "" refuses every update. release: this image's counter.
+void otaBegin(uint32_t confirmTimeoutMs, const char* key, uint32_t release);
+void otaConfirm(); // this image works
+bool otaPendingVerify();
+
+// One upload at a time, from one task. Each returns nullptr or the error;
+// after an error the upload is over. sha256 is 64 hex digits, release the
+// new image's counter in decimal, sig the 64 hex digit HMAC of both;
+// otaDenied when that does not check out, otaNotNewer for an old release.
+extern const char* const otaDenied;
+extern const char* const otaNotNewer;
+const char* otaStart(const char* sha256, const char* release, const char* sig);
+const char* otaWrite(const uint8_t* data, size_t len);
+const char* otaFinish(); // then restart into the new image
+void otaAbort();
+
+uint32_t otaWritten(); // bytes of the current or last upload
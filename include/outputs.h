@@ -0,0 +1,74 @@
+#pragma once
+/*
+  On/off GPIO outputs described by a constexpr channel table.
+
+  A channel's index in the table is its bit in every mask below. write()
+  turns one (mask, bits) pair into a single store to the GPIO set register
+  and a single store to the clear register (plus out1_* for GPIO 32/33), so
+  any number of channels switch together, with no per-pin digitalWrite. The
+  stores are write-1-to-set/clear and never touch pins outside the mask.
+*/
+
+#include <Arduino.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "soc/gpio_struct.h"
+
+struct OutputChannel {
+  uint8_t pin;
+  const char* name; // used for routes and /status fields
+};
+
+// A GPIO the ESP32 has that can drive an output: 34..39 are input only,
+// 6..11 wired to the SPI flash, and 20, 24 and 28..31 do not exist
+constexpr bool outputPinValid(uint8_t pin) {
+  return pin < 34 && (pin < 6 || pin > 11) && pin != 20 && pin != 24 && (pin < 28 || pin > 31);
+}
+
+template <size_t N>
+constexpr bool outputPinsValid(const OutputChannel (&table)[N], size_t i = 0) {
+  return i == N || (outputPinValid(table[i].pin) && outputPinsValid(table, i + 1));
+}
+
+template <size_t N>
+class OutputBank {
+  static_assert(N > 0 && N <= 32, "channel masks are uint32_t");
+
+ public:
+  explicit OutputBank(const OutputChannel (&table)[N]) : table(table) {}
+
+  static constexpr size_t size() { return N; }
+  static constexpr uint32_t allMask() { return N == 32 ? 0xFFFFFFFFu : (1u << N) - 1; }
+  const OutputChannel& operator[](size_t i) const { return table[i]; }
+
+  // Channel index by name, or -1
+  int find(const char* name) const {
+    for (size_t i = 0; i < N; ++i) if (strcmp(table[i].name, name) == 0) return i;
+    return -1;
+  }
+
+  void begin() const {
+    for (size_t i = 0; i < N; ++i) pinMode(table[i].pin, OUTPUT);
+    write(allMask(), 0);
+  }
+
+  // Channels in mask take the matching bit of bits; the rest are untouched.
+  void write(uint32_t mask, uint32_t bits) const {
+    uint32_t setLow = 0, clearLow = 0, setHigh = 0, clearHigh = 0;
+    for (size_t i = 0; i < N; ++i) {
+      if (!(mask >> i & 1)) continue;
+      uint8_t pin = table[i].pin;
+      bool on = bits >> i & 1;
+      if (pin < 32) (on ? setLow : clearLow) |= 1u << pin;
+      else (on ? setHigh : clearHigh) |= 1u << (pin - 32);
+    }
+    if (setLow) GPIO.out_w1ts = setLow;
+    if (clearLow) GPIO.out_w1tc = clearLow;
+    if (setHigh) GPIO.out1_w1ts.val = setHigh;
+    if (clearHigh) GPIO.out1_w1tc.val = clearHigh;
+  }
+
+ private:
+  const OutputChannel (&table)[N];
+};
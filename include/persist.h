@@ -0,0 +1,55 @@
+#pragma once
+/*
+  Write-coalescing NVS persistence.
+
+  State owners call persistMarkDirty() instead of writing flash themselves.
+  A low-priority task writes dirty records once nothing has changed for
+  persistDebounceMs, and skips the write when the encoded bytes hash the same
+  as what is already stored, so retries and double submits cost no erase
+  cycles. Dirty records are also flushed from esp_restart() (shutdown
+  handler). A brownout reset cannot be intercepted on the ESP32, so at most
+  the last debounce window of changes is lost there.
+
+  Records registered with an RTC capacity are also mirrored, without the
+  debounce, into RTC slow memory (snapshot_slot.h), which survives soft
+  resets: esp_restart(), panics, watchdogs. persistLoad() prefers that copy,
+  so a warm boot gets the state from just before the reset without reading
+  flash, and knows how old it is. After a power-on only NVS is left.
+*/
+
+#include <Preferences.h>
+#include <stddef.h>
+#include <stdint.h>
+
+enum PersistRecord : uint8_t { PERSIST_ALARMS, PERSIST_OUTPUTS, PERSIST_TIMER, PERSIST_WIFI, PERSIST_CLOCK, PERSIST_COUNT };
+
+const uint32_t persistDebounceMs = 2000;
+const size_t persistMaxRecordSize = 1024;
+const size_t persistRtcSize = 3584; // of the ESP32's 8 KB RTC slow memory
+
+// Fills buf with the record's current content; returns its length.
+// Runs on the persist task (or the task calling esp_restart()).
+typedef size_t (*PersistEncoder)(uint8_t* buf, size_t size);
+
+void persistBegin(Preferences* prefs, UBaseType_t priority);
+// rtcCapacity: largest encoding, to mirror it in RTC memory (0 = NVS only)
+void persistRegister(PersistRecord id, const char* key, PersistEncoder encode, size_t rtcCapacity = 0);
+
+// Reads a stored record (returns 0 if absent), the RTC copy if there is
+// one. ageUs: time since the record was saved, -1 for an NVS copy.
+size_t persistLoad(PersistRecord id, uint8_t* buf, size_t size, int64_t* ageUs = nullptr);
+
+// True if any persistLoad() was served from RTC memory.
+bool persistWarmBoot();
+
+// After a warm boot, off the startup path: writes records whose NVS copy
+// is behind their RTC copy (a crash within the debounce window).
+void persistCheckStored();
+
+void persistMarkDirty(PersistRecord id); // any task
+void persistRefreshSnapshot(PersistRecord id); // RTC copy only, e.g. to update a time left
+void persistFlush();                     // write dirty records now
+
+uint32_t persistWriteCount();
+uint32_t persistSkipCount();
+uint32_t persistRtcWriteCount();
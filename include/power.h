@@ -0,0 +1,38 @@
+#pragma once
+/*
+  Power management: dynamic frequency scaling, automatic light sleep where
+  the SDK allows it, and the figures /metrics reports about both.
+
+  Every task here blocks until an esp_timer one-shot (alarm, timer, buzzer
+  note) or a network event wakes it, so the idle task runs whenever nothing
+  is due, and with light sleep enabled esp_pm sleeps until the next esp_timer
+  deadline by itself. Light sleep needs an SDK built with tickless idle (the
+  stock Arduino one is not: powerBegin() then falls back to DFS only), and
+  the Wi-Fi driver keeps the chip awake while the softAP is up; station
+  modem sleep is set where the station interface is configured.
+
+  PWM and tones stop in light sleep, so the dimmer and buzzer hold the chip
+  awake while they output anything (powerHold(), safe from interrupts).
+
+  Idle time is sampled per core from the tick interrupt. An optional current
+  sense amplifier on an ADC pin (through an RC low-pass, so a reading is the
+  average across sleep and wake) gives the supply current while idle.
+*/
+
+#include <stdint.h>
+#include "metrics.h"
+
+const uint32_t POWER_HOLD_BUZZER = 1 << 0;
+const uint32_t POWER_HOLD_PWM = 1 << 1;
+
+// sensePin < 0: no current sensing. maPerMv converts the ADC millivolts.
+void powerBegin(uint16_t maxMhz, uint16_t minMhz, int sensePin, float maPerMv);
+
+void powerHold(uint32_t reason, bool hold);
+
+// Takes one current reading if nothing holds the chip awake. Call it from a
+// wake-up that had nothing else to do, so the reading is of an idle system.
+void powerSampleCurrent();
+bool powerSensing();
+
+void powerWriteMetrics(MetricsWriter& w);
@@ -0,0 +1,35 @@
+#pragma once
+/*
+  Event trace for field units: what ran when, kept in RAM and dumped over
+  HTTP, so a timeline needs no serial cable.
+
+  trace() appends one 16-byte record (trace_ring.h) to a lock-free ring, in
+  well under a microsecond and without locks, so it may be called from any
+  task on either core and from ISRs. The ring keeps the last traceCapacity
+  events. traceWriteJson() renders it as Chrome trace-event JSON, which
+  chrome://tracing and ui.perfetto.dev open as is: requests, buzzer output
+  and the control task each get a track.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include "json_writer.h"
+
+enum TraceEvent : uint8_t {
+  TRACE_REQUEST_BEGIN = 1, // a: route index (httpRouteUri()), 0xFFFF not found
+  TRACE_REQUEST_END,       // a: the same
+  TRACE_ALARM_FIRE,        // a: rule minute of day, b: lateness us
+  TRACE_TIMER_FIRE,        // b: timer id, a: lateness ms (saturating)
+  TRACE_BUZZER_ON,         // a: steps in the pattern
+  TRACE_BUZZER_OFF,        // a: 1 when the pattern played out, 0 when stopped
+  TRACE_NVS_WRITE,         // at the end; a: PersistRecord, b: duration us
+  TRACE_LOOP_OVERRUN,      // at the end; b: control task iteration us
+};
+
+const size_t traceCapacity = 512; // 8 KB
+
+void trace(TraceEvent event, uint16_t a = 0, uint32_t b = 0); // any context, IRAM
+
+// Records from ticket `since` on (0: all still held), plus "next", the
+// ticket to pass next time for only what is new.
+void traceWriteJson(JsonWriter& w, uint32_t since);
@@ -0,0 +1,42 @@
+#pragma once
+/*
+  Binary control over UDP, for panels that cannot afford an HTTP request
+  per toggle. Frames are the fixed 36 bytes of udp_frame.h, authenticated
+  with a shared HMAC-SHA256 key and checked against a replay window per
+  panel id; frames failing either check are dropped without a reply.
+  Once our clock is set, nonces more than a minute behind it are refused
+  too, and the window lives in RTC memory, so neither another source
+  address, nor evicting a panel, nor a restart makes an old frame fresh.
+  The window then starts empty only after a power loss, until the clock
+  is set.
+
+  A receive task blocks on the socket and does the MAC and replay checks
+  (hardware SHA, some tens of us). Accepted frames go to the server task
+  (httpQueueWork()), the single producer of the control queue, so they are
+  applied by the same code and against the same state as HTTP requests;
+  the handler's ack goes out from there as soon as the command is queued.
+  On the WebServer stack a request being served delays that until it is
+  done.
+
+  Status changes are multicast as UDP_STATUS frames, signed with the same
+  key, so any number of panels stay in sync without polling.
+*/
+
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "metrics.h"
+#include "udp_frame.h"
+
+// Server task: act on request and fill in the ack's status and value
+// (opcode, channel and seq are already set).
+typedef void (*UdpHandler)(const UdpFrame& request, UdpFrame* ack);
+
+// Listens on port. key must stay valid. statusGroup / statusPort: where
+// udpMulticast() sends ("239.255.42.1", 4211), or nullptr / 0 for nowhere.
+bool udpControlBegin(uint16_t port, const char* key, UdpHandler handler, const char* statusGroup, uint16_t statusPort,
+                     BaseType_t core, UBaseType_t priority);
+
+// Server task: sign frame and send it to the status group.
+void udpMulticast(const UdpFrame& frame);
+
+void udpWriteMetrics(MetricsWriter& w);
@@ -0,0 +1,66 @@
+#pragma once
+/*
+  Cached, non-blocking wall clock, disciplined by SNTP.
+
+  getLocalTime() waits up to 5 s for SNTP when the clock is not set, which is
+  the normal state on the softAP network. Instead we keep a reference (epoch
+  at some esp_timer_get_time() instant) and derive "now" from the monotonic
+  timer, so none of these calls ever block.
+
+  Time sources, weakest first: the RTC retained over a soft reset, the
+  browser (POST /time on page load), a fleet master (fleet.h), SNTP over
+  the station interface. A stronger source or an offset above 2 s steps the clock; smaller NTP
+  corrections are slewed in at 500 ppm like adjtime(), so the clock never
+  jumps or runs backwards. The esp_timer crystal's rate error is measured
+  between NTP samples at least 10 minutes apart and corrected for, so the
+  clock keeps time between syncs and while the uplink is down.
+*/
+
+#include <stdint.h>
+
+enum WallclockSource : uint8_t { WALLCLOCK_NONE, WALLCLOCK_RTC, WALLCLOCK_BROWSER, WALLCLOCK_FLEET, WALLCLOCK_NTP };
+
+void wallclockBegin(long gmtOffsetSec, int daylightOffsetSec, const char* ntpServer);
+
+// The crystal's rate correction as measured before a restart (see
+// persist.h). The time itself survives soft resets in the system RTC,
+// which every accepted sample sets.
+void wallclockRestore(int32_t driftPpb, bool driftKnown);
+
+// True once any source has given us a plausible epoch.
+bool wallclockSynced();
+WallclockSource wallclockSource();
+const char* wallclockSourceName(WallclockSource source); // "none", "rtc", "browser", "fleet", "ntp"
+
+// Unix time in ms, or 0 while not synced.
+int64_t wallclockNowMs();
+int64_t wallclockNowUs();
+
+// Local minute of the day (0..1439), or -1 while not synced.
+int wallclockMinuteOfDay();
+
+// Local minutes since 1970-01-01 00:00 (day * 1440 + minute of day, see
+// calendar.h), or -1 while not synced. What alarm rules are scheduled on.
+int32_t wallclockLocalMinute();
+
+// Time from a client. Ignored (false) while an NTP sync is less than 12 h
+// old, or when implausible.
+bool wallclockSetFromClient(int64_t epochMs);
+
+// Time from the fleet master: epochUs was its time at esp_timer_get_time()
+// atUs (in the past). Ignored like client time.
+bool wallclockSetFromFleet(int64_t epochUs, int64_t atUs);
+
+// Ask SNTP for a sample now, e.g. once the station interface has an address.
+void wallclockResync();
+
+// Discipline state, for /time and /metrics
+int64_t wallclockSyncAgeMs();    // since the last accepted sample, -1 never
+int64_t wallclockLastOffsetUs(); // measured - predicted at that sample
+int32_t wallclockDriftPpb();     // rate correction applied to esp_timer
+bool wallclockDriftKnown();      // measured, rather than assumed 0
+
+// Called (from the SNTP or server task) every time the reference changes:
+// first sync, resync. Anything scheduled against wall time should be
+// re-armed then.
+void wallclockOnChange(void (*listener)());
@@ -0,0 +1,66 @@
+#pragma once
+/*
+  Pending LED actions for the control task, in due order. A sorted fixed
+  array: a handful of entries, so a shifting insert beats a heap and keeps
+  equal due times in push order. Due times are in the caller's monotonic
+  unit (here: esp_timer us), as TimerTable deadlines.
+
+  Each action carries a tag naming what scheduled it, so a source can
+  withdraw its future actions (e.g. alarm lead-ins after the rules change)
+  without touching anyone else's.
+*/
+
+#include <stdint.h>
+
+struct LedAction {
+  int64_t due;
+  uint32_t fadeMs; // 0 = switch at once
+  uint8_t leds;    // channel bits, bit 0 = first output
+  uint8_t level;   // target brightness, 0..255
+  uint8_t tag;
+};
+
+template <uint8_t Capacity>
+class ActionQueue {
+ public:
+  ActionQueue() : count(0) {}
+
+  uint8_t size() const { return count; }
+  bool full() const { return count >= Capacity; }
+  void clear() { count = 0; }
+
+  // The action due first, or nullptr when empty.
+  const LedAction* soonest() const { return count ? &items[0] : nullptr; }
+
+  // After every queued action due at the same time or earlier.
+  bool push(const LedAction& a) {
+    if (full()) return false;
+    uint8_t i = count;
+    while (i && items[i - 1].due > a.due) { items[i] = items[i - 1]; --i; }
+    items[i] = a;
+    ++count;
+    return true;
+  }
+
+  // Removes and returns the first action if it is due at `now`.
+  bool popDue(int64_t now, LedAction* out) {
+    if (!count || items[0].due > now) return false;
+    *out = items[0];
+    for (uint8_t i = 1; i < count; ++i) items[i - 1] = items[i];
+    --count;
+    return true;
+  }
+
+  // Drops every action with this tag; returns how many.
+  uint8_t removeTag(uint8_t tag) {
+    uint8_t kept = 0;
+    for (uint8_t i = 0; i < count; ++i) if (items[i].tag != tag) items[kept++] = items[i];
+    uint8_t removed = count - kept;
+    count = kept;
+    return removed;
+  }
+
+ private:
+  LedAction items[Capacity];
+  uint8_t count;
+};
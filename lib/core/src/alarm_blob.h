@@ -0,0 +1,83 @@
+#pragma once
+/*
+  Binary alarm record for NVS (little endian, as stored by putBytes):
+
+    uint8_t  version    alarmBlobVersion
+    uint8_t  reserved   0
+    uint16_t count
+    uint16_t crc        CRC-16/CCITT over the rules array
+    rule     rules[count], 8 bytes each:
+      uint16_t minute, uint16_t date, uint8_t days,
+      uint8_t sound | lead << 2, uint8_t leds, flags
+
+  Version 1 stored bare uint16_t minutes; those decode as daily alarms
+  (dailyAlarm()), so old records load and are rewritten as v2 on the next
+  save. Decoding rejects wrong versions, truncated blobs, bad CRCs and
+  unsorted or invalid entries, so a corrupt record is never half applied.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "alarm_set.h"
+
+const uint8_t alarmBlobVersion = 2;
+const size_t alarmBlobHeaderSize = 6;
+const size_t alarmBlobRuleSize = 8;
+
+constexpr size_t alarmBlobSize(uint16_t count) { return alarmBlobHeaderSize + count * alarmBlobRuleSize; }
+
+// CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF)
+inline uint16_t crc16(const uint8_t* data, size_t len, uint16_t crc = 0xFFFF) {
+  while (len--) {
+    crc ^= (uint16_t)(*data++) << 8;
+    for (int i = 0; i < 8; ++i) crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+// Returns bytes written, or 0 if out is too small.
+template <uint16_t Capacity>
+size_t encodeAlarmBlob(const AlarmSet<Capacity>& alarms, uint8_t* out, size_t outSize) {
+  uint16_t count = alarms.size();
+  size_t size = alarmBlobSize(count);
+  if (outSize < size) return 0;
+  uint8_t* p = out + alarmBlobHeaderSize;
+  for (uint16_t i = 0; i < count; ++i, p += alarmBlobRuleSize) {
+    const AlarmRule& r = alarms[i];
+    p[0] = r.minute & 0xFF; p[1] = r.minute >> 8;
+    p[2] = r.date & 0xFF; p[3] = r.date >> 8;
+    p[4] = r.days; p[5] = r.sound | r.lead << 2; p[6] = r.leds; p[7] = r.flags;
+  }
+  uint16_t crc = crc16(out + alarmBlobHeaderSize, count * alarmBlobRuleSize);
+  out[0] = alarmBlobVersion;
+  out[1] = 0;
+  out[2] = count & 0xFF; out[3] = count >> 8;
+  out[4] = crc & 0xFF; out[5] = crc >> 8;
+  return size;
+}
+
+// Leaves alarms untouched and returns false unless the blob is valid.
+template <uint16_t Capacity>
+bool decodeAlarmBlob(const uint8_t* in, size_t len, AlarmSet<Capacity>* alarms) {
+  if (len < alarmBlobHeaderSize || (in[0] != alarmBlobVersion && in[0] != 1)) return false;
+  size_t entrySize = in[0] == 1 ? 2 : alarmBlobRuleSize;
+  uint16_t count = in[2] | (in[3] << 8);
+  uint16_t crc = in[4] | (in[5] << 8);
+  if (count > Capacity || len != alarmBlobHeaderSize + count * entrySize) return false;
+  const uint8_t* p = in + alarmBlobHeaderSize;
+  if (crc16(p, count * entrySize) != crc) return false;
+  AlarmSet<Capacity> decoded;
+  for (uint16_t i = 0; i < count; ++i, p += entrySize) {
+    uint16_t minute = p[0] | (p[1] << 8);
+    AlarmRule r = dailyAlarm(minute);
+    if (entrySize == alarmBlobRuleSize) {
+      r.date = p[2] | (p[3] << 8);
+      r.days = p[4]; r.sound = p[5] & 3; r.lead = p[5] >> 2; r.leds = p[6]; r.flags = p[7];
+    }
+    if (i && minute <= decoded[i - 1].minute) return false; // must be sorted, no duplicates
+    if (!decoded.add(r)) return false;
+  }
+  *alarms = decoded;
+  return true;
+}
@@ -0,0 +1,269 @@
+#pragma once
+/*
+  Alarm rules in a sorted fixed array, one rule per minute of the day. No
+  heap, O(log n) lookup; insert/remove shift at most Capacity entries.
+  A second rule at a taken minute is a conflict for the caller to report
+  (alarmSameSchedule()), never a silent replacement.
+
+  A rule is 8 bytes: when (minute, weekdays or a one-shot date) and what
+  (buzzer sound, LEDs on/off with an optional fade lead-in, snooze length).
+  Times are local "minute numbers", day * 1440 + minute of day with day as
+  in calendar.h, so the next fire of every rule is a few shifts and adds:
+  all rules are evaluated on each re-arm instead of keeping a schedule in
+  sync.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include "calendar.h"
+
+const uint16_t minutesPerDay = 24 * 60;
+
+// "HH:MM" -> minute of day. Returns false for anything else.
+inline bool parseHHMM(const char* s, uint16_t* minute) {
+  if (!s) return false;
+  for (int i = 0; i < 5; ++i) {
+    if (i == 2 ? s[i] != ':' : (s[i] < '0' || s[i] > '9')) return false;
+  }
+  if (s[5] != '\0') return false;
+  int h = (s[0] - '0') * 10 + (s[1] - '0');
+  int m = (s[3] - '0') * 10 + (s[4] - '0');
+  if (h >= 24 || m >= 60) return false;
+  *minute = (uint16_t)(h * 60 + m);
+  return true;
+}
+
+// minute of day -> "HH:MM" (out must hold 6 chars)
+inline void formatHHMM(uint16_t minute, char* out) {
+  uint8_t h = minute / 60, m = minute % 60;
+  out[0] = '0' + h / 10; out[1] = '0' + h % 10; out[2] = ':';
+  out[3] = '0' + m / 10; out[4] = '0' + m % 10; out[5] = '\0';
+}
+
+// ------------------- RULES -------------------
+enum AlarmSound : uint8_t { ALARM_SOUND_NONE, ALARM_SOUND_TUNE, ALARM_SOUND_BEEPS, alarmSoundCount };
+
+const uint8_t alarmDaily = 0x7F;      // days: every weekday bit, bit 0 = Sunday
+const uint8_t alarmWeekdays = 0x3E;   // Monday..Friday
+const uint8_t alarmWeekends = 0x41;
+const uint8_t alarmLedsOn = 0x80;     // flags: switch the rule's LEDs on, else off
+const uint8_t alarmSnoozeMask = 0x3F; // flags: snooze length in minutes, 0 = no snooze
+const uint8_t alarmDefaultSnooze = 9;
+const uint8_t alarmMaxLead = 63;
+
+struct AlarmRule {
+  uint16_t minute;   // minute of day
+  uint16_t date;     // one-shot only: the day it fires on
+  uint8_t days;      // weekday bits; 0 = one-shot on date
+  uint8_t sound : 2; // AlarmSound
+  uint8_t lead : 6;  // minutes the LEDs fade towards their state before it fires
+  uint8_t leds;      // output channels it switches, bit 0 = first
+  uint8_t flags;     // alarmLedsOn | snooze minutes
+
+  bool oneShot() const { return days == 0; }
+  bool ledsOn() const { return flags & alarmLedsOn; }
+  uint8_t snoozeMinutes() const { return flags & alarmSnoozeMask; }
+};
+static_assert(sizeof(AlarmRule) == 8, "AlarmRule must stay 8 bytes, it is stored as is");
+
+// What every alarm was before rules: daily, the tune, snoozable
+inline AlarmRule dailyAlarm(uint16_t minute) {
+  AlarmRule r = {minute, 0, alarmDaily, ALARM_SOUND_TUNE, 0, 0, alarmDefaultSnooze};
+  return r;
+}
+
+inline bool alarmRuleValid(const AlarmRule& r) {
+  return r.minute < minutesPerDay && r.days <= alarmDaily && r.sound < alarmSoundCount &&
+         (!r.oneShot() || r.date != 0);
+}
+
+// Same days, or the same date for one-shots: an edit of the same rule
+// rather than another rule that happens to share the time.
+inline bool alarmSameSchedule(const AlarmRule& a, const AlarmRule& b) {
+  return a.minute == b.minute && a.days == b.days && (a.days || a.date == b.date);
+}
+
+// First fire strictly after minute number `after` (>= 0), or -1 for a
+// one-shot that is already past.
+inline int32_t alarmNextFire(const AlarmRule& r, int32_t after) {
+  if (r.oneShot()) {
+    int32_t at = (int32_t)r.date * minutesPerDay + r.minute;
+    return at > after ? at : -1;
+  }
+  int32_t day = after / minutesPerDay;
+  if (r.minute <= after % minutesPerDay) day++; // today's has passed
+  // Rotate the weekday bits so bit 0 is `day`; the lowest set bit is then
+  // the number of days to wait
+  uint8_t wd = weekdayOfDay(day);
+  uint8_t rotated = ((r.days >> wd) | (r.days << (daysPerWeek - wd))) & alarmDaily;
+  uint8_t wait = 0;
+  while (!(rotated >> wait & 1)) ++wait;
+  return (day + wait) * minutesPerDay + r.minute;
+}
+
+// "daily", "weekdays", "weekends" or a comma list of "sun".."sat" -> bits.
+// Returns false for anything else, including an empty list.
+inline bool parseWeekdays(const char* s, uint8_t* days) {
+  static const char names[] = "sunmontuewedthufrisat";
+  if (!s || !*s) return false;
+  if (strcmp(s, "daily") == 0) { *days = alarmDaily; return true; }
+  if (strcmp(s, "weekdays") == 0) { *days = alarmWeekdays; return true; }
+  if (strcmp(s, "weekends") == 0) { *days = alarmWeekends; return true; }
+  uint8_t bits = 0;
+  for (;;) {
+    int d = 0;
+    while (d < daysPerWeek && strncmp(s, names + d * 3, 3) != 0) ++d;
+    if (d == daysPerWeek) return false;
+    bits |= 1 << d;
+    s += 3;
+    if (*s == '\0') break;
+    if (*s++ != ',') return false;
+  }
+  *days = bits;
+  return true;
+}
+
+// bits -> the form parseWeekdays() reads back (out must hold 28 chars)
+inline void formatWeekdays(uint8_t days, char* out) {
+  static const char names[] = "sunmontuewedthufrisat";
+  days &= alarmDaily;
+  const char* fixed = days == alarmDaily ? "daily" : days == alarmWeekdays ? "weekdays"
+                    : days == alarmWeekends ? "weekends" : nullptr;
+  if (fixed) { strcpy(out, fixed); return; }
+  char* p = out;
+  for (int d = 0; d < daysPerWeek; ++d) {
+    if (!(days >> d & 1)) continue;
+    if (p != out) *p++ = ',';
+    memcpy(p, names + d * 3, 3);
+    p += 3;
+  }
+  *p = '\0';
+}
+
+// ------------------- SET -------------------
+template <uint16_t Capacity>
+class AlarmSet {
+ public:
+  AlarmSet() : count(0) {}
+
+  uint16_t size() const { return count; }
+  bool full() const { return count >= Capacity; }
+  const AlarmRule& operator[](uint16_t i) const { return rules[i]; }
+  void clear() { count = 0; }
+
+  bool contains(uint16_t minute) const { return find(minute) >= 0; }
+
+  // Index of the rule at minute, or -1
+  int find(uint16_t minute) const {
+    const AlarmRule* it = lowerBound(minute);
+    return it != rules + count && it->minute == minute ? (int)(it - rules) : -1;
+  }
+
+  // A daily alarm with the defaults, as plain "HH:MM" alarms always were
+  bool add(uint16_t minute) { return add(dailyAlarm(minute)); }
+
+  // Keeps the array sorted; rejects a second rule at the same minute and
+  // invalid rules.
+  bool add(const AlarmRule& rule) {
+    if (!alarmRuleValid(rule) || full()) return false;
+    AlarmRule* it = lowerBound(rule.minute);
+    if (it != rules + count && it->minute == rule.minute) return false;
+    std::copy_backward(it, rules + count, rules + count + 1);
+    *it = rule;
+    ++count;
+    return true;
+  }
+
+  // add(), or replace the rule already at that minute
+  bool put(const AlarmRule& rule) {
+    int i = find(rule.minute);
+    if (i < 0) return add(rule);
+    if (!alarmRuleValid(rule)) return false;
+    rules[i] = rule;
+    return true;
+  }
+
+  bool remove(uint16_t minute) {
+    int i = find(minute);
+    if (i < 0) return false;
+    std::copy(rules + i + 1, rules + count, rules + i);
+    --count;
+    return true;
+  }
+
+  // Soonest fire of any rule strictly after minute number `after`, with
+  // the index of that rule; -1 if none will fire again.
+  int32_t nextFire(int32_t after, int* index = nullptr) const {
+    int32_t best = -1;
+    for (uint16_t i = 0; i < count; ++i) {
+      int32_t at = alarmNextFire(rules[i], after);
+      if (at < 0 || (best >= 0 && at >= best)) continue;
+      best = at;
+      if (index) *index = i;
+    }
+    return best;
+  }
+
+  // Earliest LED lead-in (the window of `lead` minutes before a fire) of a
+  // rule firing strictly after `after`, as the minute number it starts at;
+  // that can be <= after when the window is already open. -1 if none.
+  int32_t nextLeadIn(int32_t after, int* index = nullptr) const {
+    int32_t best = -1;
+    for (uint16_t i = 0; i < count; ++i) {
+      if (!rules[i].lead || !rules[i].leds) continue;
+      int32_t at = alarmNextFire(rules[i], after);
+      if (at < 0) continue;
+      at -= rules[i].lead;
+      if (best >= 0 && at >= best) continue;
+      best = at;
+      if (index) *index = i;
+    }
+    return best;
+  }
+
+  // Drops one-shots that will not fire after `now`; returns how many.
+  uint16_t removeExpired(int32_t now) {
+    uint16_t kept = 0;
+    for (uint16_t i = 0; i < count; ++i) {
+      if (rules[i].oneShot() && alarmNextFire(rules[i], now) < 0) continue;
+      rules[kept++] = rules[i];
+    }
+    uint16_t removed = count - kept;
+    count = kept;
+    return removed;
+  }
+
+ private:
+  const AlarmRule* lowerBound(uint16_t minute) const {
+    return std::lower_bound(rules, rules + count, minute, [](const AlarmRule& r, uint16_t m) { return r.minute < m; });
+  }
+  AlarmRule* lowerBound(uint16_t minute) {
+    return const_cast<AlarmRule*>(static_cast<const AlarmSet*>(this)->lowerBound(minute));
+  }
+
+  AlarmRule rules[Capacity];
+  uint16_t count;
+};
+
+// ------------------- SCHEDULER -------------------
+// Which minute number the alarm one-shot is armed for and which one last
+// fired. The timer's event can be handled after a re-arm in the same
+// minute (an edit or clock sample processed first); arming strictly after
+// "now" then would skip the alarm that is due and fire the next one early.
+struct AlarmArming {
+  int32_t armedAt = -1;
+  int32_t firedAt = -1;
+
+  // Re-arming at minute number `now`: the minute to search strictly after,
+  // which keeps an armed alarm due this minute that has not fired yet.
+  int32_t searchFrom(int32_t now) const { return armedAt == now && firedAt != now ? now - 1 : now; }
+
+  // The timer went off at `now`: true, once, if the armed minute is due.
+  // False for one that went off early or was already handled: re-arm.
+  bool take(int32_t now) {
+    if (armedAt < 0 || now < armedAt || firedAt == armedAt) return false;
+    firedAt = armedAt;
+    return true;
+  }
+};
@@ -0,0 +1,69 @@
+#pragma once
+/*
+  Civil dates as day numbers (days since 1970-01-01), proleptic Gregorian,
+  without time.h: the conversions are Howard Hinnant's days_from_civil /
+  civil_from_days, valid far beyond the uint16_t range alarms store.
+*/
+
+#include <stdint.h>
+
+const uint8_t daysPerWeek = 7;
+
+inline int32_t daysFromCivil(int y, unsigned m, unsigned d) {
+  y -= m <= 2;
+  int era = (y >= 0 ? y : y - 399) / 400;
+  unsigned yoe = (unsigned)(y - era * 400);
+  unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + (int32_t)doe - 719468;
+}
+
+inline void civilFromDays(int32_t z, int* y, unsigned* m, unsigned* d) {
+  z += 719468;
+  int32_t era = (z >= 0 ? z : z - 146096) / 146097;
+  unsigned doe = (unsigned)(z - era * 146097);
+  unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  unsigned mp = (5 * doy + 2) / 153;
+  *d = doy - (153 * mp + 2) / 5 + 1;
+  *m = mp < 10 ? mp + 3 : mp - 9;
+  *y = (int)yoe + era * 400 + (*m <= 2);
+}
+
+// 0 = Sunday .. 6 = Saturday, as tm_wday (1970-01-01 was a Thursday)
+inline uint8_t weekdayOfDay(int32_t day) {
+  return (uint8_t)(((day + 4) % 7 + 7) % 7);
+}
+
+inline bool isLeapYear(int y) { return (y % 4 == 0 && y % 100 != 0) || y % 400 == 0; }
+
+inline unsigned daysInMonth(int y, unsigned m) {
+  static const uint8_t days[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+  return m == 2 && isLeapYear(y) ? 29 : days[m - 1];
+}
+
+// "YYYY-MM-DD" -> day number. Returns false for anything else, including
+// dates that do not exist (2026-02-29).
+inline bool parseDate(const char* s, int32_t* day) {
+  if (!s) return false;
+  for (int i = 0; i < 10; ++i) {
+    if (i == 4 || i == 7 ? s[i] != '-' : (s[i] < '0' || s[i] > '9')) return false;
+  }
+  if (s[10] != '\0') return false;
+  int y = (s[0] - '0') * 1000 + (s[1] - '0') * 100 + (s[2] - '0') * 10 + (s[3] - '0');
+  unsigned m = (s[5] - '0') * 10 + (s[6] - '0');
+  unsigned d = (s[8] - '0') * 10 + (s[9] - '0');
+  if (m < 1 || m > 12 || d < 1 || d > daysInMonth(y, m)) return false;
+  *day = daysFromCivil(y, m, d);
+  return true;
+}
+
+// day number -> "YYYY-MM-DD" (out must hold 11 chars; years 0..9999)
+inline void formatDate(int32_t day, char* out) {
+  int y;
+  unsigned m, d;
+  civilFromDays(day, &y, &m, &d);
+  out[0] = '0' + y / 1000 % 10; out[1] = '0' + y / 100 % 10; out[2] = '0' + y / 10 % 10; out[3] = '0' + y % 10;
+  out[4] = '-'; out[5] = '0' + m / 10; out[6] = '0' + m % 10;
+  out[7] = '-'; out[8] = '0' + d / 10; out[9] = '0' + d % 10; out[10] = '\0';
+}
@@ -0,0 +1,51 @@
+#include "chunk_buffer.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+ChunkBuffer::ChunkBuffer(char* b, size_t s, ChunkSink k, void* c)
+    : buf(b), size(s), len(0), flushed(0), overflow(false), sink(k), ctx(c) {
+  if (size) buf[0] = '\0';
+}
+
+bool ChunkBuffer::flush() {
+  if (overflow) return false;
+  if (!sink || len == 0) return true;
+  if (!sink(ctx, buf, len)) { overflow = true; return false; }
+  flushed += len;
+  len = 0;
+  buf[0] = '\0';
+  return true;
+}
+
+void ChunkBuffer::append(const char* s, size_t n) {
+  while (!overflow && len + n + 1 > size) {
+    if (!sink || size < 2) { overflow = true; break; }
+    size_t part = size - 1 - len; // fill up, then pass it on
+    memcpy(buf + len, s, part);
+    len += part;
+    s += part;
+    n -= part;
+    flush();
+  }
+  if (overflow) { if (size) buf[len] = '\0'; return; }
+  memcpy(buf + len, s, n);
+  len += n;
+  buf[len] = '\0';
+}
+
+void ChunkBuffer::appendf(const char* fmt, ...) {
+  if (overflow) return;
+  for (int attempt = 0; attempt < 2; ++attempt) {
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf + len, size - len, fmt, args);
+    va_end(args);
+    if (n >= 0 && len + n + 1 <= size) { len += n; return; }
+    buf[len] = '\0';
+    // Retry once from an empty buffer; longer than the whole buffer is lost
+    if (n < 0 || !sink || len == 0 || !flush()) break;
+  }
+  overflow = true;
+}
@@ -0,0 +1,40 @@
+#pragma once
+/*
+  Fixed staging buffer for generated text (JSON, Prometheus).
+
+  Without a sink it is a plain bounded buffer: once something does not fit,
+  overflowed() is set and further writes are dropped (the buffer stays NUL
+  terminated). With a sink, a full buffer is handed to the sink and reused,
+  so output of any length goes through the same few hundred bytes, e.g. as
+  the chunks of an HTTP response. The sink is never called with len 0.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Returns false when the data could not be taken (client gone); the buffer
+// then counts as overflowed and drops the rest.
+typedef bool (*ChunkSink)(void* ctx, const char* data, size_t len);
+
+class ChunkBuffer {
+ public:
+  ChunkBuffer(char* buf, size_t size, ChunkSink sink = nullptr, void* ctx = nullptr);
+
+  void append(const char* s, size_t n);
+  void appendf(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+  bool flush(); // hands what is staged to the sink; false once anything was lost
+
+  const char* c_str() const { return buf; } // staged part only
+  size_t length() const { return len; }
+  size_t total() const { return flushed + len; }
+  bool overflowed() const { return overflow; }
+
+ private:
+  char* buf;
+  size_t size;
+  size_t len;
+  size_t flushed;
+  bool overflow;
+  ChunkSink sink;
+  void* ctx;
+};
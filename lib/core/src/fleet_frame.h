@@ -0,0 +1,171 @@
+#pragma once
+/*
+  ESP-NOW fleet sync frames (little endian), at most 250 bytes as ESP-NOW
+  allows:
+
+    uint8_t  magic      fleetFrameMagic (also the protocol version)
+    uint8_t  type       FleetFrameType
+    uint16_t tableLen   the master's binary alarm table (alarm_blob.h)
+    uint16_t tableCrc   CRC-16/CCITT over the whole table
+    uint16_t offset     FLEET_TABLE: where data goes in the table, else 0
+    int64_t  sentAtUs   master wall clock at send, unique and increasing
+    body
+      FLEET_BEACON  uint32_t seq, int64_t prevTxUs: when beacon seq - 1
+                    left the radio, by the master's clock (0 unknown)
+      FLEET_TABLE   up to fleetFragmentSize bytes of the table
+    uint8_t  mac[16]    HMAC-SHA256 over everything above, truncated
+
+  Every frame names the table it goes with, so a peer can tell from a
+  beacon alone whether it is in sync. As with udp_frame.h the MAC is the
+  caller's. sentAtUs doubles as the replay guard: a peer accepts only
+  frames sent after the last one it accepted.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "alarm_blob.h"
+#include "udp_frame.h"
+
+const uint8_t fleetFrameMagic = 0x46;
+const size_t fleetFrameHeaderSize = 16;
+const size_t fleetBeaconBodySize = 12;
+const size_t fleetFragmentSize = 200;
+const size_t fleetMacSize = udpFrameMacSize;
+const size_t fleetFrameMaxSize = fleetFrameHeaderSize + fleetFragmentSize + fleetMacSize;
+const size_t fleetMaxTableSize = 4 * fleetFragmentSize;
+static_assert(fleetFrameMaxSize <= 250, "ESP-NOW payloads are at most 250 bytes");
+
+enum FleetFrameType : uint8_t { FLEET_BEACON = 1, FLEET_TABLE };
+
+struct FleetFrame {
+  uint8_t type;
+  uint16_t tableLen;
+  uint16_t tableCrc;
+  uint16_t offset;
+  int64_t sentAtUs;
+  uint32_t seq;        // FLEET_BEACON
+  int64_t prevTxUs;    // FLEET_BEACON
+  const uint8_t* data; // FLEET_TABLE, points into the encoded frame
+  uint8_t dataLen;
+};
+
+inline void putLe64(uint8_t* p, int64_t v) {
+  putLe32(p, (uint32_t)v);
+  putLe32(p + 4, (uint32_t)((uint64_t)v >> 32));
+}
+
+inline int64_t getLe64(const uint8_t* p) { return (int64_t)((uint64_t)getLe32(p + 4) << 32 | getLe32(p)); }
+
+// Everything but the MAC, which goes to out + the returned size. 0 if a
+// fragment is too long.
+inline size_t encodeFleetFrame(const FleetFrame& f, uint8_t* out) {
+  if (f.type == FLEET_TABLE && f.dataLen > fleetFragmentSize) return 0;
+  out[0] = fleetFrameMagic;
+  out[1] = f.type;
+  out[2] = f.tableLen & 0xFF; out[3] = f.tableLen >> 8;
+  out[4] = f.tableCrc & 0xFF; out[5] = f.tableCrc >> 8;
+  out[6] = f.offset & 0xFF; out[7] = f.offset >> 8;
+  putLe64(out + 8, f.sentAtUs);
+  uint8_t* body = out + fleetFrameHeaderSize;
+  if (f.type == FLEET_BEACON) {
+    putLe32(body, f.seq);
+    putLe64(body + 4, f.prevTxUs);
+    return fleetFrameHeaderSize + fleetBeaconBodySize;
+  }
+  memcpy(body, f.data, f.dataLen);
+  return fleetFrameHeaderSize + f.dataLen;
+}
+
+// False unless in is a whole frame of this version whose fragment, if
+// any, lies inside its table. Does not check the MAC (at in + len - 16).
+inline bool decodeFleetFrame(const uint8_t* in, size_t len, FleetFrame* f) {
+  if (len < fleetFrameHeaderSize + fleetMacSize || len > fleetFrameMaxSize || in[0] != fleetFrameMagic) return false;
+  f->type = in[1];
+  f->tableLen = in[2] | (in[3] << 8);
+  f->tableCrc = in[4] | (in[5] << 8);
+  f->offset = in[6] | (in[7] << 8);
+  f->sentAtUs = getLe64(in + 8);
+  const uint8_t* body = in + fleetFrameHeaderSize;
+  size_t bodyLen = len - fleetFrameHeaderSize - fleetMacSize;
+  if (f->tableLen > fleetMaxTableSize) return false;
+  if (f->type == FLEET_BEACON) {
+    if (bodyLen != fleetBeaconBodySize) return false;
+    f->seq = getLe32(body);
+    f->prevTxUs = getLe64(body + 4);
+    f->data = nullptr;
+    f->dataLen = 0;
+    return true;
+  }
+  if (f->type != FLEET_TABLE || !bodyLen || f->offset % fleetFragmentSize) return false;
+  // Only the last fragment may be short
+  if (f->offset >= f->tableLen) return false;
+  size_t left = f->tableLen - f->offset;
+  if (bodyLen != (left < fleetFragmentSize ? left : fleetFragmentSize)) return false;
+  f->data = body;
+  f->dataLen = (uint8_t)bodyLen;
+  return true;
+}
+
+// Peer side: collects the fragments of one table. A fragment of another
+// table (length or CRC) starts over, so a new edit on the master wins.
+class FleetAssembler {
+ public:
+  FleetAssembler() : len(0), crc(0), have(0), done(false) {}
+
+  // True on the fragment that completes the table with a matching CRC.
+  bool add(const FleetFrame& f) {
+    if (f.type != FLEET_TABLE) return false;
+    if (f.tableLen != len || f.tableCrc != crc) {
+      len = f.tableLen;
+      crc = f.tableCrc;
+      have = 0;
+      done = false;
+    }
+    if (done) return false;
+    memcpy(buf + f.offset, f.data, f.dataLen);
+    have |= 1u << (f.offset / fleetFragmentSize);
+    uint8_t fragments = (len + fleetFragmentSize - 1) / fleetFragmentSize;
+    if (have != (1u << fragments) - 1) return false;
+    if (crc16(buf, len) != crc) { have = 0; return false; } // mixed from two edits with the same length
+    done = true;
+    return true;
+  }
+
+  const uint8_t* data() const { return buf; }
+  size_t size() const { return len; }
+
+ private:
+  uint8_t buf[fleetMaxTableSize];
+  uint16_t len;
+  uint16_t crc;
+  uint8_t have; // bit i: fragment i is in buf
+  bool done;
+};
+
+// Peer side of the two-step time transfer: beacon seq carries the moment
+// beacon seq - 1 left the master, which pairs with the moment this peer
+// received it.
+class FleetTimePairing {
+ public:
+  FleetTimePairing() : heard(false), lastSeq(0), lastRxUs(0) {}
+
+  // Call for every accepted beacon, with the local monotonic time it
+  // arrived. True with a (master epoch, local monotonic) pair to apply.
+  bool add(const FleetFrame& beacon, int64_t rxUs, int64_t* epochUs, int64_t* atUs) {
+    bool paired = heard && beacon.prevTxUs && beacon.seq == lastSeq + 1;
+    if (paired) {
+      *epochUs = beacon.prevTxUs;
+      *atUs = lastRxUs;
+    }
+    heard = true;
+    lastSeq = beacon.seq;
+    lastRxUs = rxUs;
+    return paired;
+  }
+
+ private:
+  bool heard;
+  uint32_t lastSeq;
+  int64_t lastRxUs;
+};
@@ -0,0 +1,131 @@
+#include "json_reader.h"
+
+#include <string.h>
+
+JsonArrayReader::JsonArrayReader(char* json, size_t len)
+    : p(json), end(json + len), err(nullptr), started(false), done(false), count(0) {}
+
+const char* JsonArrayReader::find(const char* name) const {
+  for (uint8_t i = 0; i < count; ++i) if (strcmp(keys[i], name) == 0) return values[i];
+  return nullptr;
+}
+
+void JsonArrayReader::skipSpace() {
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) ++p;
+}
+
+bool JsonArrayReader::fail(const char* why) {
+  err = why;
+  done = true;
+  count = 0;
+  return false;
+}
+
+static int hexDigit(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+// Decoded text is never longer than its escaped form, so it is written
+// over the input as it is read.
+char* JsonArrayReader::readString() {
+  char* out = ++p;
+  char* start = out;
+  while (p < end && *p != '"') {
+    char c = *p++;
+    if ((unsigned char)c < 0x20) { fail("Control character in string"); return nullptr; }
+    if (c != '\\') { *out++ = c; continue; }
+    if (p >= end) break;
+    c = *p++;
+    switch (c) {
+      case '"': case '\\': case '/': *out++ = c; break;
+      case 'b': *out++ = '\b'; break;
+      case 'f': *out++ = '\f'; break;
+      case 'n': *out++ = '\n'; break;
+      case 'r': *out++ = '\r'; break;
+      case 't': *out++ = '\t'; break;
+      case 'u': {
+        uint32_t cp = 0;
+        for (int i = 0; i < 4; ++i) {
+          int d = p < end ? hexDigit(*p++) : -1;
+          if (d < 0) { fail("Bad \\u escape"); return nullptr; }
+          cp = cp << 4 | d;
+        }
+        if (cp == 0 || (cp >= 0xD800 && cp < 0xE000)) { fail("Unsupported \\u escape"); return nullptr; }
+        if (cp < 0x80) {
+          *out++ = (char)cp;
+        } else if (cp < 0x800) {
+          *out++ = (char)(0xC0 | cp >> 6);
+          *out++ = (char)(0x80 | (cp & 0x3F));
+        } else {
+          *out++ = (char)(0xE0 | cp >> 12);
+          *out++ = (char)(0x80 | (cp >> 6 & 0x3F));
+          *out++ = (char)(0x80 | (cp & 0x3F));
+        }
+        break;
+      }
+      default: fail("Bad escape"); return nullptr;
+    }
+  }
+  if (p >= end) { fail("Unterminated string"); return nullptr; }
+  ++p; // closing quote
+  *out = '\0';
+  return start;
+}
+
+// The literal is moved back one byte, over the ':' or ',' already consumed
+// before it, to make room for its terminator.
+char* JsonArrayReader::readLiteral() {
+  char* start = p;
+  while (p < end && (*p == '-' || *p == '+' || *p == '.' || (*p >= '0' && *p <= '9') || (*p >= 'a' && *p <= 'z') ||
+                     (*p >= 'A' && *p <= 'Z'))) ++p;
+  size_t n = p - start;
+  if (n == 0) { fail(p < end && (*p == '{' || *p == '[') ? "Nested values are not supported" : "Expected a value"); return nullptr; }
+  memmove(start - 1, start, n);
+  start[n - 1] = '\0';
+  return start - 1;
+}
+
+bool JsonArrayReader::next() {
+  if (done) return false;
+  count = 0;
+  skipSpace();
+  if (!started) {
+    if (p >= end || *p != '[') return fail("Expected an array");
+    ++p;
+    started = true;
+    skipSpace();
+    if (p < end && *p == ']') { done = true; return false; }
+  } else {
+    if (p < end && *p == ']') { done = true; return false; }
+    if (p >= end || *p != ',') return fail("Expected ',' or ']'");
+    ++p;
+    skipSpace();
+  }
+  if (p >= end || *p != '{') return fail("Expected an object");
+  ++p;
+  skipSpace();
+  if (p < end && *p == '}') { ++p; skipSpace(); return true; }
+  for (;;) {
+    if (p >= end || *p != '"') return fail("Expected a key");
+    char* k = readString();
+    if (!k) return false;
+    skipSpace();
+    if (p >= end || *p != ':') return fail("Expected ':'");
+    ++p;
+    skipSpace();
+    char* v = p < end && *p == '"' ? readString() : readLiteral();
+    if (!v) return false;
+    if (count == jsonReaderMaxFields) return fail("Too many fields");
+    keys[count] = k;
+    values[count] = v;
+    ++count;
+    skipSpace();
+    if (p < end && *p == '}') { ++p; skipSpace(); return true; }
+    if (p >= end || *p != ',') return fail("Expected ',' or '}'");
+    ++p;
+    skipSpace();
+  }
+}
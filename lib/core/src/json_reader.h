@@ -0,0 +1,52 @@
+#pragma once
+/*
+  Reader for a JSON array of flat objects, the shape POST /batch takes:
+
+    [{"op":"led","ch":"led1","state":"on"},{"op":"timer","minutes":5}]
+
+  Parsed in place, no heap: string escapes are decoded into the caller's
+  buffer and every key and value becomes a NUL-terminated string in it.
+  Numbers, true, false and null are kept as their literal text, so callers
+  read all values like form fields. Nested objects or arrays, and more
+  than jsonReaderMaxFields fields in one object, are errors.
+
+    JsonArrayReader r(buf, len);
+    while (r.next()) use(r.find("op"));
+    if (r.failed()) reject(r.error());
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+const uint8_t jsonReaderMaxFields = 12;
+
+class JsonArrayReader {
+ public:
+  JsonArrayReader(char* json, size_t len); // json need not be NUL terminated
+
+  // The next object; false at the end of the array or on an error.
+  bool next();
+
+  uint8_t size() const { return count; }
+  const char* key(uint8_t i) const { return keys[i]; }
+  const char* value(uint8_t i) const { return values[i]; }
+  const char* find(const char* key) const; // nullptr when absent
+
+  bool failed() const { return err != nullptr; }
+  const char* error() const { return err; }
+
+ private:
+  void skipSpace();
+  bool fail(const char* why);
+  char* readString();  // at the opening quote
+  char* readLiteral(); // number, true, false, null
+
+  char* p;
+  char* end;
+  const char* err;
+  bool started;
+  bool done;
+  uint8_t count;
+  const char* keys[jsonReaderMaxFields];
+  const char* values[jsonReaderMaxFields];
+};
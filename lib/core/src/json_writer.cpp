@@ -0,0 +1,68 @@
+#include "json_writer.h"
+
+#include <string.h>
+
+JsonWriter::JsonWriter(char* buf, size_t size, ChunkSink sink, void* ctx)
+    : out(buf, size, sink, ctx), depth(0), hasItems(0) {}
+
+void JsonWriter::prefix(const char* key) {
+  uint32_t bit = 1u << depth;
+  if (hasItems & bit) append(",", 1);
+  hasItems |= bit;
+  if (key) {
+    append("\"", 1);
+    append(key, strlen(key));
+    append("\":", 2);
+  }
+}
+
+void JsonWriter::beginObject(const char* key) {
+  prefix(key);
+  append("{", 1);
+  depth++;
+  hasItems &= ~(1u << depth);
+}
+
+void JsonWriter::endObject() {
+  depth--;
+  append("}", 1);
+}
+
+void JsonWriter::beginArray(const char* key) {
+  prefix(key);
+  append("[", 1);
+  depth++;
+  hasItems &= ~(1u << depth);
+}
+
+void JsonWriter::endArray() {
+  depth--;
+  append("]", 1);
+}
+
+void JsonWriter::boolean(const char* key, bool v) {
+  prefix(key);
+  if (v) append("true", 4);
+  else append("false", 5);
+}
+
+void JsonWriter::number(const char* key, int64_t v) {
+  prefix(key);
+  out.appendf("%lld", (long long)v);
+}
+
+void JsonWriter::string(const char* key, const char* v) {
+  prefix(key);
+  append("\"", 1);
+  const char* run = v; // copy unescaped runs in one go
+  for (const char* p = v; *p; ++p) {
+    unsigned char c = *p;
+    if (c != '"' && c != '\\' && c >= 0x20) continue;
+    append(run, p - run);
+    if (c < 0x20) out.appendf("\\u%04x", (unsigned)c);
+    else { char esc[2] = {'\\', (char)c}; append(esc, 2); }
+    run = p + 1;
+  }
+  append(run, strlen(run));
+  append("\"", 1);
+}
@@ -0,0 +1,51 @@
+#pragma once
+/*
+  Minimal JSON writer into a caller-supplied buffer. No heap: values are
+  appended with snprintf-style formatting and commas are tracked per level.
+  Once something does not fit, overflowed() is set and further writes are
+  dropped (the buffer stays NUL terminated). Given a sink, the buffer is
+  only staging (see ChunkBuffer): output of any size streams through it,
+  and flush() passes on the tail once the document is complete.
+
+    char buf[256];
+    JsonWriter w(buf, sizeof(buf));
+    w.beginObject();
+    w.number("remainingMs", 1500);
+    w.beginArray("alarms"); w.string(nullptr, "07:30"); w.endArray();
+    w.endObject();
+
+  Pass key = nullptr for array elements.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "chunk_buffer.h"
+
+class JsonWriter {
+ public:
+  JsonWriter(char* buf, size_t size, ChunkSink sink = nullptr, void* ctx = nullptr);
+
+  void beginObject(const char* key = nullptr);
+  void endObject();
+  void beginArray(const char* key = nullptr);
+  void endArray();
+
+  void boolean(const char* key, bool v);
+  void number(const char* key, int64_t v);
+  void string(const char* key, const char* v);
+
+  bool flush() { return out.flush(); }
+  const char* c_str() const { return out.c_str(); }
+  size_t length() const { return out.length(); }
+  size_t total() const { return out.total(); } // including what was flushed
+  bool overflowed() const { return out.overflowed(); }
+
+ private:
+  void append(const char* s, size_t n) { out.append(s, n); }
+  void prefix(const char* key); // comma + "key":
+
+  ChunkBuffer out;
+  uint8_t depth;
+  uint32_t hasItems; // bit per nesting level
+};
@@ -0,0 +1,87 @@
+#pragma once
+/*
+  Crash-safe record copy in memory that a soft reset (esp_restart(), panic,
+  watchdog) leaves alone, such as the ESP32's RTC slow memory. Nothing
+  initializes that memory, so after a power-on it holds garbage.
+
+  A slot holds two copies, each a header and then capacity bytes of data:
+
+    uint32_t magic      snapshotMagic
+    uint32_t seq        one more than the other copy's when written
+    int64_t  savedAtUs  the writer's clock (one that keeps running through
+                        the reset) when written
+    uint16_t capacity   of this copy's data area
+    uint16_t length
+    uint16_t crc        CRC-16/CCITT over the header (crc as 0) and data
+    uint16_t reserved
+
+  A write goes to the copy that does not hold the newest record, so a reset
+  partway through it leaves the previous record intact. A read returns the
+  valid copy with the higher seq. Magic, capacity and CRC together reject
+  garbage, torn writes and slots laid out by other firmware.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "alarm_blob.h" // crc16()
+
+const uint32_t snapshotMagic = 0x534E4150; // "SNAP"
+
+struct SnapshotHeader {
+  uint32_t magic;
+  uint32_t seq;
+  int64_t savedAtUs;
+  uint16_t capacity;
+  uint16_t length;
+  uint16_t crc;
+  uint16_t reserved;
+};
+
+constexpr size_t snapshotSlotSize(size_t capacity) { return 2 * (sizeof(SnapshotHeader) + capacity); }
+
+inline uint16_t snapshotCrc(SnapshotHeader h, const uint8_t* data) {
+  h.crc = 0;
+  return crc16(data, h.length, crc16((const uint8_t*)&h, sizeof(h)));
+}
+
+// Copy `which` (0, 1) of a slot, if it is valid
+inline bool snapshotCopy(const uint8_t* slot, size_t capacity, int which, SnapshotHeader* h) {
+  const uint8_t* copy = slot + which * (sizeof(SnapshotHeader) + capacity);
+  memcpy(h, copy, sizeof(*h));
+  return h->magic == snapshotMagic && h->capacity == capacity && h->length <= capacity &&
+         h->crc == snapshotCrc(*h, copy + sizeof(*h));
+}
+
+// Index of the newest valid copy, or -1 for none
+inline int snapshotNewest(const uint8_t* slot, size_t capacity, SnapshotHeader* h) {
+  SnapshotHeader a, b;
+  bool va = snapshotCopy(slot, capacity, 0, &a), vb = snapshotCopy(slot, capacity, 1, &b);
+  if (vb && (!va || (int32_t)(b.seq - a.seq) > 0)) { *h = b; return 1; }
+  if (va) { *h = a; return 0; }
+  return -1;
+}
+
+inline void snapshotClear(uint8_t* slot, size_t capacity) { memset(slot, 0, snapshotSlotSize(capacity)); }
+
+inline bool snapshotWrite(uint8_t* slot, size_t capacity, const uint8_t* data, size_t len, int64_t savedAtUs) {
+  if (len > capacity || capacity > 0xFFFF) return false;
+  SnapshotHeader newest;
+  int current = snapshotNewest(slot, capacity, &newest);
+  SnapshotHeader h = {snapshotMagic, current < 0 ? 1 : newest.seq + 1, savedAtUs, (uint16_t)capacity, (uint16_t)len, 0, 0};
+  h.crc = snapshotCrc(h, data);
+  uint8_t* copy = slot + (current == 0 ? 1 : 0) * (sizeof(SnapshotHeader) + capacity);
+  memcpy(copy + sizeof(h), data, len);
+  memcpy(copy, &h, sizeof(h));
+  return true;
+}
+
+// Returns the newest record's length (0 if there is none or it does not fit).
+inline size_t snapshotRead(const uint8_t* slot, size_t capacity, uint8_t* out, size_t size, int64_t* savedAtUs) {
+  SnapshotHeader h;
+  int current = snapshotNewest(slot, capacity, &h);
+  if (current < 0 || h.length > size) return 0;
+  memcpy(out, slot + current * (sizeof(SnapshotHeader) + capacity) + sizeof(h), h.length);
+  if (savedAtUs) *savedAtUs = h.savedAtUs;
+  return h.length;
+}
@@ -0,0 +1,55 @@
+#pragma once
+/*
+  Lock-free single-producer/single-consumer ring buffer.
+
+  Exactly one task may push and exactly one task may pop. Indices are free
+  running 32-bit counters; Size must be a power of two.
+*/
+
+#include <stdint.h>
+#include <atomic>
+
+template <typename T, uint32_t Size>
+class SpscQueue {
+  static_assert(Size && (Size & (Size - 1)) == 0, "SpscQueue size must be a power of two");
+
+ public:
+  SpscQueue() : items(), head(0), tail(0) {}
+
+  // Producer side. Returns false when full.
+  bool push(const T& item) {
+    uint32_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) == Size) return false;
+    items[h & (Size - 1)] = item;
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Producer side: all of items or none. They are published together, so
+  // the consumer never sees part of them. Returns false when they don't fit.
+  bool pushAll(const T* batch, uint32_t n) {
+    uint32_t h = head.load(std::memory_order_relaxed);
+    if (n > Size - (h - tail.load(std::memory_order_acquire))) return false;
+    for (uint32_t i = 0; i < n; ++i) items[(h + i) & (Size - 1)] = batch[i];
+    head.store(h + n, std::memory_order_release);
+    return true;
+  }
+
+  // Producer side: free slots. Only the producer fills them, so there are
+  // at least this many until its next push.
+  uint32_t space() const { return Size - (head.load(std::memory_order_relaxed) - tail.load(std::memory_order_acquire)); }
+
+  // Consumer side. Returns false when empty.
+  bool pop(T& item) {
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire)) return false;
+    item = items[t & (Size - 1)];
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+ private:
+  T items[Size];
+  std::atomic<uint32_t> head; // written by the producer only
+  std::atomic<uint32_t> tail; // written by the consumer only
+};
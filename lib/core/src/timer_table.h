@@ -0,0 +1,123 @@
+#pragma once
+/*
+  Fixed pool of countdown timers ordered by a binary min-heap on deadline.
+
+  soonest() is O(1), start/cancel/popExpired are O(log n); each slot knows
+  its heap position so cancelling does not search the heap. Ids are chosen
+  by the caller and only looked up on cancel (linear over Capacity slots).
+  Deadlines are in whatever monotonic unit the caller uses (here: us).
+*/
+
+#include <stdint.h>
+
+const uint8_t timerLabelSize = 16;
+
+struct TimerEntry {
+  uint32_t id;
+  int64_t deadline;
+  char label[timerLabelSize];
+  uint16_t action; // the caller's, carried along (the firmware: what it does to the LEDs)
+};
+
+template <uint8_t Capacity>
+class TimerTable {
+  static_assert(Capacity > 0 && Capacity <= 128, "TimerTable capacity must fit the uint8_t heap indices");
+
+ public:
+  TimerTable() : count(0) { clear(); }
+
+  uint8_t size() const { return count; }
+  bool full() const { return count >= Capacity; }
+
+  // The entry due first, or nullptr when empty.
+  const TimerEntry* soonest() const { return count ? &slots[heap[0]].entry : nullptr; }
+
+  // Heap order is not sorted order; use for listing only.
+  const TimerEntry& at(uint8_t i) const { return slots[heap[i]].entry; }
+
+  bool start(uint32_t id, int64_t deadline, const char* label, uint16_t action = 0) {
+    if (full()) return false;
+    uint8_t s = freeSlot();
+    Slot& slot = slots[s];
+    slot.used = true;
+    slot.entry.id = id;
+    slot.entry.deadline = deadline;
+    slot.entry.action = action;
+    uint8_t n = 0; // truncating copy
+    for (; label && n < timerLabelSize - 1 && label[n]; ++n) slot.entry.label[n] = label[n];
+    slot.entry.label[n] = '\0';
+    heap[count] = s;
+    slot.pos = count++;
+    siftUp(slot.pos);
+    return true;
+  }
+
+  bool cancel(uint32_t id) {
+    for (uint8_t i = 0; i < count; ++i) {
+      if (slots[heap[i]].entry.id == id) { removeAt(i); return true; }
+    }
+    return false;
+  }
+
+  void clear() {
+    for (uint8_t i = 0; i < Capacity; ++i) slots[i].used = false;
+    count = 0;
+  }
+
+  // Removes and returns the soonest entry if it is due at `now`.
+  bool popExpired(int64_t now, TimerEntry* out) {
+    if (!count || slots[heap[0]].entry.deadline > now) return false;
+    *out = slots[heap[0]].entry;
+    removeAt(0);
+    return true;
+  }
+
+ private:
+  struct Slot {
+    TimerEntry entry;
+    uint8_t pos; // index into heap
+    bool used;
+  };
+
+  uint8_t freeSlot() const {
+    for (uint8_t i = 0; i < Capacity; ++i) if (!slots[i].used) return i;
+    return 0; // unreachable: callers check full()
+  }
+
+  bool less(uint8_t a, uint8_t b) const { return slots[heap[a]].entry.deadline < slots[heap[b]].entry.deadline; }
+
+  void swap(uint8_t a, uint8_t b) {
+    uint8_t t = heap[a]; heap[a] = heap[b]; heap[b] = t;
+    slots[heap[a]].pos = a;
+    slots[heap[b]].pos = b;
+  }
+
+  void siftUp(uint8_t i) {
+    while (i && less(i, (i - 1) / 2)) { swap(i, (i - 1) / 2); i = (i - 1) / 2; }
+  }
+
+  void siftDown(uint8_t i) {
+    for (;;) {
+      uint8_t l = 2 * i + 1, r = l + 1, m = i;
+      if (l < count && less(l, m)) m = l;
+      if (r < count && less(r, m)) m = r;
+      if (m == i) return;
+      swap(i, m);
+      i = m;
+    }
+  }
+
+  void removeAt(uint8_t i) {
+    slots[heap[i]].used = false;
+    --count;
+    if (i == count) return;
+    heap[i] = heap[count];
+    slots[heap[i]].pos = i;
+    siftDown(i);
+    siftUp(i);
+  }
+
+  Slot slots[Capacity];
+  uint8_t heap[Capacity];
+  uint8_t count;
+};
@@ -0,0 +1,85 @@
+#pragma once
+/*
+  Lock-free ring of fixed 16-byte trace records, for any number of writers
+  (tasks on either core, ISRs) and a reader that may run concurrently.
+
+  A writer claims a slot with one atomic increment, so it never waits and
+  never fails; once the ring is full the oldest records are overwritten.
+  Each slot is a tiny seqlock: its first word is cleared before the other
+  words are written and set to the claim ticket last, so a reader copies a
+  slot and keeps it only if that word held the ticket it expected before
+  and after. Records being written or already overwritten are skipped.
+
+    word 0  event (8 bits) | cpu (1) | valid (1) | ticket (22)
+    word 1  time, low 32 bits of microseconds
+    word 2  time, bits 32..47 | a << 16
+    word 3  b
+
+  48-bit microseconds last 8.9 years of uptime, so records never need
+  unwrapping. Ticket bits distinguish laps of the ring, not records.
+*/
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+struct TraceRecord {
+  int64_t timeUs;
+  uint8_t event;
+  uint8_t cpu;
+  uint16_t a;
+  uint32_t b;
+};
+
+template <size_t Capacity>
+class TraceRing {
+  static_assert(Capacity && (Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+  static const uint32_t validBit = 1u << 9;
+
+ public:
+  TraceRing() : head(0) {}
+
+  // Always inlined, so a caller in IRAM (an ISR) keeps all of it there
+  __attribute__((always_inline)) void write(uint8_t event, uint8_t cpu, int64_t timeUs, uint16_t a, uint32_t b) {
+    uint32_t ticket = head.fetch_add(1, std::memory_order_relaxed);
+    Slot& s = slots[ticket & (Capacity - 1)];
+    s.w[0].store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    s.w[1].store((uint32_t)timeUs, std::memory_order_relaxed);
+    s.w[2].store(((uint32_t)((uint64_t)timeUs >> 32) & 0xFFFF) | (uint32_t)a << 16, std::memory_order_relaxed);
+    s.w[3].store(b, std::memory_order_relaxed);
+    s.w[0].store(tag(ticket) | (cpu & 1u) << 8 | event, std::memory_order_release);
+  }
+
+  // Records claimed so far; those before written() - Capacity are gone.
+  uint32_t written() const { return head.load(std::memory_order_acquire); }
+
+  // The record with this ticket, if it is complete and not yet overwritten.
+  bool read(uint32_t ticket, TraceRecord* out) const {
+    const Slot& s = slots[ticket & (Capacity - 1)];
+    uint32_t w0 = s.w[0].load(std::memory_order_acquire);
+    uint32_t w1 = s.w[1].load(std::memory_order_relaxed);
+    uint32_t w2 = s.w[2].load(std::memory_order_relaxed);
+    uint32_t w3 = s.w[3].load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if ((w0 & ~0x1FFu) != tag(ticket) || s.w[0].load(std::memory_order_relaxed) != w0) return false;
+    out->timeUs = (int64_t)((uint64_t)(w2 & 0xFFFF) << 32 | w1);
+    out->event = w0 & 0xFF;
+    out->cpu = (w0 >> 8) & 1;
+    out->a = w2 >> 16;
+    out->b = w3;
+    return true;
+  }
+
+  // Oldest ticket still in the ring
+  uint32_t oldest(uint32_t written) const { return written > Capacity ? written - Capacity : 0; }
+
+ private:
+  static uint32_t tag(uint32_t ticket) { return validBit | ticket << 10; }
+
+  struct Slot {
+    std::atomic<uint32_t> w[4];
+  };
+  Slot slots[Capacity] = {}; // word 0 = 0: never written
+  std::atomic<uint32_t> head;
+};
@@ -0,0 +1,157 @@
+#pragma once
+/*
+  Fixed 36-byte UDP control frame (little endian):
+
+    uint8_t  magic      udpFrameMagic (also the protocol version)
+    uint8_t  opcode     UdpOpcode; | udpAck in replies
+    uint8_t  channel    output channel, or flags (UDP_STATUS)
+    uint8_t  status     UdpStatus in replies, 0 in requests
+    uint32_t value      opcode specific
+    uint32_t sender     panel id, 0 for the board; replies echo it
+    uint64_t nonce      per sender, increasing; replies echo it
+    uint8_t  mac[16]    HMAC-SHA256 over the 20 bytes above, truncated
+
+  The MAC is the caller's (the firmware uses mbedtls); this file only packs
+  the header and keeps the replay window. Both the sender and the nonce
+  are under the MAC, so replays are told apart whatever address they come
+  from. A nonce must keep increasing across the sender's restarts: it is
+  the sender's Unix time in microseconds (or one more than its last, if
+  the clock has not moved on).
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+const uint8_t udpFrameMagic = 0x4C;
+const size_t udpFrameHeaderSize = 20;
+const size_t udpFrameMacSize = 16;
+const size_t udpFrameSize = udpFrameHeaderSize + udpFrameMacSize;
+
+enum UdpOpcode : uint8_t {
+  UDP_PING,          // reply only (round trip time)
+  UDP_LED,           // channel, value 0 = off, else on
+  UDP_OUTPUTS,       // value: bits (low 16) | mask << 16, all in one write
+  UDP_BRIGHTNESS,    // channel, value: level (low 8) | fade ms << 8
+  UDP_TIMER_START,   // value: ms; the reply's value is the timer id
+  UDP_TIMER_STOP,    // every timer
+  UDP_ALARM_SNOOZE,
+  UDP_ALARM_DISMISS,
+  UDP_STATUS = 0x40, // multicast by the board (sender 0): value = output bits
+};
+const uint8_t udpAck = 0x80;
+
+enum UdpStatus : uint8_t { UDP_OK, UDP_BUSY, UDP_BAD_REQUEST, UDP_UNKNOWN_OP };
+
+// UDP_STATUS channel bits
+const uint8_t udpStatusRinging = 1 << 0;
+const uint8_t udpStatusSnoozed = 1 << 1;
+const uint8_t udpStatusTimer = 1 << 2;
+
+struct UdpFrame {
+  uint8_t opcode;
+  uint8_t channel;
+  uint8_t status;
+  uint32_t value;
+  uint32_t sender;
+  uint64_t nonce;
+};
+
+inline void putLe32(uint8_t* p, uint32_t v) {
+  p[0] = v & 0xFF; p[1] = v >> 8 & 0xFF; p[2] = v >> 16 & 0xFF; p[3] = v >> 24;
+}
+
+inline uint32_t getLe32(const uint8_t* p) {
+  return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+// The header only: the MAC goes to out + udpFrameHeaderSize.
+inline void encodeUdpFrame(const UdpFrame& f, uint8_t* out) {
+  out[0] = udpFrameMagic;
+  out[1] = f.opcode;
+  out[2] = f.channel;
+  out[3] = f.status;
+  putLe32(out + 4, f.value);
+  putLe32(out + 8, f.sender);
+  putLe32(out + 12, (uint32_t)f.nonce);
+  putLe32(out + 16, (uint32_t)(f.nonce >> 32));
+}
+
+// False unless in is a whole frame of this version. Does not check the MAC.
+inline bool decodeUdpFrame(const uint8_t* in, size_t len, UdpFrame* f) {
+  if (len != udpFrameSize || in[0] != udpFrameMagic) return false;
+  f->opcode = in[1];
+  f->channel = in[2];
+  f->status = in[3];
+  f->value = getLe32(in + 4);
+  f->sender = getLe32(in + 8);
+  f->nonce = (uint64_t)getLe32(in + 16) << 32 | getLe32(in + 12);
+  return true;
+}
+
+// Constant time, so a forger cannot find the MAC byte by byte
+inline bool udpMacEqual(const uint8_t* a, const uint8_t* b) {
+  uint8_t diff = 0;
+  for (size_t i = 0; i < udpFrameMacSize; ++i) diff |= a[i] ^ b[i];
+  return diff == 0;
+}
+
+// Replay protection for authenticated frames: per sender id, the highest
+// nonce seen and a 64-bit window below it (as IPsec does), so reordered
+// datagrams still get through but none is accepted twice. Senders are
+// kept in LRU order. Nothing at or below the floor is accepted, and an
+// evicted sender's highest nonce raises the floor, so an unknown sender
+// never gets a fresh window to replay old frames into: Peers should exceed
+// the number of panels in use. The firmware also raises the floor to its
+// clock minus a tolerance, and keeps the whole window over soft resets.
+// Plain data, so it may be copied byte for byte.
+template <uint8_t Peers>
+class ReplayWindow {
+ public:
+  ReplayWindow() : floor(0), clock(0) {
+    for (uint8_t i = 0; i < Peers; ++i) peers[i] = Peer();
+  }
+
+  // Call only for frames whose MAC checked out; records nonce if fresh.
+  bool accept(uint32_t sender, uint64_t nonce) {
+    if (nonce <= floor) return false;
+    Peer* p = nullptr;
+    Peer* oldest = &peers[0];
+    for (uint8_t i = 0; i < Peers && !p; ++i) {
+      if (peers[i].lastUsed && peers[i].sender == sender) p = &peers[i];
+      else if (peers[i].lastUsed < oldest->lastUsed) oldest = &peers[i];
+    }
+    if (!p) {
+      p = oldest;
+      if (p->lastUsed) raiseFloor(p->top);
+      if (nonce <= floor) return false;
+      p->sender = sender;
+      p->top = nonce;
+      p->seen = 1;
+    } else if (nonce > p->top) {
+      uint64_t shift = nonce - p->top;
+      p->seen = shift >= 64 ? 1 : p->seen << shift | 1;
+      p->top = nonce;
+    } else {
+      uint64_t back = p->top - nonce;
+      if (back >= 64 || (p->seen >> back & 1)) return false;
+      p->seen |= 1ULL << back;
+    }
+    p->lastUsed = ++clock;
+    return true;
+  }
+
+  void raiseFloor(uint64_t nonce) {
+    if (nonce > floor) floor = nonce;
+  }
+
+ private:
+  struct Peer {
+    uint32_t sender = 0;
+    uint32_t lastUsed = 0; // 0 = free
+    uint64_t top = 0;
+    uint64_t seen = 0;     // bit i: top - i was accepted
+  };
+  Peer peers[Peers];
+  uint64_t floor;
+  uint32_t clock;
+};
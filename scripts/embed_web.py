@@ -0,0 +1,120 @@
+"""
+Pre-build step: gzip the static web UI into flash-resident byte arrays.
+
+  web/index.html, web/*.css, web/*.js  ->  include/web_assets.h
+                                           (generated, not checked in)
+
+Each file in ASSETS is served at a content-hashed URL (style.css ->
+/style.<hash>.css) that can be cached forever; "{{style.css}}" in the page
+is replaced by that URL. The page itself stays at / with an ETag, so a new
+firmware's page (and through it, new asset URLs) is picked up on the next
+load.
+
+Runs automatically from platformio.ini (extra_scripts = pre:...), or by hand:
+  python scripts/embed_web.py
+The output is deterministic (gzip mtime fixed to 0), so hashes only change
+when the content does, and the header is only rewritten when it differs.
+"""
+
+import gzip
+import hashlib
+import os
+
+PAGE = ("index.html", "WEB_INDEX")  # (source under web/, C identifier prefix)
+
+ASSETS = [
+    # (source under web/, Content-Type)
+    ("style.css", "text/css"),
+    ("app.js", "application/javascript"),
+]
+
+
+def project_dir():
+    try:
+        return env.subst("$PROJECT_DIR")  # noqa: F821 (injected by PlatformIO)
+    except NameError:
+        return os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+
+def c_array(data, per_line=16):
+    lines = []
+    for i in range(0, len(data), per_line):
+        lines.append("  " + ",".join("0x%02x" % b for b in data[i:i + per_line]) + ",")
+    return "\n".join(lines)
+
+
+def read(root, name):
+    with open(os.path.join(root, "web", name), "rb") as f:
+        return f.read()
+
+
+def identifier(name):
+    return "WEB_" + "".join(c if c.isalnum() else "_" for c in name.upper())
+
+
+def blob(ident, name, raw):
+    gz = gzip.compress(raw, compresslevel=9, mtime=0)
+    return gz, [
+        "// %s: %d bytes, %d gzipped" % (name, len(raw), len(gz)),
+        "const size_t %s_GZ_LEN = %d;" % (ident, len(gz)),
+        "const uint8_t %s_GZ[] PROGMEM = {" % ident,
+        c_array(gz),
+        "};",
+        "",
+    ]
+
+
+def render(root):
+    out = [
+        "// Generated by scripts/embed_web.py from web/ -- do not edit.",
+        "#pragma once",
+        "#include <Arduino.h>",
+        "",
+        "struct WebAsset {",
+        "  const char* path; // content-hashed, cache forever",
+        "  const char* type;",
+        "  const uint8_t* gz;",
+        "  size_t len;",
+        "};",
+        "",
+    ]
+    urls, table = {}, []
+    for name, ctype in ASSETS:
+        raw = read(root, name)
+        stem, ext = os.path.splitext(name)
+        urls[name] = "/%s.%s%s" % (stem, hashlib.sha256(raw).hexdigest()[:10], ext)
+        ident = identifier(name)
+        out += blob(ident, name, raw)[1]
+        table.append('  {"%s", "%s", %s_GZ, %s_GZ_LEN},' % (urls[name], ctype, ident, ident))
+    out += ["const WebAsset webAssets[] = {"] + table + ["};",
+            "const size_t webAssetCount = %d;" % len(table), ""]
+
+    page = read(root, PAGE[0])
+    for name, url in urls.items():
+        if ("{{%s}}" % name).encode() not in page:
+            raise SystemExit("embed_web: %s does not reference {{%s}}" % (PAGE[0], name))
+        page = page.replace(("{{%s}}" % name).encode(), url.encode())
+    gz, lines = blob(PAGE[1], PAGE[0], page)
+    out += ['const char %s_ETAG[] = "\\"%s\\"";' % (PAGE[1], hashlib.sha256(gz).hexdigest()[:16])] + lines
+    return "\n".join(out)
+
+
+def main():
+    root = project_dir()
+    target = os.path.join(root, "include", "web_assets.h")
+    text = render(root)
+    old = None
+    if os.path.exists(target):
+        with open(target) as f:
+            old = f.read()
+    if text != old:
+        with open(target, "w") as f:
+            f.write(text)
+        print("embed_web: wrote " + os.path.relpath(target, root))
+
+
+try:
+    Import("env")  # noqa: F821
+except NameError:
+    pass
+main()
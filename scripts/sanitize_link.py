@@ -0,0 +1,8 @@
+"""
+Post-configure step for env:native-asan: SCons only hands -fsanitize to the
+compiler, so repeat it on the link line or the ASan/UBSan runtimes are missing.
+"""
+
+Import("env")  # noqa: F821 (provided by PlatformIO)
+
+env.Append(LINKFLAGS=["-fsanitize=address,undefined"])  # noqa: F821
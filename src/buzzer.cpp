@@ -0,0 +1,207 @@
+#include "buzzer.h"
+
+#include <Arduino.h>
+#include "driver/rmt.h"
+#include "esp_timer.h"
+#include "power.h"
+#include "trace.h"
+
+static const rmt_channel_t rmtChannel = RMT_CHANNEL_0;
+// REF_TICK (1 MHz, unaffected by CPU frequency changes) / 100 = 100 us ticks,
+// so one RMT half-item covers up to 3.2 s.
+static const uint8_t rmtClockDiv = 100;
+static const uint32_t rmtTicksPerMs = 10;
+static const uint32_t rmtMaxTicks = 32767;
+static const uint8_t ledcChannel = 0;
+static const uint8_t ledcResolution = 8; // bits
+
+static uint8_t buzzerPin = 0;
+static bool buzzerPassive = false;
+static uint16_t defaultToneHz = 0;
+static void (*noteDueListener)() = nullptr;
+
+// RMT playback, compiled per play (plus one slot for the end marker)
+static rmt_item32_t items[buzzerMaxItems + 1];
+static uint8_t itemCount = 0;
+static bool halfUsed = false; // items[itemCount] has its first half set
+static volatile bool rmtPlaying = false;
+
+// Melody playback (passive buzzer, LEDC)
+static esp_timer_handle_t noteTimer = nullptr;
+static BuzzerPattern melody = {};
+static bool melodyActive = false;
+static bool melodyInPause = false;
+static uint8_t melodyIndex = 0, melodyRound = 0;
+static int64_t melodyDueUs = 0;
+
+static void IRAM_ATTR onRmtDone(rmt_channel_t channel, void*) {
+  if (channel != rmtChannel) return;
+  rmtPlaying = false;
+  powerHold(POWER_HOLD_BUZZER, false);
+  trace(TRACE_BUZZER_OFF, 1);
+}
+
+static void onNoteTimer(void*) {
+  if (noteDueListener) noteDueListener();
+}
+
+static bool appendHalf(uint32_t level, uint32_t ticks) {
+  rmt_item32_t& item = items[itemCount];
+  if (!halfUsed) {
+    if (itemCount >= buzzerMaxItems) return false;
+    item.duration0 = ticks;
+    item.level0 = level;
+    item.duration1 = 0;
+    item.level1 = 0;
+    halfUsed = true;
+  } else {
+    item.duration1 = ticks;
+    item.level1 = level;
+    halfUsed = false;
+    itemCount++;
+  }
+  return true;
+}
+
+// Zero-length levels are skipped: a zero duration is the RMT end marker.
+static bool appendLevel(uint32_t level, uint32_t ms) {
+  for (uint32_t ticks = ms * rmtTicksPerMs; ticks;) {
+    uint32_t t = ticks < rmtMaxTicks ? ticks : rmtMaxTicks;
+    if (!appendHalf(level, t)) return false;
+    ticks -= t;
+  }
+  return true;
+}
+
+// All or nothing, so a cut pattern ends on a whole step
+static bool appendStep(const BuzzerStep& step) {
+  uint8_t savedCount = itemCount;
+  bool savedHalf = halfUsed;
+  if (appendLevel(1, step.onMs) && appendLevel(0, step.offMs)) return true;
+  itemCount = savedCount;
+  halfUsed = savedHalf;
+  return false;
+}
+
+static void compilePattern(const BuzzerPattern& p) {
+  itemCount = 0;
+  halfUsed = false;
+  uint8_t rounds = p.repeat ? p.repeat : 1;
+  bool fits = true;
+  for (uint8_t r = 0; r < rounds && fits; ++r) {
+    for (uint8_t i = 0; i < p.count && fits; ++i) fits = appendStep(p.steps[i]);
+  }
+  if (!fits) log_w("buzzer pattern cut after %u items", itemCount);
+  // End marker: the unused half of the last item, or a new zero item
+  if (!halfUsed) { items[itemCount].duration0 = 0; items[itemCount].level0 = 0; }
+  items[itemCount].duration1 = 0;
+  items[itemCount].level1 = 0;
+  itemCount++;
+}
+
+static void armNote(uint32_t ms) {
+  melodyDueUs = esp_timer_get_time() + (int64_t)ms * 1000;
+  esp_timer_start_once(noteTimer, ms ? (uint64_t)ms * 1000ULL : 1);
+}
+
+static void startNote() {
+  const BuzzerStep& step = melody.steps[melodyIndex];
+  ledcWriteTone(ledcChannel, step.toneHz ? step.toneHz : defaultToneHz);
+  melodyInPause = false;
+  armNote(step.onMs);
+}
+
+void buzzerBegin(uint8_t pin, bool passive, uint16_t toneHz, void (*onNoteDue)()) {
+  buzzerPin = pin;
+  buzzerPassive = passive;
+  defaultToneHz = toneHz;
+  noteDueListener = onNoteDue;
+
+  rmt_config_t cfg = {};
+  cfg.rmt_mode = RMT_MODE_TX;
+  cfg.channel = rmtChannel;
+  cfg.gpio_num = pin;
+  cfg.clk_div = rmtClockDiv;
+  cfg.mem_block_num = 1;
+  cfg.flags = RMT_CHANNEL_FLAGS_AWARE_DFS;
+  cfg.tx_config.carrier_en = passive; // the carrier is the tone
+  cfg.tx_config.carrier_freq_hz = toneHz;
+  cfg.tx_config.carrier_duty_percent = 50;
+  cfg.tx_config.carrier_level = RMT_CARRIER_LEVEL_HIGH;
+  cfg.tx_config.idle_output_en = true;
+  cfg.tx_config.idle_level = RMT_IDLE_LEVEL_LOW;
+  ESP_ERROR_CHECK(rmt_config(&cfg));
+  ESP_ERROR_CHECK(rmt_driver_install(rmtChannel, 0, 0));
+  rmt_register_tx_end_callback(onRmtDone, nullptr);
+
+  if (passive) {
+    ledcSetup(ledcChannel, toneHz, ledcResolution);
+    ledcWriteTone(ledcChannel, 0);
+    esp_timer_create_args_t args = {};
+    args.callback = onNoteTimer;
+    args.name = "buzzer";
+    esp_timer_create(&args, &noteTimer);
+  }
+}
+
+void buzzerPlay(const BuzzerPattern& pattern) {
+  buzzerStop();
+  if (!pattern.count) return;
+  trace(TRACE_BUZZER_ON, pattern.count * (pattern.repeat ? pattern.repeat : 1));
+
+  bool tuned = false;
+  for (uint8_t i = 0; i < pattern.count; ++i) tuned |= pattern.steps[i].toneHz != 0;
+  if (buzzerPassive && tuned) {
+    ledcAttachPin(buzzerPin, ledcChannel);
+    melody = pattern;
+    melodyIndex = melodyRound = 0;
+    melodyActive = true;
+    powerHold(POWER_HOLD_BUZZER, true); // LEDC tones stop in light sleep
+    startNote();
+    return;
+  }
+
+  // Written straight to RMT memory rather than rmt_write_items(): that call
+  // blocks on a semaphore that rmt_tx_stop() never gives back.
+  compilePattern(pattern);
+  if (buzzerPassive) rmt_set_gpio(rmtChannel, RMT_MODE_TX, buzzerPin, false); // back from LEDC
+  rmt_fill_tx_items(rmtChannel, items, itemCount, 0);
+  rmtPlaying = true;
+  powerHold(POWER_HOLD_BUZZER, true); // so does RMT
+  rmt_tx_start(rmtChannel, true);
+}
+
+void buzzerStop() {
+  if (buzzerPlaying()) trace(TRACE_BUZZER_OFF, 0);
+  rmt_tx_stop(rmtChannel); // output drops to the idle level
+  rmtPlaying = false;
+  if (melodyActive) {
+    esp_timer_stop(noteTimer);
+    ledcWriteTone(ledcChannel, 0);
+    melodyActive = false;
+  }
+  powerHold(POWER_HOLD_BUZZER, false);
+}
+
+void buzzerService() {
+  // Drops a stale wake from a melody that was replaced or stopped
+  if (!melodyActive || esp_timer_get_time() < melodyDueUs) return;
+  if (!melodyInPause) {
+    ledcWriteTone(ledcChannel, 0);
+    melodyInPause = true;
+    uint16_t offMs = melody.steps[melodyIndex].offMs;
+    if (offMs) { armNote(offMs); return; }
+  }
+  if (++melodyIndex == melody.count) {
+    melodyIndex = 0;
+    if (++melodyRound >= (melody.repeat ? melody.repeat : 1)) {
+      melodyActive = false;
+      powerHold(POWER_HOLD_BUZZER, false);
+      trace(TRACE_BUZZER_OFF, 1);
+      return;
+    }
+  }
+  startNote();
+}
+
+bool buzzerPlaying() { return rmtPlaying || melodyActive; }
@@ -0,0 +1,119 @@
+#include "dimmer.h"
+
+#include <Arduino.h>
+#include "driver/ledc.h"
+#include "power.h"
+
+static const ledc_mode_t ledcMode = LEDC_LOW_SPEED_MODE; // the buzzer uses the high-speed group
+static const ledc_timer_t ledcTimer = LEDC_TIMER_0;
+static const uint32_t pwmFreqHz = 5000;
+
+static const uint8_t* channelPins = nullptr;
+static uint8_t channelCount = 0;
+static bool (*fadeEndListener)() = nullptr;
+
+static uint32_t attachedMask = 0;
+static volatile uint32_t fadingMask = 0; // cleared from the fade-end interrupt
+static portMUX_TYPE fadeMux = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t levels[dimmerMaxChannels]; // target of the last applied change
+
+// Deferred while the channel was fading
+static uint32_t pendingMask = 0;
+static uint8_t pendingFrom[dimmerMaxChannels]; // used if the pin is on GPIO by then
+static uint8_t pendingLevel[dimmerMaxChannels];
+static uint16_t pendingFadeMs[dimmerMaxChannels];
+
+static bool IRAM_ATTR onLedcFade(const ledc_cb_param_t* param, void*) {
+  if (param->event != LEDC_FADE_END_EVT) return false;
+  portENTER_CRITICAL_ISR(&fadeMux);
+  fadingMask &= ~(1u << param->channel);
+  portEXIT_CRITICAL_ISR(&fadeMux);
+  return fadeEndListener ? fadeEndListener() : false;
+}
+
+static bool fading(uint8_t ch) { return fadingMask >> ch & 1; }
+
+static void attach(uint8_t ch, uint8_t from) {
+  ledc_channel_config_t cfg = {};
+  cfg.gpio_num = channelPins[ch];
+  cfg.speed_mode = ledcMode;
+  cfg.channel = (ledc_channel_t)ch;
+  cfg.intr_type = LEDC_INTR_DISABLE;
+  cfg.timer_sel = ledcTimer;
+  cfg.duty = dimmerDuty(from); // no visible step when taking over from GPIO
+  ledc_channel_config(&cfg);
+  ledc_cbs_t cbs = {onLedcFade};
+  ledc_cb_register(ledcMode, (ledc_channel_t)ch, &cbs, nullptr);
+  attachedMask |= 1u << ch;
+  powerHold(POWER_HOLD_PWM, true); // PWM stops in light sleep
+  levels[ch] = from;
+}
+
+static void apply(uint8_t ch, uint8_t level, uint16_t fadeMs) {
+  ledc_channel_t channel = (ledc_channel_t)ch;
+  // An unchanged duty raises no fade-end interrupt, so never fade to it
+  if (fadeMs && dimmerDuty(level) != dimmerDuty(levels[ch])) {
+    portENTER_CRITICAL(&fadeMux);
+    fadingMask |= 1u << ch;
+    portEXIT_CRITICAL(&fadeMux);
+    ledc_set_fade_with_time(ledcMode, channel, dimmerDuty(level), fadeMs);
+    ledc_fade_start(ledcMode, channel, LEDC_FADE_NO_WAIT);
+  } else {
+    ledc_set_duty_and_update(ledcMode, channel, dimmerDuty(level), 0);
+  }
+  levels[ch] = level;
+}
+
+void dimmerBegin(const uint8_t* pins, uint8_t count, bool (*onFadeEnd)()) {
+  channelPins = pins;
+  channelCount = count < dimmerMaxChannels ? count : dimmerMaxChannels;
+  fadeEndListener = onFadeEnd;
+  ledc_timer_config_t timer = {};
+  timer.speed_mode = ledcMode;
+  timer.duty_resolution = LEDC_TIMER_12_BIT;
+  timer.timer_num = ledcTimer;
+  timer.freq_hz = pwmFreqHz;
+  timer.clk_cfg = LEDC_AUTO_CLK;
+  ESP_ERROR_CHECK(ledc_timer_config(&timer));
+  ESP_ERROR_CHECK(ledc_fade_func_install(0));
+}
+
+bool dimmerAttached(uint8_t ch) { return attachedMask >> ch & 1; }
+
+void dimmerSet(uint8_t ch, uint8_t from, uint8_t level, uint16_t fadeMs) {
+  if (ch >= channelCount) return;
+  // Even attaching waits for a fade, one left over from before a release too
+  if (fading(ch)) {
+    pendingMask |= 1u << ch;
+    pendingFrom[ch] = from;
+    pendingLevel[ch] = level;
+    pendingFadeMs[ch] = fadeMs;
+    return;
+  }
+  if (!dimmerAttached(ch)) attach(ch, from);
+  apply(ch, level, fadeMs);
+}
+
+void dimmerRelease(uint8_t ch) {
+  pendingMask &= ~(1u << ch);
+  if (!dimmerAttached(ch)) return;
+  // A fade still running carries on in LEDC, just no longer on the pin
+  ledcDetachPin(channelPins[ch]);
+  attachedMask &= ~(1u << ch);
+  powerHold(POWER_HOLD_PWM, attachedMask != 0);
+}
+
+uint32_t dimmerService() {
+  uint32_t idle = 0;
+  for (uint8_t ch = 0; ch < channelCount; ++ch) {
+    if (fading(ch)) continue;
+    if (pendingMask >> ch & 1) {
+      pendingMask &= ~(1u << ch);
+      if (!dimmerAttached(ch)) attach(ch, pendingFrom[ch]);
+      apply(ch, pendingLevel[ch], pendingFadeMs[ch]);
+      if (fading(ch)) continue;
+    }
+    if (dimmerAttached(ch) && (levels[ch] == 0 || levels[ch] == 255)) idle |= 1u << ch;
+  }
+  return idle;
+}
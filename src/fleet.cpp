@@ -0,0 +1,265 @@
+#include "fleet.h"
+
+#include <atomic>
+#include <string.h>
+#include "esp_now.h"
+#include "esp_timer.h"
+#include "mbedtls/md.h"
+#include "fleet_frame.h"
+#include "http.h"
+#include "spsc_queue.h"
+#include "wallclock.h"
+
+static const uint8_t broadcastAddr[ESP_NOW_ETH_ALEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+static const uint8_t tableBurst = 3;    // beacons followed by a changed table (broadcasts are not acked)
+static const uint8_t tableRefresh = 10; // otherwise every this many beacons
+
+struct Received {
+  uint8_t buf[fleetFrameMaxSize];
+  uint8_t len;
+  int64_t receivedUs;
+};
+
+static FleetRole role = FLEET_OFF;
+static const char* macKey = "";
+static size_t macKeyLen = 0;
+static FleetTableSource tableSource = nullptr;
+static FleetTableSink tableSink = nullptr;
+static const volatile uint32_t* tableVersion = nullptr;
+
+// This unit's table as last encoded, server task only
+static uint8_t table[fleetMaxTableSize];
+static uint16_t tableLen = 0, tableCrc = 0;
+static uint32_t encodedVersion = 0;
+static bool encoded = false;
+
+// Master, server task (the timer only queues the beacon there)
+static esp_timer_handle_t beaconTimer = nullptr;
+static std::atomic<uint8_t> beaconQueued(0);
+static uint16_t sentLen = 0, sentCrc = 0;
+static uint8_t burstLeft = 0, sinceTable = 0;
+static uint32_t beaconSeq = 0;
+static int64_t lastSentAtUs = 0;
+static uint32_t sendsIssued = 0;
+
+// Master: when beacon `seq` left the radio, stamped in the send callback
+// (Wi-Fi task). Callbacks come in send order, one per accepted send.
+struct TxStamp {
+  uint32_t seq;
+  int64_t epochUs;
+};
+static portMUX_TYPE txMux = portMUX_INITIALIZER_UNLOCKED;
+static TxStamp txStamp = {0, 0};
+static bool awaitingTx = false;
+static uint32_t awaitTicket = 0, awaitSeq = 0;
+static std::atomic<uint32_t> sendsDone(0);
+
+// Peer, server task
+static SpscQueue<Received, 8> pending; // producer: Wi-Fi task
+static std::atomic<uint8_t> drainQueued(0);
+static FleetAssembler assembler;
+static FleetTimePairing pairing;
+static int64_t lastAcceptedUs = 0;
+static int64_t lastBeaconUs = -1;
+static bool inSync = false;
+
+static volatile uint32_t sent = 0, sendErrors = 0;
+static volatile uint32_t received = 0, rejected = 0, replayed = 0, dropped = 0, tablesApplied = 0, timeSamples = 0;
+
+static void sign(const uint8_t* frame, size_t len, uint8_t* mac) {
+  uint8_t full[32];
+  mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), (const unsigned char*)macKey, macKeyLen, frame, len,
+                  full);
+  memcpy(mac, full, fleetMacSize);
+}
+
+// Server task: re-encoded only after an edit, false if there is none
+static bool refreshTable() {
+  uint32_t version = *tableVersion;
+  if (!encoded || version != encodedVersion) {
+    size_t len = tableSource(table, sizeof(table));
+    tableLen = len;
+    tableCrc = len ? crc16(table, len) : 0;
+    encodedVersion = version;
+    encoded = true;
+  }
+  return tableLen != 0;
+}
+
+// ------------------- MASTER -------------------
+
+// Unique even when two frames go out within a microsecond
+static int64_t nextSentAt() {
+  int64_t now = wallclockNowUs();
+  lastSentAtUs = now > lastSentAtUs ? now : lastSentAtUs + 1;
+  return lastSentAtUs;
+}
+
+static bool sendFrame(FleetFrame& f) {
+  uint8_t buf[fleetFrameMaxSize];
+  f.sentAtUs = nextSentAt();
+  size_t n = encodeFleetFrame(f, buf);
+  sign(buf, n, buf + n);
+  if (esp_now_send(broadcastAddr, buf, n + fleetMacSize) != ESP_OK) {
+    sendErrors++;
+    return false;
+  }
+  sendsIssued++;
+  sent++;
+  return true;
+}
+
+// Wi-Fi task
+static void onSent(const uint8_t*, esp_now_send_status_t status) {
+  int64_t now = wallclockNowUs();
+  uint32_t ticket = sendsDone.fetch_add(1);
+  portENTER_CRITICAL(&txMux);
+  if (awaitingTx && ticket == awaitTicket) {
+    if (status == ESP_NOW_SEND_SUCCESS) txStamp = {awaitSeq, now};
+    awaitingTx = false;
+  }
+  portEXIT_CRITICAL(&txMux);
+}
+
+// Server task
+static void sendBeacon(void*) {
+  beaconQueued = 0;
+  if (!wallclockSynced() || !refreshTable()) return; // nothing worth following yet
+  if (tableLen != sentLen || tableCrc != sentCrc) {
+    sentLen = tableLen;
+    sentCrc = tableCrc;
+    burstLeft = tableBurst;
+  }
+
+  FleetFrame f = {};
+  f.type = FLEET_BEACON;
+  f.tableLen = sentLen;
+  f.tableCrc = sentCrc;
+  f.seq = ++beaconSeq;
+  portENTER_CRITICAL(&txMux);
+  f.prevTxUs = txStamp.seq == f.seq - 1 ? txStamp.epochUs : 0;
+  awaitingTx = true;
+  awaitTicket = sendsIssued;
+  awaitSeq = f.seq;
+  portEXIT_CRITICAL(&txMux);
+  if (!sendFrame(f)) {
+    portENTER_CRITICAL(&txMux);
+    awaitingTx = false;
+    portEXIT_CRITICAL(&txMux);
+  }
+
+  if (burstLeft) burstLeft--;
+  else if (++sinceTable < tableRefresh) return;
+  sinceTable = 0;
+  for (uint16_t offset = 0; offset < sentLen; offset += fleetFragmentSize) {
+    f = {};
+    f.type = FLEET_TABLE;
+    f.tableLen = sentLen;
+    f.tableCrc = sentCrc;
+    f.offset = offset;
+    f.data = table + offset;
+    size_t left = sentLen - offset;
+    f.dataLen = left < fleetFragmentSize ? left : fleetFragmentSize;
+    sendFrame(f);
+  }
+}
+
+// esp_timer task, every period: kept to a notification, so the one-shots
+// sharing the task are not held up by encoding, HMACs and sends
+static void onBeaconTimer(void*) {
+  if (beaconQueued.exchange(1) == 0 && !httpQueueWork(sendBeacon, nullptr)) beaconQueued = 0;
+}
+
+// ------------------- PEER -------------------
+
+static bool holdsTable(const FleetFrame& f) {
+  return refreshTable() && tableLen == f.tableLen && tableCrc == f.tableCrc;
+}
+
+// Server task
+static void drain(void*) {
+  drainQueued = 0;
+  Received r;
+  while (pending.pop(r)) {
+    FleetFrame f;
+    uint8_t mac[fleetMacSize];
+    if (!decodeFleetFrame(r.buf, r.len, &f)) { rejected++; continue; }
+    size_t signedLen = r.len - fleetMacSize;
+    sign(r.buf, signedLen, mac);
+    if (!udpMacEqual(mac, r.buf + signedLen)) { rejected++; continue; }
+    if (f.sentAtUs <= lastAcceptedUs) { replayed++; continue; }
+    lastAcceptedUs = f.sentAtUs;
+
+    if (f.type == FLEET_BEACON) {
+      lastBeaconUs = r.receivedUs;
+      int64_t epochUs, atUs;
+      bool applied;
+      if (pairing.add(f, r.receivedUs, &epochUs, &atUs)) applied = wallclockSetFromFleet(epochUs, atUs);
+      else if (wallclockSource() != WALLCLOCK_FLEET) applied = wallclockSetFromFleet(f.sentAtUs, r.receivedUs); // rough, until paired
+      else applied = false;
+      if (applied) timeSamples++;
+      inSync = holdsTable(f);
+    } else if (holdsTable(f)) {
+      inSync = true;
+    } else if (assembler.add(f)) {
+      if (tableSink(assembler.data(), assembler.size())) tablesApplied++;
+      else rejected++;
+      inSync = holdsTable(f);
+    }
+  }
+}
+
+// Wi-Fi task: stamp and hand over, nothing more
+static void onReceive(const uint8_t*, const uint8_t* data, int len) {
+  received++;
+  if (len <= 0 || (size_t)len > fleetFrameMaxSize) { rejected++; return; }
+  Received r;
+  r.receivedUs = esp_timer_get_time();
+  memcpy(r.buf, data, len);
+  r.len = (uint8_t)len;
+  if (!pending.push(r)) { dropped++; return; }
+  if (drainQueued.exchange(1) == 0 && !httpQueueWork(drain, nullptr)) drainQueued = 0;
+}
+
+bool fleetBegin(FleetRole r, const char* key, FleetTableSource source, FleetTableSink sink,
+                const volatile uint32_t* version, uint32_t periodMs) {
+  macKey = key;
+  macKeyLen = strlen(key);
+  tableSource = source;
+  tableSink = sink;
+  tableVersion = version;
+  if (r == FLEET_OFF || esp_now_init() != ESP_OK) return false;
+  role = r;
+  if (role == FLEET_PEER) return esp_now_register_recv_cb(onReceive) == ESP_OK;
+
+  esp_now_peer_info_t peer = {};
+  memcpy(peer.peer_addr, broadcastAddr, sizeof(broadcastAddr));
+  peer.channel = 0; // whatever the interface is on
+  peer.ifidx = WIFI_IF_AP;
+  peer.encrypt = false;
+  if (esp_now_register_send_cb(onSent) != ESP_OK || esp_now_add_peer(&peer) != ESP_OK) return false;
+  esp_timer_create_args_t args = {};
+  args.callback = onBeaconTimer;
+  args.name = "fleet";
+  return esp_timer_create(&args, &beaconTimer) == ESP_OK && esp_timer_start_periodic(beaconTimer, periodMs * 1000ULL) == ESP_OK;
+}
+
+void fleetWriteMetrics(MetricsWriter& w) {
+  if (role == FLEET_OFF) return;
+  w.gauge("esp32_fleet_role", "Fleet sync role (1 master, 2 peer)", role);
+  if (role == FLEET_MASTER) {
+    w.counter("esp32_fleet_frames_sent_total", "ESP-NOW fleet frames broadcast", sent);
+    w.counter("esp32_fleet_send_errors_total", "ESP-NOW fleet frames the driver refused", sendErrors);
+    return;
+  }
+  int64_t beaconAgeUs = lastBeaconUs < 0 ? -1 : esp_timer_get_time() - lastBeaconUs;
+  w.counter("esp32_fleet_frames_received_total", "ESP-NOW frames received", received);
+  w.counter("esp32_fleet_frames_rejected_total", "ESP-NOW frames dropped for size, version, MAC or a bad table", rejected);
+  w.counter("esp32_fleet_frames_replayed_total", "Authentic fleet frames not newer than the last accepted", replayed);
+  w.counter("esp32_fleet_frames_busy_total", "Fleet frames dropped, queue full", dropped);
+  w.counter("esp32_fleet_tables_applied_total", "Alarm tables taken from the master", tablesApplied);
+  w.counter("esp32_fleet_time_samples_total", "Clock samples taken from the master", timeSamples);
+  w.gauge("esp32_fleet_table_in_sync", "Alarm table matches the master's last announced one (0/1)", inSync);
+  w.gauge("esp32_fleet_beacon_age_seconds", "Time since the last master beacon (-1 never)",
+          beaconAgeUs < 0 ? -1 : beaconAgeUs / 1000000);
+}
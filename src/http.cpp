@@ -0,0 +1,590 @@
+#include "http.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_timer.h"
+#include "trace.h"
+#include <unistd.h>
+#include <algorithm>
+
+struct Route {
+  const char* uri;
+  HTTPMethod method;
+  HttpHandler handler;
+  HttpUploadHandler upload; // streamed body, see httpOnUpload()
+  LatencyHistogram latency; // handler time including the response
+};
+
+static const uint8_t maxRoutes = 32;
+static Route routes[maxRoutes];
+static uint8_t routeCount = 0;
+static HttpHandler notFoundHandler;
+static LatencyHistogram notFoundLatency;
+static LatencyHistogram pollLatency; // one WebServer::handleClient() (sync stack only)
+static int64_t readyUs = 0;          // boot -> listening
+static int64_t firstResponseUs = 0;  // boot -> first request handled, 0 = none yet
+
+static const uint16_t notFoundIndex = 0xFFFF; // in trace records
+
+static uint16_t routeIndex(const Route* route) { return route ? route - routes : notFoundIndex; }
+
+static int64_t beginRequest(const Route* route) {
+  trace(TRACE_REQUEST_BEGIN, routeIndex(route));
+  return esp_timer_get_time();
+}
+
+static void endRequest(const Route* route, LatencyHistogram& h, int64_t start) {
+  int64_t end = esp_timer_get_time();
+  metricsObserve(h, end - start);
+  if (!firstResponseUs) firstResponseUs = end;
+  trace(TRACE_REQUEST_END, routeIndex(route));
+}
+
+static const char* methodName(HTTPMethod m) {
+  switch (m) {
+    case HTTP_GET: return "GET";
+    case HTTP_POST: return "POST";
+    case HTTP_PUT: return "PUT";
+    case HTTP_DELETE: return "DELETE";
+    default: return "OTHER";
+  }
+}
+
+void httpWriteMetrics(MetricsWriter& w) {
+  char labels[80];
+  w.gauge("esp32_boot_http_ready_microseconds", "Boot -> HTTP server listening", readyUs);
+  w.gauge("esp32_boot_first_response_microseconds", "Boot -> first request handled", firstResponseUs);
+  w.histogramHelp("http_request_duration_seconds", "Handler time per route, including sending the response");
+  for (uint8_t i = 0; i < routeCount; ++i) {
+    if (!routes[i].latency.count) continue; // keeps the page short
+    snprintf(labels, sizeof(labels), "route=\"%s\",method=\"%s\"", routes[i].uri, methodName(routes[i].method));
+    w.histogram("http_request_duration_seconds", labels, routes[i].latency);
+  }
+  w.histogram("http_request_duration_seconds", "route=\"<not found>\",method=\"any\"", notFoundLatency);
+#ifndef HTTP_ASYNC
+  w.histogramHelp("http_poll_duration_seconds", "Time spent in one WebServer::handleClient() call");
+  w.histogram("http_poll_duration_seconds", nullptr, pollLatency);
+#endif
+}
+
+static const uint8_t maxCollectedHeaders = 8;
+static const char* collectedHeaders[maxCollectedHeaders];
+static size_t collectedHeaderCount = 0;
+
+bool httpOn(const char* uri, HTTPMethod method, HttpHandler handler) {
+  if (routeCount >= maxRoutes) { log_e("Route table full, %s dropped", uri); return false; }
+  routes[routeCount].uri = uri;
+  routes[routeCount].method = method;
+  routes[routeCount].handler = handler;
+  routeCount++;
+  return true;
+}
+
+bool httpOnUpload(const char* uri, HTTPMethod method, HttpUploadHandler upload, HttpHandler handler) {
+  if (!httpOn(uri, method, handler)) return false;
+  routes[routeCount - 1].upload = upload;
+  return true;
+}
+
+void httpOnNotFound(HttpHandler handler) { notFoundHandler = handler; }
+
+const char* httpRouteUri(uint16_t index) { return index < routeCount ? routes[index].uri : nullptr; }
+const char* httpRouteMethod(uint16_t index) { return index < routeCount ? methodName(routes[index].method) : nullptr; }
+
+void httpCollectHeaders(const char* keys[], size_t count) {
+  for (size_t i = 0; i < count && collectedHeaderCount < maxCollectedHeaders; ++i) {
+    collectedHeaders[collectedHeaderCount++] = keys[i];
+  }
+}
+
+static int hexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+static String urlDecode(const char* s, size_t len) {
+  String out;
+  out.reserve(len);
+  for (size_t i = 0; i < len; ++i) {
+    if (s[i] == '+') { out += ' '; continue; }
+    if (s[i] == '%' && i + 2 < len) {
+      int hi = hexValue(s[i + 1]), lo = hexValue(s[i + 2]);
+      if (hi >= 0 && lo >= 0) { out += (char)(hi * 16 + lo); i += 2; continue; }
+    }
+    out += s[i];
+  }
+  return out;
+}
+
+String HttpRequest::pathArg() {
+  const char* star = routeUri ? strchr(routeUri, '*') : nullptr;
+  if (!star) return String("");
+  String p = path();
+  size_t prefix = star - routeUri;
+  if (p.length() <= prefix) return String("");
+  return urlDecode(p.c_str() + prefix, p.length() - prefix);
+}
+
+void HttpRequest::redirect(const char* location) {
+  sendHeader("Location", location);
+  send(302, "text/plain", "", 0);
+}
+
+static const char eventStreamHeader[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: text/event-stream\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Connection: keep-alive\r\n\r\n"
+    "retry: 3000\n\n";
+
+static bool eventStreamOpen(int slot);
+static bool writeEventStream(int slot, const char* data, size_t len);
+static void closeEventStream(int slot);
+
+// Slots the event being written goes to; one that fails is closed and
+// dropped, the others still get the whole message
+static uint32_t eventTargets = 0;
+
+static void eventWrite(const char* data, size_t len) {
+  for (int i = 0; i < httpMaxEventStreams; ++i) {
+    if (!(eventTargets & (1u << i))) continue;
+    if (!writeEventStream(i, data, len)) { closeEventStream(i); eventTargets &= ~(1u << i); }
+  }
+}
+
+static void eventBegin(uint32_t targets, const char* event) {
+  eventTargets = targets;
+  eventWrite("event: ", 7);
+  eventWrite(event, strlen(event));
+  eventWrite("\ndata: ", 7);
+}
+
+bool httpEventSink(void*, const char* data, size_t len) {
+  eventWrite(data, len);
+  return true; // a closed stream must not cut the event short for the rest
+}
+
+void httpEventEnd() {
+  eventWrite("\n\n", 2);
+  eventTargets = 0;
+}
+
+void httpBroadcastBegin(const char* event) {
+  uint32_t targets = 0;
+  for (int i = 0; i < httpMaxEventStreams; ++i) if (eventStreamOpen(i)) targets |= 1u << i;
+  eventBegin(targets, event);
+}
+
+void httpBroadcastEvent(const char* event, const char* data, size_t len) {
+  httpBroadcastBegin(event);
+  eventWrite(data, len);
+  httpEventEnd();
+}
+
+uint8_t httpEventStreamCount() {
+  uint8_t n = 0;
+  for (int i = 0; i < httpMaxEventStreams; ++i) n += eventStreamOpen(i) ? 1 : 0;
+  return n;
+}
+
+void HttpRequest::beginEvent(const char* event) { eventBegin(eventSlot >= 0 ? 1u << eventSlot : 0, event); }
+
+void HttpRequest::sendEvent(const char* event, const char* data, size_t len) {
+  beginEvent(event);
+  eventWrite(data, len);
+  httpEventEnd();
+}
+
+bool httpStreamSink(void* req, const char* data, size_t len) { return ((HttpRequest*)req)->write(data, len); }
+
+#ifndef HTTP_ASYNC
+// ------------------- Arduino WebServer -------------------
+#include <uri/UriGlob.h>
+
+static WebServer* server = nullptr;
+
+bool HttpRequest::hasArg(const char* name) { return server->hasArg(name); }
+String HttpRequest::arg(const char* name) { return server->arg(name); }
+int HttpRequest::args() { return server->args(); }
+String HttpRequest::argName(int i) { return server->argName(i); }
+String HttpRequest::arg(int i) { return server->arg(i); }
+String HttpRequest::header(const char* name) { return server->header(name); }
+String HttpRequest::path() { return server->uri(); }
+
+// WebServer has already read a non-form body into the "plain" arg
+int HttpRequest::body(char* buf, size_t size) {
+  String plain = server->arg("plain");
+  if (plain.length() > size) return -1;
+  memcpy(buf, plain.c_str(), plain.length());
+  return plain.length();
+}
+void HttpRequest::sendHeader(const char* name, const char* value) { server->sendHeader(name, value); }
+
+void HttpRequest::send(int code, const char* contentType, const char* body, size_t len) {
+  // send_P writes straight from the pointer (flash is memory mapped on ESP32)
+  server->send_P(code, contentType, body, len);
+  responded = true;
+}
+
+// WebServer sends Transfer-Encoding: chunked for an unknown length (HTTP/1.1
+// clients; 1.0 ones read until the close)
+void HttpRequest::beginStream(int code, const char* contentType) {
+  server->setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server->send(code, contentType, "");
+  responded = true;
+}
+
+bool HttpRequest::write(const char* data, size_t len) {
+  server->sendContent(data, len);
+  return server->client().connected();
+}
+
+void HttpRequest::endStream() { server->sendContent("", 0); }
+
+// Event streams: the WiFiClient copy keeps the socket open after WebServer
+// drops its own reference at the end of the request.
+static WiFiClient eventClients[httpMaxEventStreams];
+
+bool HttpRequest::beginEventStream() {
+  for (int i = 0; i < httpMaxEventStreams; ++i) {
+    if (eventClients[i].connected()) continue;
+    eventClients[i] = server->client();
+    eventClients[i].setNoDelay(true);
+    eventClients[i].write((const uint8_t*)eventStreamHeader, sizeof(eventStreamHeader) - 1);
+    eventSlot = i;
+    responded = true;
+    return true;
+  }
+  return false;
+}
+
+static bool eventStreamOpen(int slot) { return eventClients[slot].connected(); }
+
+static bool writeEventStream(int slot, const char* data, size_t len) {
+  return eventClients[slot].write((const uint8_t*)data, len) == len;
+}
+
+static void closeEventStream(int slot) { eventClients[slot].stop(); }
+
+struct Work {
+  void (*fn)(void*);
+  void* arg;
+};
+static QueueHandle_t workQueue = nullptr;
+
+bool httpQueueWork(void (*fn)(void*), void* arg) {
+  Work work = {fn, arg};
+  return workQueue && xQueueSend(workQueue, &work, 0) == pdTRUE;
+}
+
+// WebServer can only be polled. Poll every tick while clients are about;
+// once quiet, wait on the work queue instead so the CPU can idle between
+// polls and a new connection waits at most idlePollMs to be accepted.
+static const uint32_t idlePollMs = 20;
+static const int64_t activeHoldUs = 500000; // keep polling fast this long after a request
+
+static void serverTask(void*) {
+  int64_t lastActiveUs = 0;
+  for (;;) {
+    int64_t start = esp_timer_get_time();
+    server->handleClient();
+    int64_t end = esp_timer_get_time();
+    metricsObserve(pollLatency, end - start);
+    if (server->client().connected()) lastActiveUs = end;
+    TickType_t wait = end - lastActiveUs < activeHoldUs ? 1 : pdMS_TO_TICKS(idlePollMs);
+    Work work;
+    while (xQueueReceive(workQueue, &work, wait) == pdTRUE) { work.fn(work.arg); wait = 0; }
+  }
+}
+
+bool httpBegin(uint16_t port, BaseType_t core, UBaseType_t priority, uint8_t) {
+  server = new WebServer(port);
+  server->collectHeaders(collectedHeaders, collectedHeaderCount);
+  for (uint8_t i = 0; i < routeCount; ++i) {
+    Route* route = &routes[i];
+    WebServer::THandlerFunction fn = [route]() {
+      HttpRequest req(route->uri);
+      int64_t start = beginRequest(route);
+      route->handler(req);
+      endRequest(route, route->latency, start);
+    };
+    if (route->upload) {
+      // A body that is not a form is streamed through server->raw()
+      WebServer::THandlerFunction ufn = [route]() {
+        HttpRequest req(route->uri);
+        HTTPRaw& raw = server->raw();
+        switch (raw.status) {
+          case RAW_START: route->upload(req, HTTP_UPLOAD_BEGIN, nullptr, 0); break;
+          case RAW_WRITE: route->upload(req, HTTP_UPLOAD_DATA, raw.buf, raw.currentSize); break;
+          case RAW_END: route->upload(req, HTTP_UPLOAD_END, nullptr, 0); break;
+          case RAW_ABORTED: route->upload(req, HTTP_UPLOAD_ABORT, nullptr, 0); break;
+        }
+      };
+      server->on(route->uri, route->method, fn, ufn);
+    } else if (strchr(route->uri, '*')) {
+      server->on(UriGlob(route->uri), route->method, fn);
+    } else {
+      server->on(route->uri, route->method, fn);
+    }
+  }
+  server->onNotFound([]() {
+    HttpRequest req;
+    int64_t start = beginRequest(nullptr);
+    if (notFoundHandler) notFoundHandler(req);
+    else req.send(404, "text/plain", "Not found");
+    endRequest(nullptr, notFoundLatency, start);
+  });
+  server->begin();
+  workQueue = xQueueCreate(8, sizeof(Work));
+  if (!workQueue || xTaskCreatePinnedToCore(serverTask, "http", 8192, nullptr, priority, nullptr, core) != pdPASS) {
+    log_e("HTTP server task failed to start");
+    return false;
+  }
+  readyUs = esp_timer_get_time();
+  return true;
+}
+
+#else
+// ------------------- esp_http_server -------------------
+static httpd_handle_t httpd = nullptr;
+
+HttpRequest::HttpRequest(httpd_req_t* req, const char* uri) : routeUri(uri), r(req) {
+  if (httpd_req_get_url_query_str(r, query, sizeof(query)) != ESP_OK) query[0] = '\0';
+
+  // WebServer exposes url-encoded form fields as args; do the same here
+  if (r->method != HTTP_POST || r->content_len == 0) return;
+  if (!header("Content-Type").startsWith("application/x-www-form-urlencoded")) return;
+  size_t used = strlen(query);
+  if (used + 1 + r->content_len >= sizeof(query)) return;
+  char* dst = query + used;
+  if (used) *dst++ = '&';
+  size_t got = 0;
+  while (got < r->content_len) {
+    int n = httpd_req_recv(r, dst + got, r->content_len - got);
+    if (n <= 0) break;
+    got += n;
+  }
+  dst[got] = '\0';
+}
+
+int HttpRequest::body(char* buf, size_t size) {
+  if (r->content_len > size || header("Content-Type").startsWith("application/x-www-form-urlencoded")) return -1;
+  size_t got = 0;
+  while (got < r->content_len) {
+    int n = httpd_req_recv(r, buf + got, r->content_len - got);
+    if (n <= 0) return -1;
+    got += n;
+  }
+  return got;
+}
+
+String HttpRequest::path() {
+  const char* q = strchr(r->uri, '?');
+  return q ? String(r->uri).substring(0, q - r->uri) : String(r->uri);
+}
+
+// index-th "name=value" pair of the query string
+bool HttpRequest::queryAt(int index, String* name, String* value) {
+  const char* p = query;
+  for (int i = 0; *p; ++i) {
+    const char* end = strchr(p, '&');
+    if (!end) end = p + strlen(p);
+    if (i == index) {
+      const char* eq = (const char*)memchr(p, '=', end - p);
+      const char* nameEnd = eq ? eq : end;
+      if (name) *name = urlDecode(p, nameEnd - p);
+      if (value) *value = eq ? urlDecode(eq + 1, end - eq - 1) : String("");
+      return true;
+    }
+    p = *end ? end + 1 : end;
+  }
+  return false;
+}
+
+int HttpRequest::args() {
+  int n = 0;
+  while (queryAt(n, nullptr, nullptr)) ++n;
+  return n;
+}
+
+String HttpRequest::argName(int i) { String name; queryAt(i, &name, nullptr); return name; }
+String HttpRequest::arg(int i) { String value; queryAt(i, nullptr, &value); return value; }
+
+bool HttpRequest::hasArg(const char* name) {
+  String n;
+  for (int i = 0; queryAt(i, &n, nullptr); ++i) if (n == name) return true;
+  return false;
+}
+
+String HttpRequest::arg(const char* name) {
+  String n, v;
+  for (int i = 0; queryAt(i, &n, &v); ++i) if (n == name) return v;
+  return String("");
+}
+
+String HttpRequest::header(const char* name) {
+  size_t len = httpd_req_get_hdr_value_len(r, name);
+  if (len == 0) return String("");
+  char buf[128];
+  if (len >= sizeof(buf) || httpd_req_get_hdr_value_str(r, name, buf, sizeof(buf)) != ESP_OK) return String("");
+  return String(buf);
+}
+
+void HttpRequest::sendHeader(const char* name, const char* value) {
+  size_t nameLen = strlen(name) + 1, valueLen = strlen(value) + 1;
+  if (headerUsed + nameLen + valueLen > sizeof(headerStore)) { log_e("header store full, dropping %s", name); return; }
+  char* n = headerStore + headerUsed;
+  memcpy(n, name, nameLen);
+  char* v = n + nameLen;
+  memcpy(v, value, valueLen);
+  headerUsed += nameLen + valueLen;
+  httpd_resp_set_hdr(r, n, v);
+}
+
+static const char* statusLine(int code) {
+  switch (code) {
+    case 200: return "200 OK";
+    case 201: return "201 Created";
+    case 202: return "202 Accepted";
+    case 204: return "204 No Content";
+    case 302: return "302 Found";
+    case 304: return "304 Not Modified";
+    case 400: return "400 Bad Request";
+    case 404: return "404 Not Found";
+    case 405: return "405 Method Not Allowed";
+    case 409: return "409 Conflict";
+    case 413: return "413 Payload Too Large";
+    case 500: return "500 Internal Server Error";
+    case 503: return "503 Service Unavailable";
+    default: return code < 400 ? "200 OK" : "500 Internal Server Error";
+  }
+}
+
+void HttpRequest::send(int code, const char* contentType, const char* body, size_t len) {
+  httpd_resp_set_status(r, statusLine(code));
+  httpd_resp_set_type(r, contentType);
+  httpd_resp_send(r, body, len);
+  responded = true;
+}
+
+void HttpRequest::beginStream(int code, const char* contentType) {
+  httpd_resp_set_status(r, statusLine(code));
+  httpd_resp_set_type(r, contentType);
+  responded = true; // headers go out with the first chunk
+}
+
+bool HttpRequest::write(const char* data, size_t len) { return httpd_resp_send_chunk(r, data, len) == ESP_OK; }
+
+void HttpRequest::endStream() { httpd_resp_send_chunk(r, nullptr, 0); }
+
+// Event streams are plain sockets written with httpd_socket_send after the
+// handler returns without a response; httpd keeps the session open.
+static int eventFds[httpMaxEventStreams]; // -1 = free, set in httpBegin()
+
+bool HttpRequest::beginEventStream() {
+  int fd = httpd_req_to_sockfd(r);
+  for (int i = 0; i < httpMaxEventStreams; ++i) {
+    if (eventFds[i] >= 0) continue;
+    eventFds[i] = fd;
+    eventSlot = i;
+    responded = true;
+    if (!writeEventStream(i, eventStreamHeader, sizeof(eventStreamHeader) - 1)) closeEventStream(i);
+    return true;
+  }
+  return false;
+}
+
+static bool eventStreamOpen(int slot) { return eventFds[slot] >= 0; }
+
+static bool writeEventStream(int slot, const char* data, size_t len) {
+  return eventFds[slot] >= 0 && httpd_socket_send(httpd, eventFds[slot], data, len, 0) == (int)len;
+}
+
+static void closeEventStream(int slot) {
+  if (eventFds[slot] < 0) return;
+  httpd_sess_trigger_close(httpd, eventFds[slot]);
+  eventFds[slot] = -1;
+}
+
+// httpd closes sockets on error, LRU purge or client disconnect
+static void onSocketClose(httpd_handle_t, int fd) {
+  for (int i = 0; i < httpMaxEventStreams; ++i) if (eventFds[i] == fd) eventFds[i] = -1;
+  close(fd);
+}
+
+bool httpQueueWork(void (*fn)(void*), void* arg) {
+  return httpd && httpd_queue_work(httpd, fn, arg) == ESP_OK;
+}
+
+// Server task only, like every handler
+static uint8_t uploadBuf[httpUploadChunkSize];
+
+static bool streamUpload(Route* route, HttpRequest& req, httpd_req_t* r) {
+  route->upload(req, HTTP_UPLOAD_BEGIN, nullptr, 0);
+  uint8_t timeouts = 0;
+  for (size_t left = r->content_len; left;) {
+    int n = httpd_req_recv(r, (char*)uploadBuf, std::min(left, sizeof(uploadBuf)));
+    if (n == HTTPD_SOCK_ERR_TIMEOUT && ++timeouts < 3) continue; // recv_wait_timeout each
+    if (n <= 0) { route->upload(req, HTTP_UPLOAD_ABORT, nullptr, 0); return false; }
+    route->upload(req, HTTP_UPLOAD_DATA, uploadBuf, n);
+    left -= n;
+    timeouts = 0;
+  }
+  route->upload(req, HTTP_UPLOAD_END, nullptr, 0);
+  return true;
+}
+
+static esp_err_t dispatch(httpd_req_t* r) {
+  Route* route = (Route*)r->user_ctx;
+  HttpRequest req(r, route->uri);
+  int64_t start = beginRequest(route);
+  if (route->upload && !streamUpload(route, req, r)) { // closes the socket
+    trace(TRACE_REQUEST_END, routeIndex(route));
+    return ESP_FAIL;
+  }
+  route->handler(req);
+  if (!req.sent()) req.send(500);
+  endRequest(route, route->latency, start);
+  return ESP_OK;
+}
+
+static esp_err_t dispatchNotFound(httpd_req_t* r, httpd_err_code_t) {
+  HttpRequest req(r, nullptr);
+  int64_t start = beginRequest(nullptr);
+  if (notFoundHandler) notFoundHandler(req);
+  if (!req.sent()) req.send(404, "text/plain", "Not found", 9);
+  endRequest(nullptr, notFoundLatency, start);
+  return ESP_OK;
+}
+
+bool httpBegin(uint16_t port, BaseType_t core, UBaseType_t priority, uint8_t maxSockets) {
+  for (int i = 0; i < httpMaxEventStreams; ++i) eventFds[i] = -1;
+
+  httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+  config.server_port = port;
+  config.core_id = core;
+  config.task_priority = priority;
+  config.stack_size = 10240; // handlers keep the query (~1 KB) and a response chunk on it
+  config.max_uri_handlers = maxRoutes;
+  config.max_open_sockets = maxSockets;
+  config.lru_purge_enable = true; // a new client evicts the least recently used idle socket
+  config.uri_match_fn = httpd_uri_match_wildcard;
+  config.close_fn = onSocketClose;
+  if (httpd_start(&httpd, &config) != ESP_OK) { log_e("httpd_start failed"); return false; }
+
+  for (uint8_t i = 0; i < routeCount; ++i) {
+    httpd_uri_t uri = {};
+    uri.uri = routes[i].uri;
+    uri.method = (httpd_method_t)routes[i].method;
+    uri.handler = dispatch;
+    uri.user_ctx = &routes[i];
+    if (httpd_register_uri_handler(httpd, &uri) != ESP_OK) { log_e("Could not register %s", uri.uri); return false; }
+  }
+  httpd_register_err_handler(httpd, HTTPD_404_NOT_FOUND, dispatchNotFound);
+  readyUs = esp_timer_get_time();
+  return true;
+}
+#endif
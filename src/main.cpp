@@ -1,11 +1,14 @@
 /*
   ESP32: LED controller + Multiple Alarms + Timer (rings a buzzer)
   - Configurable pins at top
-  - Web UI (add/remove alarms client-side)
+  - Web UI (add/remove alarms client-side), served gzipped from flash (see web/)
   - Alarms stored in Preferences (non-volatile)
   - Alarms validated and sorted
-  - NTP time sync used to trigger alarms (HH:MM)
-  - Timer counts down and rings buzzer when finished
+  - Station + AP: NTP over the station's uplink (credentials via /wifi),
+    browser time as the fallback; alarms run on that clock
+  - Alarm rules: weekdays or a one-shot date, sound, LEDs on/off (faded in
+    ahead of time if asked), snooze; timers can switch LEDs as well
+  - Named timers (up to maxTimers at once) ring the buzzer when they finish
   - Supports active and passive buzzers (see buzzerIsPassive)
 
   Author: Oday A. Rabaiah + fixes
@@ -13,30 +16,121 @@
 
 #include <Arduino.h>
 #include <WiFi.h>
-#include <WebServer.h>
 #include <Preferences.h>
 #include <time.h>
-#include <vector>
-#include <algorithm>
+#include <assert.h>
+#include "http.h"
+#include "web_assets.h" // generated from web/ by scripts/embed_web.py
+#include "wallclock.h"
+#include "alarm_set.h"
+#include "alarm_blob.h"
+#include "spsc_queue.h"
+#include "json_writer.h"
+#include "json_reader.h"
+#include "persist.h"
+#include "timer_table.h"
+#include "action_queue.h"
+#include "buzzer.h"
+#include "outputs.h"
+#include "dimmer.h"
+#include "metrics.h"
+#include "power.h"
+#include "udp_control.h"
+#include "ota.h"
+#include "trace.h"
+#include "fleet.h"
+#include "fleet_frame.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include <atomic>
 
 // ------------------- CONFIG -------------------
 const char* ssid = "ESP32";
 const char* password = "33n&00d1";
 
 // Pins
-const uint8_t LED1pin = 5;         // GPIO for LED1
-const uint8_t LED2pin = 4;         // GPIO for LED2
+// On/off outputs. The name is the channel's /status field and its
+// /<name>on, /<name>off routes; the index is its bit in /leds masks.
+constexpr OutputChannel outputChannels[] = {
+  {5, "led1"},
+  {4, "led2"},
+};
+static_assert(outputPinsValid(outputChannels), "output on a missing, input-only or flash pin");
+const size_t outputCount = sizeof(outputChannels) / sizeof(outputChannels[0]);
+static_assert(outputCount <= 8, "alarm rules address outputs with 8 bits");
 const uint8_t buzzerPin = 12;      // GPIO for buzzer
 const bool buzzerIsPassive = false; // false = active buzzer, true = passive (tone)
 
-// Timer tone parameters (for passive buzzer)
-const int buzzerToneHz = 2000;     
-const int buzzerDurationMs = 1800; // total duration for timer finish (ms)
+// Buzzer patterns, played by RMT/LEDC hardware (see buzzer.h)
+const uint16_t buzzerToneHz = 2000; // passive buzzer: tone of untuned steps
+const BuzzerStep timerBeeps[] = {{150, 100, 0}, {150, 100, 0}, {150, 600, 0}};
+const BuzzerPattern timerPattern = {timerBeeps, 3, 3};
+// Rhythm only on an active buzzer, a little tune on a passive one
+const BuzzerStep alarmTune[] = {{200, 50, 1319}, {200, 50, 1568}, {200, 50, 2093}, {400, 600, 1568}};
+const BuzzerPattern alarmPattern = {alarmTune, 4, 4};
+// By AlarmSound: what an alarm rule's sound= plays
+const BuzzerPattern* const alarmSounds[alarmSoundCount] = {nullptr, &alarmPattern, &timerPattern};
+const char* const alarmSoundNames[alarmSoundCount] = {"none", "tune", "beeps"};
 
 // Alarm storage
 const char* prefsNamespace = "alarms"; 
-const char* prefsKey = "alarm_csv";   
-const uint8_t maxAlarms = 20;         
+const char* prefsKey = "alarm_bin";       // versioned blob, see alarm_blob.h
+const char* prefsLegacyKey = "alarm_csv"; // pre-blob CSV, migrated once on boot
+const char* prefsOutputsKey = "outputs";  // LED state, restored on boot
+const char* prefsTimerKey = "timer";      // running timer, resumed on boot
+const char* prefsWifiKey = "wifi";        // station credentials
+const char* prefsClockKey = "clock";      // crystal drift correction
+// Records other than wifi are also kept in RTC memory for warm boots (see
+// persist.h). Running timers are re-copied there this often, which bounds
+// what the RTC's RC clock can get wrong about how long ago that was.
+const uint32_t timerSnapshotRefreshS = 10;
+const uint8_t maxAlarms = 64;         // responses stream; bound by the NVS blob (8 B a rule, 518 B) and /setAlarms
+const uint8_t maxTimers = 32;         // concurrent countdown timers, see /timers
+const uint8_t maxLedActions = 8;      // LED changes queued for the control task
+const size_t maxBatchBytes = 2048;    // POST /batch body, parsed in place
+
+// Concurrent connections. WebServer serves one at a time regardless; the
+// HTTP_ASYNC stack keeps up to httpMaxSockets open (lwIP reserves 3 of its 10).
+const uint8_t maxApClients = 4;
+const uint8_t httpMaxSockets = 7;
+
+// Tasks: HTTP on the Wi-Fi core, timer/buzzer/alarm logic on the other
+const BaseType_t networkCore = 0;
+const BaseType_t controlCore = 1;
+const UBaseType_t networkPriority = 3;
+const UBaseType_t controlPriority = 10; // above everything Arduino/HTTP runs at
+const UBaseType_t persistPriority = 1;  // flash writes only when nothing else runs
+const uint32_t controlOverrunUs = 2000;  // longer control task iterations show in /trace
+
+// Power (see power.h). Wi-Fi needs the 80 MHz APB clock, so DFS bottoms out there.
+const uint16_t cpuMaxMhz = 240;
+const uint16_t cpuMinMhz = 80;
+const wifi_ps_type_t wifiPowerSave = WIFI_PS_MAX_MODEM; // station interface only
+// Optional supply current sense amplifier on an ADC pin, -1 when not fitted
+const int currentSensePin = -1;
+const float currentSenseMaPerMv = 1.0f; // e.g. 100 mOhm shunt into a 10x amplifier
+const uint32_t currentSampleMs = 10000;
+
+// UDP control (see udp_control.h), for panels that need less latency than
+// HTTP. Off until a key is set; panels must be given the same one.
+const char* udpControlKey = "";             // HMAC-SHA256 key
+const uint16_t udpControlPort = 4210;
+const char* udpStatusGroup = "239.255.42.1"; // status multicast, nullptr for none
+const uint16_t udpStatusPort = 4211;
+
+// Fleet sync over ESP-NOW (see fleet.h): one master's alarms and clock on
+// every peer. Off until a role and a key are set; all units need the same
+// key and Wi-Fi channel.
+const FleetRole fleetRole = FLEET_OFF;
+const char* fleetKey = "";          // HMAC-SHA256 key
+const uint32_t fleetBeaconMs = 1000;
+
+// Firmware updates (see ota.h): off until a key is set. A new image that
+// has not served HTTP within this long after boot is rolled back.
+const char* otaKey = "";              // HMAC-SHA256 key, signs each upload's digest and release
+const uint32_t firmwareRelease = 1;   // bump for every build you ship: /update only takes higher ones
+const uint32_t otaConfirmTimeoutMs = 60000;
+const uint8_t otaSelfCheckTries = 10;   // GET /status to itself, a second apart
 
 // NTP config
 const char* ntpServer = "pool.ntp.org";
@@ -44,287 +138,1906 @@ const long gmtOffset_sec = 0;
 const int daylightOffset_sec = 0;
 
 // ------------------- GLOBALS -------------------
-WebServer server(80);
 Preferences prefs;
 
-bool LED1status = false;
-bool LED2status = false;
-
-// Timer state
-bool timerRunning = false;
-uint64_t timerTargetMs = 0;
-
-// Buzzer non-blocking state
-bool buzzerActive = false;
-uint64_t buzzerEndMs = 0;
-
-// Alarms in RAM
-std::vector<String> alarms;
-
-// Track last minute checked to avoid repeated alarm triggers
-int lastCheckedMinute = -1;
-
-// For passive buzzer on ESP32 we'll use ledc (if passive)
-const int buzzerLedcChannel = 0;
-const int buzzerLedcFreq = 2000;
-const int buzzerLedcResolution = 8; // bits
-
-// ------------------- HTML -------------------
-String createHTML() {
-  String str = "<!DOCTYPE html><html>";
-  str += "<head><meta name=\"viewport\" content=\"width=device-width, initial-scale=1.0, user-scalable=no\">";
-  str += "<style>";
-  str += "body{font-family:Arial,sans-serif;color:#444;text-align:center;margin:0;padding:0 10px;}";
-  str += ".title{font-size:28px;font-weight:bold;letter-spacing:2px;margin:40px 0 20px;}";
-  str += ".led-control{display:flex;align-items:center;justify-content:center;margin:20px 0;gap:20px;}";
-  str += ".led-label{font-size:20px;width:80px;text-align:left;padding-left:10px;}";
-  str += ".toggle-switch{width:120px;height:60px;position:relative;}";
-  str += ".slider{position:absolute;width:120px;height:60px;background-color:#f1f1f1;transition:.4s;border-radius:60px;border:1px solid #ddd;}";
-  str += ".slider:before{content:'';position:absolute;height:52px;width:52px;left:4px;top:4px;background-color:white;transition:.4s;border-radius:50%;box-shadow:0 2px 5px rgba(0,0,0,.3);}";
-  str += ".slider.on{background-color:#4285f4;border:none;}.slider.on:before{transform:translateX(60px);}";
-  str += "a{display:block;height:100%;width:100%;text-decoration:none;color:inherit;}";
-  str += ".section{margin-top:30px;padding-bottom:20px;border-bottom:1px solid #eee;}";
-  str += ".section-title{font-size:20px;margin-bottom:12px;}";
-  str += ".input-time{font-size:18px;padding:8px 10px;border-radius:8px;border:1px solid #ccc;margin:6px 0;}";
-  str += ".btn{margin-top:10px;padding:10px 16px;font-size:16px;background-color:#4285f4;border:none;color:white;border-radius:10px;cursor:pointer;}";
-  str += ".btn.red{background-color:#e53935;}";
-  str += ".timer-input{width:70px;font-size:18px;padding:8px;border:1px solid #ccc;border-radius:8px;margin:6px;}";
-  str += ".alarm-item{margin:6px 0;display:flex;gap:8px;align-items:center;justify-content:center;}";
-  str += ".alarm-item input{font-size:18px;padding:6px;border-radius:8px;border:1px solid #ccc;}";
-  str += ".small-btn{padding:6px 8px;font-size:14px;border-radius:8px;border:none;background:#777;color:white;cursor:pointer;}";
-  str += "</style></head><body>";
-  str += "<h1 class='title'>LED CONTROLLER</h1>";
-
-  // LED1
-  str += "<div class='led-control'><span class='led-label'>LED 1</span><div class='toggle-switch'>";
-  str += LED1status ? "<a href='/led1off'><div class='slider on'></div></a>" : "<a href='/led1on'><div class='slider'></div></a>";
-  str += "</div></div>";
-
-  // LED2
-  str += "<div class='led-control'><span class='led-label'>LED 2</span><div class='toggle-switch'>";
-  str += LED2status ? "<a href='/led2off'><div class='slider on'></div></a>" : "<a href='/led2on'><div class='slider'></div></a>";
-  str += "</div></div>";
-
-  // Alarms section
-  str += "<div class='section'><div class='section-title'>Alarms</div>";
-  str += "<form id='alarmsForm' action='/setAlarms' method='GET'>";
-  str += "<div id='alarmList'>";
-  for (size_t i = 0; i < alarms.size(); ++i) {
-    str += "<div class='alarm-item'><input type='time' name='alarm" + String(i) + "' value='" + alarms[i] + "' required>";
-    str += "<button type='button' class='small-btn' onclick='removeAlarm(" + String(i) + ")'>Delete</button></div>";
-  }
-  if (alarms.size() == 0) {
-    str += "<div class='alarm-item'><input type='time' name='alarm0' class='input-time' required></div>";
-  }
-  str += "</div>";
-  str += "<button type='button' class='btn' onclick='addAlarm()'>Add Alarm</button> &nbsp;";
-  str += "<button type='submit' class='btn'>Save Alarms</button> &nbsp;";
-  str += "<button type='button' class='btn red' onclick='clearAlarms()'>Clear All</button>";
-  str += "</form></div>";
-
-  // Timer section
-  str += "<div class='section'><div class='section-title'>Timer (rings buzzer)</div>";
-  str += "<form action='/startTimer' method='GET'>";
-  str += "<input type='number' name='hours' class='timer-input' placeholder='HH' min='0' max='23'>";
-  str += "<input type='number' name='minutes' class='timer-input' placeholder='MM' min='0' max='59'>";
-  str += "<input type='number' name='seconds' class='timer-input' placeholder='SS' min='0' max='59'><br>";
-  str += "<button type='submit' class='btn'>Start Timer</button></form>";
-  str += "<form action='/stopTimer' method='GET' style='margin-top:8px;'><button type='submit' class='btn red'>Stop Timer</button></form>";
-
-  // Status area
-  str += "<div style='margin-top:16px;font-size:16px;' id='statusArea'></div>";
-
-  // Scripts
-  str += "<script>";
-  str += "function addAlarm(){var list=document.getElementById('alarmList');var idx=list.children.length;var div=document.createElement('div');div.className='alarm-item';var input=document.createElement('input');input.type='time';input.name='alarm'+idx;input.required=true;var btn=document.createElement('button');btn.type='button';btn.className='small-btn';btn.innerText='Delete';btn.onclick=function(){div.remove();renumberAlarms();};div.appendChild(input);div.appendChild(btn);list.appendChild(div);}";
-  str += "function renumberAlarms(){var list=document.getElementById('alarmList');for(var i=0;i<list.children.length;i++){var inp=list.children[i].querySelector('input');if(inp) inp.name='alarm'+i;var btn=list.children[i].querySelector('button');if(btn) btn.setAttribute('onclick','removeAlarm('+i+')');}}";
-  str += "function removeAlarm(i){var list=document.getElementById('alarmList');if(list.children[i]) list.children[i].remove();renumberAlarms();}";
-  str += "function clearAlarms(){fetch('/clearAlarms').then(()=>location.reload());}";
-  str += "function fetchStatus(){fetch('/status').then(r=>r.json()).then(j=>{var s=document.getElementById('statusArea');var txt='';txt+='Timer: '+(j.timerRunning?('running, remaining: '+j.remaining):'stopped')+'<br>';txt+='Alarms stored: '+j.alarmsCount+'<br>';txt+='LED1: '+(j.led1?'ON':'OFF')+' | LED2: '+(j.led2?'ON':'OFF')+'<br>';s.innerHTML=txt;}).catch(e=>{});} setInterval(fetchStatus,2000);fetchStatus();";
-  str += "</script>";
-
-  str += "</body></html>";
-  return str;
-}
+// Station credentials, an empty ssid means AP only. Written by the network
+// task; the persist task copies them under wifiMux.
+struct WifiRecord {
+  uint8_t version;
+  char ssid[33];
+  char password[65];
+};
+WifiRecord wifiCreds = {};
+portMUX_TYPE wifiMux = portMUX_INITIALIZER_UNLOCKED;
+
+// State below is written by the control task only; HTTP handlers read it
+// and request changes through controlQueue.
+OutputBank<outputCount> outputs(outputChannels);
+volatile uint32_t outputBits = 0; // bit i = outputChannels[i] is on
+// 0..255, 255 when switched on; the first dimmerMaxChannels can dim/fade
+uint8_t brightness[outputCount];
+
+// Timers. Deadlines are on the 64-bit esp_timer_get_time() base (us),
+// which does not wrap like millis() does after ~49.7 days.
+TimerTable<maxTimers> timers; // guarded by timerMux (read from other tasks)
+portMUX_TYPE timerMux = portMUX_INITIALIZER_UNLOCKED;
+volatile uint8_t timersActive = 0;        // timers.size() as of the last re-arm
+esp_timer_handle_t timerExpiry = nullptr; // one-shot for the soonest deadline
+uint32_t nextTimerId = 1;                 // network task only; 0 is /startTimer's
+const uint32_t legacyTimerId = 0;
+
+// Alarm rules in RAM, sorted by minute of day. Edited by the network task;
+// the control task reads it under alarmsMux when re-arming and firing.
+AlarmSet<maxAlarms> alarms;
+portMUX_TYPE alarmsMux = portMUX_INITIALIZER_UNLOCKED;
+volatile uint32_t alarmsVersion = 0; // bumped on every edit; the /alarms ETag
+
+// Bumped after every LED, timer or alarm change; with the minute and clock
+// source it identifies a /status body, so it is that route's ETag
+std::atomic<uint32_t> stateVersion(0);
+
+// Alarm scheduler: one esp_timer one-shot armed for the next alarm
+esp_timer_handle_t alarmTimer = nullptr;
+AlarmArming arming;              // local minute numbers, control task only
+int64_t armedEpochMs = 0;        // wall time alarmTimer is armed for
+int64_t armedMonoUs = 0;         // the same on the esp_timer base, for lateness
+
+// The alarm last fired rings (again after each snooze) until dismissed
+esp_timer_handle_t snoozeTimer = nullptr;
+AlarmRule ringingRule = {};              // control task only
+volatile bool alarmRinging = false;
+volatile int64_t snoozeUntilMs = 0;      // wall time, 0 = not snoozed
+
+// LED changes made by alarms and timers, run by the control task so none
+// of it needs the network. One esp_timer one-shot for the soonest.
+enum ActionTag : uint8_t { ACTION_NOW, ACTION_LEAD_IN };
+ActionQueue<maxLedActions> ledActions;   // control task only
+esp_timer_handle_t actionTimer = nullptr;
+int32_t leadInAfter = -1;                // armLeadIn()'s arguments, to queue the next step
+int64_t leadInAfterMs = 0;
+int64_t leadInStepEndMs = 0;             // wall time the queued lead-in step ends at
+bool leadInOn = false;                   // fading up (else down)
+const uint32_t leadInStepMs = 60000;     // LEDC fades are at most 65 s, so long lead-ins step
+
+// TimerEntry::action: channel bits, plus whether they go on or off
+const uint16_t timerLedsOn = 0x100;
+
+// Network task -> control task commands
+enum ControlOp : uint8_t { CMD_OUTPUTS, CMD_BRIGHTNESS, CMD_TIMER_START, CMD_TIMER_CANCEL, CMD_TIMER_STOP, CMD_ALARMS_CHANGED,
+                          CMD_ALARM_SNOOZE, CMD_ALARM_DISMISS };
+struct ControlCmd {
+  ControlOp op;
+  uint8_t channel;  // CMD_BRIGHTNESS
+  uint32_t value;   // CMD_OUTPUTS: channel bits, CMD_BRIGHTNESS: level, CMD_TIMER_START: milliseconds
+  uint32_t id;      // CMD_OUTPUTS: channel mask, CMD_BRIGHTNESS: fade ms, CMD_TIMER_START/CANCEL: timer
+  char label[timerLabelSize]; // CMD_TIMER_START
+  uint16_t action;            // CMD_TIMER_START: TimerEntry::action
+};
+const uint8_t controlQueueSize = 16;    // also the most commands one POST /batch can make
+SpscQueue<ControlCmd, controlQueueSize> controlQueue; // producer: network task only
+bool sendCommand(const ControlCmd& cmd);
+bool sendCommand(ControlOp op, uint8_t channel = 0, uint32_t value = 0);
+bool sendOutputs(uint32_t mask, uint32_t bits);
+
+// Control task notification bits
+const uint32_t EVT_COMMAND = 1 << 0;
+const uint32_t EVT_ALARM = 1 << 1;
+const uint32_t EVT_CLOCK = 1 << 2;
+const uint32_t EVT_TIMER = 1 << 3;
+const uint32_t EVT_BUZZER = 1 << 4; // next melody note due
+const uint32_t EVT_FADE = 1 << 5;   // an LED fade finished
+const uint32_t EVT_POWER = 1 << 6;  // time for a supply current reading
+const uint32_t EVT_SNOOZE = 1 << 7; // a snoozed alarm is due again
+const uint32_t EVT_ACTION = 1 << 8; // a queued LED action is due
+
+TaskHandle_t controlTaskHandle = nullptr;
+
+// /metrics (HTTP routes keep their own, see httpWriteMetrics())
+LatencyHistogram alarmLateness;     // alarm due -> control task acting on it
+LatencyHistogram timerLateness;     // per finished timer
+LatencyHistogram controlIteration;  // control task work per wake-up
+
+// /events: push only what changed, plus a 1 Hz tick while the timer runs
+struct StatusSnapshot {
+  bool timeSynced;
+  uint8_t clockSource;
+  int minute;
+  uint8_t timers;
+  uint32_t alarmsVersion;
+  bool alarmRinging;
+  bool snoozed;
+  uint32_t outputs;
+  uint8_t brightness[outputCount];
+};
+StatusSnapshot lastPushed = {};  // server task only
+std::atomic<uint32_t> pushPending(0);
+esp_timer_handle_t tickTimer = nullptr;
+esp_timer_handle_t powerTimer = nullptr; // only with a current sense pin
 
 // ------------------- HELPERS -------------------
-void saveAlarmsToPrefs() {
-  std::sort(alarms.begin(), alarms.end());
-  String csv = "";
-  for (size_t i = 0; i < alarms.size() && i < maxAlarms; ++i) {
-    if (i) csv += ",";
-    csv += alarms[i];
+// Records written by the persist task (see persist.h)
+// v1 was {version, led1, led2}
+struct OutputsRecord {
+  uint8_t version;
+  uint8_t count;     // channels when written
+  uint16_t reserved;
+  uint32_t bits;
+};
+
+// v1 held a single timer; v2 on are a header plus `count` entries. The
+// wall time v1-v3 stored was never usable: timers are restored at boot,
+// before any clock source. The RTC copy's own age stands in for it.
+struct TimerRecordV1 {
+  uint8_t version;
+  uint8_t running;
+  uint32_t remainingMs;     // at the time of writing
+  int64_t deadlineEpochMs;  // 0 when the wall clock was not synced
+};
+
+struct TimerRecordHeaderV3 {
+  uint8_t version;
+  uint8_t count;
+  uint16_t reserved;
+  int64_t savedAtEpochMs;
+};
+
+struct TimerRecordHeader {
+  uint8_t version;
+  uint8_t count;
+  uint16_t reserved;
+};
+
+struct TimerRecordEntryV2 {
+  uint32_t id;
+  uint32_t remainingMs;
+  char label[timerLabelSize];
+};
+
+struct TimerRecordEntry {
+  uint32_t id;
+  uint32_t remainingMs;     // when written
+  uint16_t action;
+  uint16_t reserved;
+  char label[timerLabelSize];
+};
+
+const uint8_t outputsRecordVersion = 2;
+const uint8_t timerRecordVersion = 4; // v2 entries had no action, v2-v3 headers a wall time
+const uint8_t wifiRecordVersion = 1;
+const uint8_t clockRecordVersion = 1;
+const size_t timerRecordSize = sizeof(TimerRecordHeader) + maxTimers * sizeof(TimerRecordEntry);
+static_assert(timerRecordSize <= persistMaxRecordSize, "timer record exceeds the persist scratch buffer");
+static_assert(alarmBlobSize(maxAlarms) <= persistMaxRecordSize, "alarm blob exceeds the persist scratch buffer");
+static_assert(alarmBlobSize(maxAlarms) <= fleetMaxTableSize, "alarm blob exceeds a fleet table");
+
+uint64_t timerRemainingMs();
+
+size_t encodeAlarmsRecord(uint8_t* buf, size_t size) {
+  AlarmSet<maxAlarms> copy;
+  portENTER_CRITICAL(&alarmsMux);
+  copy = alarms;
+  portEXIT_CRITICAL(&alarmsMux);
+  return encodeAlarmBlob(copy, buf, size);
+}
+
+size_t encodeOutputsRecord(uint8_t* buf, size_t size) {
+  OutputsRecord rec = {outputsRecordVersion, (uint8_t)outputs.size(), 0, outputBits};
+  memcpy(buf, &rec, sizeof(rec));
+  return sizeof(rec);
+}
+
+size_t encodeTimerRecord(uint8_t* buf, size_t size) {
+  TimerRecordHeader hdr = {};
+  hdr.version = timerRecordVersion;
+  TimerRecordEntry* entries = (TimerRecordEntry*)(buf + sizeof(hdr));
+  int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL(&timerMux);
+  hdr.count = timers.size();
+  for (uint8_t i = 0; i < hdr.count; ++i) {
+    const TimerEntry& t = timers.at(i);
+    int64_t left = t.deadline - now;
+    entries[i].id = t.id;
+    entries[i].remainingMs = left > 0 ? (uint32_t)((left + 999) / 1000) : 0;
+    entries[i].action = t.action;
+    entries[i].reserved = 0;
+    memcpy(entries[i].label, t.label, timerLabelSize);
   }
-  prefs.putString(prefsKey, csv);
+  portEXIT_CRITICAL(&timerMux);
+  memcpy(buf, &hdr, sizeof(hdr));
+  return sizeof(hdr) + hdr.count * sizeof(TimerRecordEntry);
 }
 
-void loadAlarmsFromPrefs() {
-  alarms.clear();
-  String csv = prefs.getString(prefsKey, "");
-  if (csv.length() == 0) return;
+size_t encodeWifiRecord(uint8_t* buf, size_t size) {
+  portENTER_CRITICAL(&wifiMux);
+  memcpy(buf, &wifiCreds, sizeof(wifiCreds));
+  portEXIT_CRITICAL(&wifiMux);
+  return sizeof(wifiCreds);
+}
+
+struct ClockRecord {
+  uint8_t version;
+  uint8_t driftKnown;
+  uint16_t reserved;
+  int32_t driftPpb;
+};
+
+size_t encodeClockRecord(uint8_t* buf, size_t size) {
+  ClockRecord rec = {clockRecordVersion, wallclockDriftKnown(), 0, wallclockDriftPpb()};
+  memcpy(buf, &rec, sizeof(rec));
+  return sizeof(rec);
+}
+
+// One-time import of the old "HH:MM,HH:MM" record
+bool migrateLegacyAlarms() {
+  String csv = prefs.getString(prefsLegacyKey, "");
+  if (csv.length() == 0) return false;
   int start = 0;
   while (start < (int)csv.length()) {
     int comma = csv.indexOf(',', start);
     if (comma == -1) comma = csv.length();
     String token = csv.substring(start, comma);
     token.trim();
-    if (token.length() == 5 && token.charAt(2) == ':') {
-      int h = token.substring(0,2).toInt();
-      int m = token.substring(3,5).toInt();
-      if (h < 24 && m < 60) alarms.push_back(token);
-    }
+    uint16_t minute;
+    if (parseHHMM(token.c_str(), &minute)) alarms.add(minute);
     start = comma + 1;
-    if (alarms.size() >= maxAlarms) break;
+    if (alarms.full()) break;
   }
+  persistMarkDirty(PERSIST_ALARMS);
+  persistFlush(); // before dropping the old key
+  prefs.remove(prefsLegacyKey);
+  Serial.printf("Migrated %u alarms from %s\n", alarms.size(), prefsLegacyKey);
+  return true;
 }
 
-void triggerBuzzer(uint32_t durationMs) {
-  buzzerActive = true;
-  buzzerEndMs = millis() + durationMs;
-  if (!buzzerIsPassive) digitalWrite(buzzerPin, HIGH);
-  else ledcWriteTone(buzzerLedcChannel, buzzerToneHz);
+void loadAlarmsFromPrefs() {
+  alarms.clear();
+  uint8_t blob[alarmBlobSize(maxAlarms)];
+  size_t len = persistLoad(PERSIST_ALARMS, blob, sizeof(blob));
+  if (len == 0) { if (prefs.isKey(prefsLegacyKey)) migrateLegacyAlarms(); return; }
+  if (!decodeAlarmBlob(blob, len, &alarms)) Serial.println("Stored alarms are corrupt, starting empty");
 }
 
-void stopBuzzer() {
-  buzzerActive = false;
-  digitalWrite(buzzerPin, LOW);
-  if (buzzerIsPassive) ledcWriteTone(buzzerLedcChannel, 0);
+void restoreTimer(uint32_t id, int64_t remainingMs, const char* label, uint16_t action = 0) {
+  // Expired while we were off: let it ring now rather than drop it
+  if (remainingMs < 1) remainingMs = 1;
+  timers.start(id, esp_timer_get_time() + remainingMs * 1000, label, action);
+  if (id >= nextTimerId) nextTimerId = id + 1;
+  Serial.printf("Resuming timer %u (%s), %lld ms left\n", id, label, (long long)remainingMs);
 }
 
-String getCurrentHHMM() {
-  struct tm timeinfo;
-  if (!getLocalTime(&timeinfo)) return String("");
-  char buf[6];
-  snprintf(buf, sizeof(buf), "%02d:%02d", timeinfo.tm_hour, timeinfo.tm_min);
-  return String(buf);
+// Refills the timer table. Runs before the control task exists, which
+// arms timerExpiry when it starts.
+void loadTimersFromPrefs() {
+  uint8_t buf[sizeof(TimerRecordHeaderV3) + maxTimers * sizeof(TimerRecordEntry)]; // a full v3 table too
+  int64_t ageUs;
+  size_t len = persistLoad(PERSIST_TIMER, buf, sizeof(buf), &ageUs);
+  if (len == sizeof(TimerRecordV1) && buf[0] == 1) {
+    TimerRecordV1 rec;
+    memcpy(&rec, buf, sizeof(rec));
+    if (!rec.running) return;
+    restoreTimer(legacyTimerId, rec.remainingMs, "timer");
+    return;
+  }
+  TimerRecordHeader hdr;
+  if (len < sizeof(hdr)) return;
+  memcpy(&hdr, buf, sizeof(hdr));
+  bool legacy = hdr.version == 2 || hdr.version == 3;
+  size_t headerSize = legacy ? sizeof(TimerRecordHeaderV3) : sizeof(hdr);
+  size_t entrySize = hdr.version == 2 ? sizeof(TimerRecordEntryV2) : sizeof(TimerRecordEntry);
+  if ((hdr.version != timerRecordVersion && !legacy) || hdr.count > maxTimers || len != headerSize + hdr.count * entrySize) {
+    Serial.println("Stored timers are corrupt, dropping them");
+    return;
+  }
+  // The RTC copy knows its own age; an NVS one resumes where it was written,
+  // as nothing tells how long the power was off
+  int64_t elapsedMs = ageUs >= 0 ? ageUs / 1000 : 0;
+  for (uint8_t i = 0; i < hdr.count; ++i) {
+    TimerRecordEntry e = {};
+    const uint8_t* src = buf + headerSize + i * entrySize;
+    if (hdr.version == 2) {
+      TimerRecordEntryV2 old;
+      memcpy(&old, src, sizeof(old));
+      e.id = old.id;
+      e.remainingMs = old.remainingMs;
+      memcpy(e.label, old.label, timerLabelSize);
+    } else {
+      memcpy(&e, src, sizeof(e));
+    }
+    e.label[timerLabelSize - 1] = '\0';
+    restoreTimer(e.id, (int64_t)e.remainingMs - elapsedMs, e.label, e.action);
+  }
 }
 
-// ------------------- HTTP Handlers -------------------
-void handleRoot() { server.send(200, "text/html", createHTML()); }
-void handleStatus() {
-  String remaining = "0s";
-  if (timerRunning) {
-    long msLeft = (long)(timerTargetMs > millis() ? (timerTargetMs - millis()) : 0);
-    long s = msLeft / 1000;
-    remaining = String(s / 3600) + "h " + String((s % 3600) / 60) + "m " + String(s % 60) + "s";
-  }
-  String json = "{";
-  json += "\"timerRunning\":" + String(timerRunning ? "true" : "false") + ",";
-  json += "\"remaining\":\"" + remaining + "\",";
-  json += "\"alarmsCount\":" + String(alarms.size()) + ",";
-  json += "\"led1\":" + String(LED1status ? "true" : "false") + ",";
-  json += "\"led2\":" + String(LED2status ? "true" : "false");
-  json += "}";
-  server.send(200, "application/json", json);
-}
-
-void handleLed1On() { LED1status=true; digitalWrite(LED1pin,HIGH); server.sendHeader("Location","/"); server.send(302,"text/plain",""); }
-void handleLed1Off(){ LED1status=false; digitalWrite(LED1pin,LOW); server.sendHeader("Location","/"); server.send(302,"text/plain",""); }
-void handleLed2On() { LED2status=true; digitalWrite(LED2pin,HIGH); server.sendHeader("Location","/"); server.send(302,"text/plain",""); }
-void handleLed2Off(){ LED2status=false; digitalWrite(LED2pin,LOW); server.sendHeader("Location","/"); server.send(302,"text/plain",""); }
-
-void handleSetAlarms() {
-  alarms.clear();
-  for (uint8_t i = 0; i < server.args(); ++i) {
-    String name = server.argName(i);
-    String val = server.arg(i);
-    if (name.startsWith("alarm")) {
-      if (val.length() == 5 && val.charAt(2) == ':') {
-        int h = val.substring(0,2).toInt();
-        int m = val.substring(3,5).toInt();
-        if (h<24 && m<60) alarms.push_back(val);
-      }
+void loadWifiFromPrefs() {
+  uint8_t buf[sizeof(WifiRecord)];
+  if (persistLoad(PERSIST_WIFI, buf, sizeof(buf)) != sizeof(WifiRecord) || buf[0] != wifiRecordVersion) return;
+  memcpy(&wifiCreds, buf, sizeof(wifiCreds));
+  wifiCreds.ssid[sizeof(wifiCreds.ssid) - 1] = '\0';
+  wifiCreds.password[sizeof(wifiCreds.password) - 1] = '\0';
+}
+
+void loadClockFromPrefs() {
+  ClockRecord rec;
+  if (persistLoad(PERSIST_CLOCK, (uint8_t*)&rec, sizeof(rec)) != sizeof(rec) || rec.version != clockRecordVersion) return;
+  wallclockRestore(rec.driftPpb, rec.driftKnown);
+}
+
+// Replays saved LED state through the control task.
+void restoreOutputs() {
+  uint8_t buf[sizeof(OutputsRecord)];
+  size_t len = persistLoad(PERSIST_OUTPUTS, buf, sizeof(buf));
+  uint32_t bits;
+  if (len == 3 && buf[0] == 1) bits = (buf[1] ? 1 : 0) | (buf[2] ? 2 : 0); // v1: led1, led2
+  else if (len == sizeof(OutputsRecord) && buf[0] == outputsRecordVersion) bits = ((OutputsRecord*)buf)->bits;
+  else return;
+  sendOutputs(outputs.allMask(), bits); // channels added since are off
+}
+
+// ------------------- LED ACTIONS -------------------
+void setBrightness(uint8_t ch, uint8_t level, uint16_t fadeMs);
+
+void armActionTimer() {
+  esp_timer_stop(actionTimer);
+  const LedAction* next = ledActions.soonest();
+  if (!next) return;
+  int64_t delayUs = next->due - esp_timer_get_time();
+  esp_timer_start_once(actionTimer, delayUs > 0 ? (uint64_t)delayUs : 1);
+}
+
+void queueLedAction(const LedAction& a) {
+  if (!ledActions.push(a)) Serial.printf("LED action for 0x%02x dropped, queue full\n", a.leds);
+}
+
+// Queue the next step of the earliest alarm lead-in: the rule's LEDs fade
+// linearly towards their state over the `lead` minutes before it fires,
+// one step of up to leadInStepMs at a time, starting no earlier than
+// fromMs (wall time). Arguments as armAlarmAfter(). Only one lead-in runs
+// at a time; one that overlaps an earlier one starts when that has fired.
+void armLeadIn(int32_t after, int64_t afterStartMs, int64_t fromMs = 0) {
+  ledActions.removeTag(ACTION_LEAD_IN);
+  leadInAfter = after;
+  leadInAfterMs = afterStartMs;
+  int index = -1;
+  portENTER_CRITICAL(&alarmsMux);
+  int32_t start = alarms.nextLeadIn(after, &index);
+  AlarmRule rule = index >= 0 ? alarms[index] : AlarmRule();
+  portEXIT_CRITICAL(&alarmsMux);
+  if (start < 0) return;
+  int64_t startMs = afterStartMs + (int64_t)(start - after) * 60000;
+  int64_t fireMs = startMs + rule.lead * 60000LL;
+  int64_t nowMs = wallclockNowMs();
+  int64_t dueMs = std::max(std::max(startMs, nowMs), fromMs);
+  if (dueMs >= fireMs) return; // done; the alarm itself sets the final state
+  int64_t endMs = std::min(dueMs + (int64_t)leadInStepMs, fireMs);
+  uint8_t level = (uint8_t)(255 * (endMs - startMs) / (fireMs - startMs));
+  leadInOn = rule.ledsOn();
+  leadInStepEndMs = endMs;
+  LedAction a = {esp_timer_get_time() + std::max<int64_t>(dueMs - nowMs, 0) * 1000, (uint32_t)(endMs - dueMs),
+                 rule.leds, (uint8_t)(leadInOn ? level : 255 - level), ACTION_LEAD_IN};
+  queueLedAction(a);
+}
+
+// Control task: apply every action due at `now`, then re-arm actionTimer.
+// Lead-in steps only ever move a channel towards the rule's state, so a
+// light already brighter (or darker) is left alone. Returns whether
+// anything changed.
+bool runLedActions(int64_t now) {
+  LedAction a;
+  bool changed = false, leadIn = false;
+  while (ledActions.popDue(now, &a)) {
+    for (size_t ch = 0; ch < outputCount; ++ch) {
+      if (!(a.leds >> ch & 1)) continue;
+      if (a.tag == ACTION_LEAD_IN && (leadInOn ? brightness[ch] >= a.level : brightness[ch] <= a.level)) continue;
+      setBrightness(ch, a.level, (uint16_t)a.fadeMs);
+      changed = true;
     }
-    if (alarms.size()>=maxAlarms) break;
+    leadIn |= a.tag == ACTION_LEAD_IN;
+  }
+  if (leadIn) armLeadIn(leadInAfter, leadInAfterMs, leadInStepEndMs);
+  if (changed) persistMarkDirty(PERSIST_OUTPUTS);
+  armActionTimer();
+  return changed;
+}
+
+// ------------------- ALARM SCHEDULER -------------------
+void onAlarmTimer(void*) { xTaskNotify(controlTaskHandle, EVT_ALARM, eSetBits); }
+void onTimerExpiry(void*) { xTaskNotify(controlTaskHandle, EVT_TIMER, eSetBits); }
+void onSnoozeTimer(void*) { xTaskNotify(controlTaskHandle, EVT_SNOOZE, eSetBits); }
+void onActionTimer(void*) { xTaskNotify(controlTaskHandle, EVT_ACTION, eSetBits); }
+void onClockChange() {
+  xTaskNotify(controlTaskHandle, EVT_CLOCK, eSetBits);
+  // Drift is re-measured on NTP samples only; fleet samples come every
+  // beacon and would keep restarting the persist debounce
+  if (wallclockSource() != WALLCLOCK_FLEET) persistMarkDirty(PERSIST_CLOCK);
+}
+void onBuzzerNote() { xTaskNotify(controlTaskHandle, EVT_BUZZER, eSetBits); }
+void onPowerTimer(void*) { xTaskNotify(controlTaskHandle, EVT_POWER, eSetBits); }
+bool IRAM_ATTR onFadeEnd() {
+  BaseType_t woken = pdFALSE;
+  xTaskNotifyFromISR(controlTaskHandle, EVT_FADE, eSetBits, &woken);
+  return woken == pdTRUE;
+}
+
+// Arm alarmTimer for the first rule firing strictly after local minute
+// number `from`, where fromStartMs is the wall time at which it began.
+// Every rule is evaluated (a few adds each), so edits need no bookkeeping.
+void armAlarmAfter(int32_t from, int64_t fromStartMs) {
+  esp_timer_stop(alarmTimer);
+  arming.armedAt = -1;
+  armLeadIn(from, fromStartMs);
+  portENTER_CRITICAL(&alarmsMux);
+  int32_t next = alarms.nextFire(from);
+  portEXIT_CRITICAL(&alarmsMux);
+  if (next < 0) return;
+  arming.armedAt = next;
+  armedEpochMs = fromStartMs + (int64_t)(next - from) * 60000;
+  int64_t delayMs = armedEpochMs - wallclockNowMs();
+  uint64_t delayUs = delayMs > 0 ? (uint64_t)delayMs * 1000ULL : 1;
+  armedMonoUs = esp_timer_get_time() + delayUs;
+  esp_timer_start_once(alarmTimer, delayUs);
+}
+
+// Re-arm from the current time; call after alarms or the clock change.
+// An alarm due this minute whose event is still pending stays armed.
+void scheduleAlarms() {
+  int32_t minute = wallclockLocalMinute();
+  if (minute < 0) { esp_timer_stop(alarmTimer); arming.armedAt = -1; ledActions.removeTag(ACTION_LEAD_IN); return; }
+  int64_t nowMs = wallclockNowMs();
+  int32_t from = arming.searchFrom(minute);
+  armAlarmAfter(from, nowMs - nowMs % 60000 - (int64_t)(minute - from) * 60000);
+}
+
+// Queue a change for the control task. Only the network task may call this.
+bool sendCommand(const ControlCmd& cmd) {
+  if (!controlQueue.push(cmd)) return false;
+  xTaskNotify(controlTaskHandle, EVT_COMMAND, eSetBits);
+  return true;
+}
+
+bool sendCommand(ControlOp op, uint8_t channel, uint32_t value) {
+  ControlCmd cmd = {op, channel, value, 0, ""};
+  return sendCommand(cmd);
+}
+
+bool sendOutputs(uint32_t mask, uint32_t bits) {
+  ControlCmd cmd = {CMD_OUTPUTS, 0, bits & mask, mask, ""};
+  return sendCommand(cmd);
+}
+
+bool sendTimerStart(uint32_t id, uint32_t ms, const char* label, uint16_t action = 0) {
+  ControlCmd cmd = {CMD_TIMER_START, 0, ms, id, "", action};
+  strncpy(cmd.label, label, timerLabelSize - 1);
+  return sendCommand(cmd);
+}
+
+// ------------------- HTTP Handlers -------------------
+// API clients skip the redirect back to the page (and its reload) with
+// ?json=1 or Accept: application/json, and get a bodiless 204 instead
+void redirectHome(HttpRequest& req) {
+  if (req.arg("json") == "1" || req.header("Accept").indexOf("application/json") >= 0) req.send(204);
+  else req.redirect("/");
+}
+void sendBusy(HttpRequest& req) { req.send(503,"text/plain","Busy"); }
+
+// Conditional GET: set the validator, and answer 304 (no body) when the
+// client already has it. Clients must revalidate every time.
+bool sendNotModified(HttpRequest& req, const char* etag) {
+  req.sendHeader("ETag", etag);
+  req.sendHeader("Cache-Control", "no-cache");
+  if (req.header("If-None-Match") != etag) return false;
+  req.send(304);
+  return true;
+}
+
+// The UI is static gzipped blobs in flash, sent straight from there. The
+// page revalidates, so a new firmware's UI shows up; the CSS/JS it links
+// have content-hashed URLs and are cached for good.
+void handleRoot(HttpRequest& req) {
+  if (sendNotModified(req, WEB_INDEX_ETAG)) return;
+  req.sendHeader("Content-Encoding", "gzip");
+  req.send(200, "text/html", (const char*)WEB_INDEX_GZ, WEB_INDEX_GZ_LEN);
+}
+
+void handleAsset(HttpRequest& req, const WebAsset& asset) {
+  req.sendHeader("Cache-Control", "public, max-age=31536000, immutable");
+  req.sendHeader("Content-Encoding", "gzip");
+  req.send(200, asset.type, (const char*)asset.gz, asset.len);
+}
+
+StatusSnapshot currentStatus() {
+  StatusSnapshot now;
+  now.timeSynced = wallclockSynced();
+  now.clockSource = wallclockSource();
+  now.minute = wallclockMinuteOfDay();
+  now.timers = timersActive;
+  now.alarmsVersion = alarmsVersion;
+  now.alarmRinging = alarmRinging;
+  now.snoozed = snoozeUntilMs != 0;
+  now.outputs = outputBits;
+  memcpy(now.brightness, brightness, sizeof(brightness));
+  return now;
+}
+
+uint64_t remainingMsAt(int64_t deadline, int64_t now) {
+  return deadline > now ? (uint64_t)(deadline - now + 999) / 1000 : 0;
+}
+
+// Of the timer due first, 0 when none is running
+uint64_t timerRemainingMs() {
+  portENTER_CRITICAL(&timerMux);
+  const TimerEntry* next = timers.soonest();
+  int64_t deadline = next ? next->deadline : 0;
+  portEXIT_CRITICAL(&timerMux);
+  return next ? remainingMsAt(deadline, esp_timer_get_time()) : 0;
+}
+
+// Just the times, as the page lists them
+void writeAlarmsArray(JsonWriter& w, const char* key) {
+  char hhmm[6];
+  w.beginArray(key);
+  for (uint16_t i = 0; i < alarms.size(); ++i) {
+    formatHHMM(alarms[i].minute, hhmm);
+    w.string(nullptr, hhmm);
+  }
+  w.endArray();
+}
+
+// In the form POST /alarms takes it
+void writeAlarmRule(JsonWriter& w, const AlarmRule& r) {
+  char text[28];
+  w.beginObject();
+  formatHHMM(r.minute, text);
+  w.string("time", text);
+  if (r.oneShot()) { formatDate(r.date, text); w.string("date", text); }
+  else { formatWeekdays(r.days, text); w.string("days", text); }
+  w.string("sound", alarmSoundNames[r.sound]);
+  w.beginArray("leds");
+  for (size_t i = 0; i < outputs.size(); ++i) if (r.leds >> i & 1) w.string(nullptr, outputs[i].name);
+  w.endArray();
+  w.string("ledState", r.ledsOn() ? "on" : "off");
+  w.number("lead", r.lead);
+  w.number("snooze", r.snoozeMinutes());
+  w.endObject();
+}
+
+// All fields, or only those that differ from *since
+void writeStatusJson(JsonWriter& w, const StatusSnapshot& now, const StatusSnapshot* since) {
+  char text[24];
+  w.beginObject();
+  if (!since || since->timeSynced != now.timeSynced || since->clockSource != now.clockSource || since->minute != now.minute) {
+    w.boolean("timeSynced", now.timeSynced);
+    w.string("clockSource", wallclockSourceName((WallclockSource)now.clockSource));
+    if (now.minute >= 0) formatHHMM(now.minute, text); else text[0] = '\0';
+    w.string("time", text);
+  }
+  if (!since || since->timers != now.timers || now.timers) {
+    uint64_t msLeft = now.timers ? timerRemainingMs() : 0;
+    unsigned long s = msLeft / 1000;
+    snprintf(text, sizeof(text), "%luh %lum %lus", s / 3600, (s % 3600) / 60, s % 60);
+    w.boolean("timerRunning", now.timers > 0);
+    w.number("timers", now.timers);
+    w.number("remainingMs", (int64_t)msLeft);
+    w.string("remaining", text);
+  }
+  if (!since || since->alarmsVersion != now.alarmsVersion) {
+    w.number("alarmsCount", alarms.size());
+    writeAlarmsArray(w, "alarms");
+  }
+  if (!since || since->alarmRinging != now.alarmRinging || since->snoozed != now.snoozed) {
+    w.boolean("alarmRinging", now.alarmRinging);
+    w.boolean("snoozed", now.snoozed);
+  }
+  uint32_t changedOutputs = since ? since->outputs ^ now.outputs : outputs.allMask();
+  for (size_t i = 0; i < outputs.size(); ++i) {
+    if (changedOutputs >> i & 1) w.boolean(outputs[i].name, now.outputs >> i & 1);
+  }
+  if (!since || memcmp(since->brightness, now.brightness, sizeof(now.brightness)) != 0) {
+    w.beginObject("brightness");
+    for (size_t i = 0; i < outputs.size(); ++i) w.number(outputs[i].name, now.brightness[i]);
+    w.endObject();
+  }
+  w.endObject();
+}
+
+void handleStatus(HttpRequest& req) {
+  StatusSnapshot now = currentStatus();
+  // A running timer's remainingMs changes by itself, so no validator then
+  if (now.timers) {
+    req.sendHeader("Cache-Control", "no-store");
+  } else {
+    char etag[32];
+    snprintf(etag, sizeof(etag), "\"s%u-%d-%u\"", stateVersion.load(), now.minute, now.clockSource);
+    if (sendNotModified(req, etag)) return;
+  }
+  JsonResponse w(req);
+  writeStatusJson(w, now, nullptr);
+}
+
+// Server task: send the delta since the last push to every /events stream
+UdpFrame udpStatusFrame(const StatusSnapshot& s) {
+  uint8_t flags = (s.alarmRinging ? udpStatusRinging : 0) | (s.snoozed ? udpStatusSnoozed : 0) | (s.timers ? udpStatusTimer : 0);
+  UdpFrame f = {UDP_STATUS, flags, UDP_OK, s.outputs, 0, 0}; // udpMulticast() signs it as ours
+  return f;
+}
+
+void pushStatus(void*) {
+  pushPending = 0;
+  StatusSnapshot now = currentStatus();
+  static uint32_t multicastVersion = 0;
+  if (udpControlKey[0] && stateVersion.load() != multicastVersion) {
+    multicastVersion = stateVersion.load();
+    udpMulticast(udpStatusFrame(now));
+  }
+  // The event is only begun once a chunk is ready, so an empty delta ("{}",
+  // still staged at the end) is dropped without sending anything
+  static bool begun;
+  begun = false;
+  ChunkSink sink = [](void*, const char* data, size_t len) {
+    if (!begun) { httpBroadcastBegin("status"); begun = true; }
+    return httpEventSink(nullptr, data, len);
+  };
+  char chunk[httpChunkSize];
+  JsonWriter w(chunk, sizeof(chunk), sink, nullptr);
+  writeStatusJson(w, now, &lastPushed);
+  lastPushed = now;
+  if (httpEventStreamCount() == 0 || (!begun && w.length() <= 2)) return;
+  w.flush();
+  httpEventEnd();
+}
+
+// Any task: coalesces into a single pending push
+void statusChanged() {
+  if (pushPending.exchange(1) == 0 && !httpQueueWork(pushStatus, nullptr)) pushPending = 0;
+}
+
+void onTickTimer(void*) {
+  statusChanged();
+  static uint32_t ticks = 0;
+  if (++ticks % timerSnapshotRefreshS == 0) persistRefreshSnapshot(PERSIST_TIMER);
+}
+
+void handleEvents(HttpRequest& req) {
+  if (!req.beginEventStream()) { req.send(503, "text/plain", "Too many event streams"); return; }
+  char chunk[httpChunkSize];
+  req.beginEvent("status");
+  JsonWriter w(chunk, sizeof(chunk), httpEventSink, nullptr);
+  writeStatusJson(w, currentStatus(), nullptr);
+  w.flush();
+  httpEventEnd();
+}
+
+// Channel by name or 1-based number ("led2" or "2"), or -1
+int parseChannel(const String& v) {
+  int ch = outputs.find(v.c_str());
+  if (ch >= 0) return ch;
+  long n = v.toInt();
+  return n >= 1 && n <= (long)outputs.size() && String(n) == v ? n - 1 : -1;
+}
+
+bool parseState(const String& v, bool* on) {
+  if (v == "on" || v == "1" || v == "true") { *on = true; return true; }
+  if (v == "off" || v == "0" || v == "false") { *on = false; return true; }
+  return false;
+}
+
+// The parsers below read HttpRequest args or, for POST /batch, the fields
+// of one operation (BatchArgs); they return the error for a 400, or nullptr.
+
+// ch=<name|n>&state=on|off, or &brightness=0..255[&fadeMs=]
+template <class Args>
+const char* parseLedCommand(Args& req, ControlCmd* cmd) {
+  int ch = parseChannel(req.arg("ch"));
+  if (ch < 0) return "Expected ch=<channel>";
+  if (req.hasArg("brightness")) {
+    long level = req.arg("brightness").toInt();
+    long fadeMs = req.hasArg("fadeMs") ? req.arg("fadeMs").toInt() : 0;
+    if (level < 0 || level > 255 || fadeMs < 0 || fadeMs > 65535) return "Expected brightness=0..255, fadeMs=0..65535";
+    if (ch >= dimmerMaxChannels && level != 0 && level != 255) return "Channel cannot dim";
+    *cmd = ControlCmd{CMD_BRIGHTNESS, (uint8_t)ch, (uint32_t)level, (uint32_t)fadeMs, ""};
+  } else {
+    bool on;
+    if (!parseState(req.arg("state"), &on)) return "Expected state=on|off or brightness=";
+    *cmd = ControlCmd{CMD_OUTPUTS, 0, on ? 1u << ch : 0, 1u << ch, ""};
+  }
+  return nullptr;
+}
+
+// GET /led, as parseLedCommand()
+void handleLed(HttpRequest& req) {
+  ControlCmd cmd;
+  const char* error = parseLedCommand(req, &cmd);
+  if (error) { req.send(400,"text/plain",error); return; }
+  if (sendCommand(cmd)) redirectHome(req); else sendBusy(req);
+}
+
+// Old per-channel routes: /<name>on, /<name>off
+void handleLegacyLed(HttpRequest& req) {
+  String p = req.path().substring(1);
+  bool on = p.endsWith("on");
+  if (on || p.endsWith("off")) p.remove(p.length() - (on ? 2 : 3));
+  int ch = outputs.find(p.c_str());
+  if (ch < 0 || p.length() == req.path().length() - 1) { req.send(404,"text/plain","Not found"); return; }
+  if (sendOutputs(1u << ch, on ? 1u << ch : 0)) redirectHome(req); else sendBusy(req);
+}
+
+void sendOutputsJson(HttpRequest& req, uint32_t bits) {
+  char buf[16 + outputCount * 24];
+  JsonWriter w(buf, sizeof(buf));
+  w.beginObject();
+  for (size_t i = 0; i < outputs.size(); ++i) w.boolean(outputs[i].name, bits >> i & 1);
+  w.endObject();
+  req.send(200, "application/json", w.c_str(), w.length());
+}
+
+void handleGetLeds(HttpRequest& req) { sendOutputsJson(req, outputBits); }
+
+// led1=on&led2=off..., all=on|off
+template <class Args>
+const char* parseOutputArgs(Args& req, uint32_t* mask, uint32_t* bits) {
+  *mask = *bits = 0;
+  int argCount = req.args();
+  for (int i = 0; i < argCount; ++i) {
+    String name = req.argName(i);
+    bool on;
+    int ch = name == "all" ? -2 : outputs.find(name.c_str());
+    if (ch == -1 || !parseState(req.arg(i), &on)) return "Expected <channel>=on|off";
+    uint32_t m = ch == -2 ? outputs.allMask() : 1u << ch;
+    *mask |= m;
+    *bits = on ? *bits | m : *bits & ~m;
+  }
+  return *mask ? nullptr : "Expected <channel>=on|off";
+}
+
+// POST /leds, as parseOutputArgs(). One command, so every listed channel
+// switches in the same register write.
+void handleSetLeds(HttpRequest& req) {
+  uint32_t mask, bits;
+  const char* error = parseOutputArgs(req, &mask, &bits);
+  if (error) { req.send(400,"text/plain",error); return; }
+  if (!sendOutputs(mask, bits)) { sendBusy(req); return; }
+  sendOutputsJson(req, (outputBits & ~mask) | bits); // as it will be once applied
+}
+
+// After any edit of `alarms` (network task only)
+void alarmsChanged() {
+  alarmsVersion++;
+  stateVersion++;
+  persistMarkDirty(PERSIST_ALARMS);
+  sendCommand(CMD_ALARMS_CHANGED);
+}
+
+void handleSetAlarms(HttpRequest& req) {
+  AlarmSet<maxAlarms> updated;
+  int argCount = req.args();
+  for (int i = 0; i < argCount; ++i) {
+    String name = req.argName(i);
+    String val = req.arg(i);
+    uint16_t minute;
+    if (!name.startsWith("alarm") || !parseHHMM(val.c_str(), &minute)) continue;
+    int existing = alarms.find(minute); // the form only has times: keep the rest of a rule
+    if (existing >= 0) updated.add(alarms[existing]);
+    else updated.add(minute);
+    if (updated.full()) break;
   }
-  saveAlarmsToPrefs();
-  server.sendHeader("Location","/");
-  server.send(302,"text/plain","");
+  portENTER_CRITICAL(&alarmsMux);
+  alarms = updated;
+  portEXIT_CRITICAL(&alarmsMux);
+  alarmsChanged();
+  redirectHome(req);
+}
+
+// Server task: the fleet master's table (fleet.h), applied like an edit here
+bool applyFleetAlarms(const uint8_t* table, size_t len) {
+  AlarmSet<maxAlarms> updated;
+  if (!decodeAlarmBlob(table, len, &updated)) return false;
+  portENTER_CRITICAL(&alarmsMux);
+  alarms = updated;
+  portEXIT_CRITICAL(&alarmsMux);
+  alarmsChanged();
+  return true;
 }
 
-void handleClearAlarms() {
+void handleClearAlarms(HttpRequest& req) {
+  portENTER_CRITICAL(&alarmsMux);
   alarms.clear();
-  prefs.remove(prefsKey);
-  server.send(200,"text/plain","OK");
+  portEXIT_CRITICAL(&alarmsMux);
+  alarmsChanged();
+  req.send(200,"text/plain","OK");
+}
+
+// REST: GET /alarms, POST /alarms (time=HH:MM plus the optional rule
+// fields below), DELETE /alarms/HH:MM, POST /alarms/snooze|dismiss.
+// Each edit is one in-place insert/remove and one coalesced persist.
+void sendAlarmsJson(HttpRequest& req, int code) {
+  JsonResponse w(req, code);
+  w.beginObject();
+  w.number("count", alarms.size());
+  w.number("max", maxAlarms);
+  writeAlarmsArray(w, "alarms");
+  w.beginArray("rules");
+  for (uint16_t i = 0; i < alarms.size(); ++i) writeAlarmRule(w, alarms[i]);
+  w.endArray();
+  w.endObject();
+}
+
+void handleGetAlarms(HttpRequest& req) {
+  char etag[16];
+  snprintf(etag, sizeof(etag), "\"a%u\"", alarmsVersion);
+  if (sendNotModified(req, etag)) return;
+  sendAlarmsJson(req, 200);
+}
+
+// leds=channels (led1,2) and ledState=on|off (default on), as alarms and
+// timers take them
+template <class Args>
+const char* parseLedArgs(Args& req, uint8_t* leds, bool* on) {
+  String list = req.arg("leds");
+  for (int start = 0; start < (int)list.length();) {
+    int comma = list.indexOf(',', start);
+    if (comma < 0) comma = list.length();
+    int ch = parseChannel(list.substring(start, comma));
+    if (ch < 0) return "Unknown channel in leds=";
+    *leds |= 1 << ch;
+    start = comma + 1;
+  }
+  String state = req.hasArg("ledState") ? req.arg("ledState") : String("on");
+  if (state != "on" && state != "off") return "Expected ledState=on or off";
+  *on = state == "on";
+  return nullptr;
+}
+
+// time=HH:MM, then either days=daily|weekdays|weekends|mon,tue,.. (default
+// daily) or date=YYYY-MM-DD for a one-shot; sound=none|tune|beeps, leds=
+// and ledState= as above, lead=minutes to fade the LEDs in (or out) before
+// it fires (max 63), snooze=minutes (0 = none, max 63). replace=1 allows
+// overwriting a rule with another schedule at the same time.
+template <class Args>
+const char* parseAlarmRule(Args& req, AlarmRule* rule) {
+  if (!parseHHMM(req.arg("time").c_str(), &rule->minute)) return "Expected time=HH:MM";
+  *rule = dailyAlarm(rule->minute);
+  if (req.hasArg("date")) {
+    int32_t day;
+    if (!parseDate(req.arg("date").c_str(), &day) || day <= 0 || day > UINT16_MAX) return "Expected date=YYYY-MM-DD";
+    rule->days = 0;
+    rule->date = day;
+    int32_t now = wallclockLocalMinute();
+    if (now >= 0 && alarmNextFire(*rule, now) < 0) return "That time has passed";
+  } else if (req.hasArg("days") && !parseWeekdays(req.arg("days").c_str(), &rule->days)) {
+    return "Expected days=daily, weekdays, weekends or mon,tue,...";
+  }
+  if (req.hasArg("sound")) {
+    String sound = req.arg("sound");
+    uint8_t i = 0;
+    while (i < alarmSoundCount && sound != alarmSoundNames[i]) ++i;
+    if (i == alarmSoundCount) return "Expected sound=none, tune or beeps";
+    rule->sound = i;
+  }
+  bool on;
+  const char* error = parseLedArgs(req, &rule->leds, &on);
+  if (error) return error;
+  long lead = req.hasArg("lead") ? req.arg("lead").toInt() : 0;
+  if (lead < 0 || lead > alarmMaxLead) return "Expected lead=0..63";
+  rule->lead = lead;
+  long snooze = req.hasArg("snooze") ? req.arg("snooze").toInt() : alarmDefaultSnooze;
+  if (snooze < 0 || snooze > alarmSnoozeMask) return "Expected snooze=0..63";
+  rule->flags = (on ? alarmLedsOn : 0) | (uint8_t)snooze;
+  return nullptr;
+}
+
+// One rule per minute: a rule with the same schedule as the one at its
+// minute updates it, another schedule is 409 unless replace=1
+const char* alarmConflict = "Another rule is set for that time (replace=1 to overwrite it)";
+
+template <class Args>
+bool alarmConflicts(Args& req, const AlarmSet<maxAlarms>& set, const AlarmRule& rule) {
+  int existing = set.find(rule.minute);
+  return existing >= 0 && !alarmSameSchedule(set[existing], rule) && req.arg("replace") != "1";
+}
+
+void handleAddAlarm(HttpRequest& req) {
+  AlarmRule rule;
+  const char* error = parseAlarmRule(req, &rule);
+  if (error) { req.send(400,"text/plain",error); return; }
+  int existing = alarms.find(rule.minute);
+  if (existing >= 0 && memcmp(&alarms[existing], &rule, sizeof(rule)) == 0) { sendAlarmsJson(req, 200); return; } // idempotent
+  if (alarmConflicts(req, alarms, rule)) { req.send(409,"text/plain",alarmConflict); return; }
+  portENTER_CRITICAL(&alarmsMux);
+  bool stored = alarms.put(rule);
+  portEXIT_CRITICAL(&alarmsMux);
+  if (!stored) { req.send(409,"text/plain","Alarm list full"); return; }
+  alarmsChanged();
+  sendAlarmsJson(req, existing >= 0 ? 200 : 201);
+}
+
+void handleAlarmAction(HttpRequest& req) {
+  String action = req.pathArg();
+  ControlOp op;
+  if (action == "snooze") op = CMD_ALARM_SNOOZE;
+  else if (action == "dismiss") op = CMD_ALARM_DISMISS;
+  else { req.send(404,"text/plain","Expected /alarms/snooze or /alarms/dismiss"); return; }
+  if (!alarmRinging) { req.send(409,"text/plain","No alarm ringing"); return; }
+  if (sendCommand(op)) req.send(202); else sendBusy(req);
 }
 
-void handleStartTimer() {
+// Server task, after a one-shot fired: drop it so it is not listed forever
+void pruneAlarms(void*) {
+  int32_t now = wallclockLocalMinute();
+  if (now < 0) return;
+  portENTER_CRITICAL(&alarmsMux);
+  uint16_t removed = alarms.removeExpired(now);
+  portEXIT_CRITICAL(&alarmsMux);
+  if (removed) alarmsChanged();
+}
+
+void handleDeleteAlarm(HttpRequest& req) {
+  uint16_t minute;
+  if (!parseHHMM(req.pathArg().c_str(), &minute)) { req.send(400,"text/plain","Expected /alarms/HH:MM"); return; }
+  portENTER_CRITICAL(&alarmsMux);
+  bool removed = alarms.remove(minute);
+  portEXIT_CRITICAL(&alarmsMux);
+  if (!removed) { req.send(404,"text/plain","No such alarm"); return; }
+  alarmsChanged();
+  sendAlarmsJson(req, 200);
+}
+
+void handleStartTimer(HttpRequest& req) {
   int hours=0,minutes=0,seconds=0;
-  if(server.hasArg("hours")) hours=server.arg("hours").toInt();
-  if(server.hasArg("minutes")) minutes=server.arg("minutes").toInt();
-  if(server.hasArg("seconds")) seconds=server.arg("seconds").toInt();
+  if(req.hasArg("hours")) hours=req.arg("hours").toInt();
+  if(req.hasArg("minutes")) minutes=req.arg("minutes").toInt();
+  if(req.hasArg("seconds")) seconds=req.arg("seconds").toInt();
   if(hours<0) hours=0; if(minutes<0) minutes=0; if(seconds<0) seconds=0;
   uint64_t totalSec=(uint64_t)hours*3600+(uint64_t)minutes*60+(uint64_t)seconds;
-  if(totalSec==0){ timerRunning=false; server.sendHeader("Location","/"); server.send(302,"text/plain",""); return;}
-  timerTargetMs=millis()+totalSec*1000ULL;
-  timerRunning=true;
-  server.sendHeader("Location","/"); server.send(302,"text/plain","");
+  // Restarts the one legacy timer; 0 stops every timer as it always has
+  bool queued = totalSec==0 ? sendCommand(CMD_TIMER_STOP) : sendTimerStart(legacyTimerId,(uint32_t)std::min<uint64_t>(totalSec*1000ULL,UINT32_MAX),"timer");
+  if(queued) redirectHome(req); else sendBusy(req);
+}
+
+void handleStopTimer(HttpRequest& req){ if(sendCommand(CMD_TIMER_STOP)) redirectHome(req); else sendBusy(req); }
+
+// REST: GET /timers, POST /timers (ms=, or hours/minutes/seconds, label=,
+// leds= and ledState= to switch when it finishes), DELETE /timers/<id>. Starting/cancelling is applied by the control task.
+void handleGetTimers(HttpRequest& req) {
+  static TimerEntry list[maxTimers]; // handlers all run on the server task
+  portENTER_CRITICAL(&timerMux);
+  uint8_t n = timers.size();
+  for (uint8_t i = 0; i < n; ++i) list[i] = timers.at(i);
+  portEXIT_CRITICAL(&timerMux);
+  std::sort(list, list + n, [](const TimerEntry& a, const TimerEntry& b) { return a.deadline < b.deadline; });
+  int64_t now = esp_timer_get_time();
+  JsonResponse w(req);
+  w.beginObject();
+  w.number("count", n);
+  w.number("max", maxTimers);
+  w.beginArray("timers");
+  for (uint8_t i = 0; i < n; ++i) {
+    w.beginObject();
+    w.number("id", list[i].id);
+    w.string("label", list[i].label);
+    w.number("remainingMs", (int64_t)remainingMsAt(list[i].deadline, now));
+    if (list[i].action & 0xFF) {
+      w.beginArray("leds");
+      for (size_t c = 0; c < outputs.size(); ++c) if (list[i].action >> c & 1) w.string(nullptr, outputs[c].name);
+      w.endArray();
+      w.string("ledState", list[i].action & timerLedsOn ? "on" : "off");
+    }
+    w.endObject();
+  }
+  w.endArray();
+  w.endObject();
+}
+
+void sendTimerId(HttpRequest& req, int code, uint32_t id) {
+  char buf[24];
+  JsonWriter w(buf, sizeof(buf));
+  w.beginObject();
+  w.number("id", id);
+  w.endObject();
+  req.send(code, "application/json", w.c_str(), w.length());
+}
+
+template <class Args>
+uint64_t nonNegativeArg(Args& req, const char* name) {
+  return req.hasArg(name) ? (uint64_t)std::max(0L, req.arg(name).toInt()) : 0;
+}
+
+// A CMD_TIMER_START for id, without sending it
+template <class Args>
+const char* parseTimerArgs(Args& req, uint32_t id, ControlCmd* cmd) {
+  uint64_t ms = req.hasArg("ms") ? nonNegativeArg(req, "ms")
+      : nonNegativeArg(req, "hours") * 3600000ULL + nonNegativeArg(req, "minutes") * 60000ULL + nonNegativeArg(req, "seconds") * 1000ULL;
+  if (ms == 0) return "Expected ms= or hours/minutes/seconds";
+  uint8_t leds = 0;
+  bool on;
+  const char* error = parseLedArgs(req, &leds, &on);
+  if (error) return error;
+  *cmd = ControlCmd{CMD_TIMER_START, 0, (uint32_t)std::min<uint64_t>(ms, UINT32_MAX), id, "", (uint16_t)(leds | (leds && on ? timerLedsOn : 0))};
+  String label = req.hasArg("label") ? req.arg("label") : String("timer");
+  strncpy(cmd->label, label.c_str(), timerLabelSize - 1);
+  return nullptr;
+}
+
+void handleAddTimer(HttpRequest& req) {
+  uint32_t id = nextTimerId;
+  ControlCmd cmd;
+  const char* error = parseTimerArgs(req, id, &cmd);
+  if (error) { req.send(400,"text/plain",error); return; }
+  // Starts still queued are not counted, so the control task re-checks
+  if (timersActive >= maxTimers) { req.send(409,"text/plain","Timer list full"); return; }
+  if (!sendCommand(cmd)) { sendBusy(req); return; }
+  nextTimerId++;
+  sendTimerId(req, 201, id);
+}
+
+void handleDeleteTimer(HttpRequest& req) {
+  String arg = req.pathArg();
+  char* end;
+  unsigned long id = strtoul(arg.c_str(), &end, 10);
+  if (arg.length() == 0 || *end) { req.send(400,"text/plain","Expected /timers/<id>"); return; }
+  bool found = false;
+  portENTER_CRITICAL(&timerMux);
+  for (uint8_t i = 0; i < timers.size() && !found; ++i) found = timers.at(i).id == id;
+  portEXIT_CRITICAL(&timerMux);
+  if (!found) { req.send(404,"text/plain","No such timer"); return; }
+  ControlCmd cmd = {CMD_TIMER_CANCEL, 0, 0, (uint32_t)id, ""};
+  if (!sendCommand(cmd)) { sendBusy(req); return; }
+  sendTimerId(req, 200, id);
+}
+
+// POST /batch: a JSON array of operations, each an object of the fields
+// the matching route takes plus "op":
+//
+//   [{"op":"led","ch":"led1","state":"on"}, {"op":"leds","led2":"off"},
+//    {"op":"timer","minutes":5,"label":"tea"}, {"op":"alarm","time":"07:30"}]
+//
+// ops: led, leds, timer, cancelTimer (id), stopTimers, alarm, deleteAlarm
+// (time), clearAlarms. Everything is checked before anything is applied:
+// alarm edits go to a copy that replaces the list in one step, and the
+// control commands are queued together, so the control task applies them
+// in one pass (one status push, one coalesced NVS write per record).
+struct BatchArgs {
+  const JsonArrayReader& r;
+
+  bool hasArg(const char* name) const { return r.find(name) != nullptr; }
+  String arg(const char* name) const {
+    const char* v = r.find(name);
+    return String(v ? v : "");
+  }
+  // Indexed access, as /leds iterates its args; "op" is not one of them
+  int args() const { return r.size() - (hasArg("op") ? 1 : 0); }
+  String argName(int i) const { return String(r.key(field(i))); }
+  String arg(int i) const { return String(r.value(field(i))); }
+
+ private:
+  uint8_t field(int i) const {
+    uint8_t f = 0;
+    for (;; ++f) if (strcmp(r.key(f), "op") != 0 && i-- == 0) return f;
+  }
+};
+
+// One operation: adds to cmds/edited. Returns the error for a 400, or nullptr.
+const char* parseBatchOp(BatchArgs& a, ControlCmd* cmds, uint8_t* n, AlarmSet<maxAlarms>* edited, bool* alarmsEdited,
+                         uint8_t* timerStarts) {
+  String op = a.arg("op");
+  if (op == "alarm" || op == "deleteAlarm" || op == "clearAlarms") {
+    *alarmsEdited = true;
+    if (op == "clearAlarms") { edited->clear(); return nullptr; }
+    AlarmRule rule;
+    if (op == "alarm") {
+      const char* error = parseAlarmRule(a, &rule);
+      if (error) return error;
+      if (alarmConflicts(a, *edited, rule)) return alarmConflict;
+      return edited->put(rule) ? nullptr : "Alarm list full";
+    }
+    if (!parseHHMM(a.arg("time").c_str(), &rule.minute)) return "Expected time=HH:MM";
+    edited->remove(rule.minute); // gone already is fine
+    return nullptr;
+  }
+  if (*n >= controlQueueSize - 1) return "Too many operations"; // one slot for CMD_ALARMS_CHANGED
+  ControlCmd& cmd = cmds[*n];
+  const char* error = nullptr;
+  if (op == "led") {
+    error = parseLedCommand(a, &cmd);
+  } else if (op == "leds") {
+    uint32_t mask, bits;
+    error = parseOutputArgs(a, &mask, &bits);
+    cmd = ControlCmd{CMD_OUTPUTS, 0, bits & mask, mask, ""};
+  } else if (op == "timer") {
+    error = parseTimerArgs(a, nextTimerId + *timerStarts, &cmd);
+    if (!error && timersActive + ++*timerStarts > maxTimers) error = "Timer list full";
+  } else if (op == "cancelTimer") {
+    char* end;
+    String id = a.arg("id");
+    cmd = ControlCmd{CMD_TIMER_CANCEL, 0, 0, (uint32_t)strtoul(id.c_str(), &end, 10), ""};
+    if (id.length() == 0 || *end) error = "Expected id=";
+  } else if (op == "stopTimers") {
+    cmd = ControlCmd{CMD_TIMER_STOP, 0, 0, 0, ""};
+  } else {
+    error = "Unknown op";
+  }
+  if (!error) ++*n;
+  return error;
+}
+
+void handleBatch(HttpRequest& req) {
+  // Handlers all run on the server task
+  static char body[maxBatchBytes];
+  static ControlCmd cmds[controlQueueSize];
+  static AlarmSet<maxAlarms> edited;
+  int len = req.body(body, sizeof(body));
+  if (len < 0) { req.send(413,"text/plain","Expected a JSON array of at most 2048 bytes"); return; }
+  JsonArrayReader r(body, len);
+  edited = alarms; // only this task edits it
+  uint8_t n = 0, timerStarts = 0;
+  uint16_t ops = 0;
+  bool alarmsEdited = false;
+  while (r.next()) {
+    BatchArgs a = {r};
+    const char* error = parseBatchOp(a, cmds, &n, &edited, &alarmsEdited, &timerStarts);
+    if (error) {
+      char text[96];
+      snprintf(text, sizeof(text), "op %u: %s", ops, error);
+      req.send(400,"text/plain",text);
+      return;
+    }
+    ++ops;
+  }
+  if (r.failed()) { req.send(400,"text/plain",r.error()); return; }
+  if (alarmsEdited) cmds[n++] = ControlCmd{CMD_ALARMS_CHANGED, 0, 0, 0, ""};
+  // Nothing else fills controlQueue, so once there is room the push below
+  // cannot fail; checking first keeps the alarm edit from going in alone
+  if (controlQueue.space() < n) { sendBusy(req); return; }
+  if (alarmsEdited) {
+    portENTER_CRITICAL(&alarmsMux);
+    alarms = edited;
+    portEXIT_CRITICAL(&alarmsMux);
+    alarmsVersion++;
+    stateVersion++;
+    persistMarkDirty(PERSIST_ALARMS);
+  }
+  controlQueue.pushAll(cmds, n);
+  if (n) xTaskNotify(controlTaskHandle, EVT_COMMAND, eSetBits);
+  JsonResponse w(req);
+  w.beginObject();
+  w.number("applied", ops);
+  w.beginArray("timerIds");
+  for (uint8_t i = 0; i < timerStarts; ++i) w.number(nullptr, nextTimerId + i);
+  w.endArray();
+  w.number("alarmsCount", alarms.size());
+  w.endObject();
+  nextTimerId += timerStarts;
+}
+
+// Server task: one authenticated UDP frame, see udp_frame.h for the opcodes.
+// Same commands and checks as the HTTP routes.
+void handleUdpFrame(const UdpFrame& in, UdpFrame* ack) {
+  bool queued = true;
+  switch (in.opcode) {
+    case UDP_PING: { // the reply carries the status, a resync for a panel that missed a multicast
+      UdpFrame status = udpStatusFrame(currentStatus());
+      ack->channel = status.channel;
+      ack->value = status.value;
+      return;
+    }
+    case UDP_LED:
+      if (in.channel >= outputs.size()) { ack->status = UDP_BAD_REQUEST; return; }
+      queued = sendOutputs(1u << in.channel, in.value ? 1u << in.channel : 0);
+      break;
+    case UDP_OUTPUTS:
+      if (!(in.value >> 16 & outputs.allMask())) { ack->status = UDP_BAD_REQUEST; return; }
+      queued = sendOutputs(in.value >> 16 & outputs.allMask(), in.value & 0xFFFF);
+      break;
+    case UDP_BRIGHTNESS: {
+      uint8_t level = in.value & 0xFF;
+      uint32_t fadeMs = in.value >> 8;
+      if (in.channel >= outputs.size() || fadeMs > 65535 || (in.channel >= dimmerMaxChannels && level != 0 && level != 255)) {
+        ack->status = UDP_BAD_REQUEST;
+        return;
+      }
+      ControlCmd cmd = {CMD_BRIGHTNESS, in.channel, level, fadeMs, ""};
+      queued = sendCommand(cmd);
+      break;
+    }
+    case UDP_TIMER_START:
+      if (in.value == 0 || timersActive >= maxTimers) { ack->status = UDP_BAD_REQUEST; return; }
+      queued = sendTimerStart(nextTimerId, in.value, "udp");
+      if (queued) ack->value = nextTimerId++;
+      break;
+    case UDP_TIMER_STOP: queued = sendCommand(CMD_TIMER_STOP); break;
+    case UDP_ALARM_SNOOZE: queued = sendCommand(CMD_ALARM_SNOOZE); break;
+    case UDP_ALARM_DISMISS: queued = sendCommand(CMD_ALARM_DISMISS); break;
+    default: ack->status = UDP_UNKNOWN_OP; return;
+  }
+  if (!queued) ack->status = UDP_BUSY;
+}
+
+// GET /time: clock state. POST /time ms=<Unix ms>: the browser's clock, used
+// while there is no (recent) NTP sync.
+void sendTimeJson(HttpRequest& req, int code) {
+  char buf[160];
+  JsonWriter w(buf, sizeof(buf));
+  w.beginObject();
+  w.boolean("synced", wallclockSynced());
+  w.string("source", wallclockSourceName(wallclockSource()));
+  w.number("epochMs", wallclockNowMs());
+  w.number("syncAgeMs", wallclockSyncAgeMs());
+  w.number("offsetUs", wallclockLastOffsetUs());
+  w.number("driftPpb", wallclockDriftPpb());
+  w.endObject();
+  req.send(code, "application/json", w.c_str(), w.length());
+}
+
+void handleGetTime(HttpRequest& req) { sendTimeJson(req, 200); }
+
+void handleSetTime(HttpRequest& req) {
+  String arg = req.arg("ms");
+  char* end;
+  long long ms = strtoll(arg.c_str(), &end, 10);
+  if (arg.length() == 0 || *end) { req.send(400,"text/plain","Expected ms=<Unix time in ms>"); return; }
+  sendTimeJson(req, wallclockSetFromClient(ms) ? 200 : 409); // 409: NTP is newer, or ms is implausible
+}
+
+// (Re)connect the station, or drop it when no ssid is set. The softAP
+// follows the station's channel, so AP clients may blip once on connect.
+void connectStation() {
+  if (!wifiCreds.ssid[0]) { WiFi.disconnect(); return; }
+  WiFi.begin(wifiCreds.ssid, wifiCreds.password[0] ? wifiCreds.password : nullptr);
+}
+
+void onStationGotIp(arduino_event_id_t) { wallclockResync(); }
+
+// GET /wifi: station state; the password is never sent back
+void handleGetWifi(HttpRequest& req) {
+  char buf[256];
+  JsonWriter w(buf, sizeof(buf));
+  bool connected = WiFi.isConnected();
+  w.beginObject();
+  w.string("ssid", wifiCreds.ssid);
+  w.boolean("connected", connected);
+  if (connected) {
+    w.string("ip", WiFi.localIP().toString().c_str());
+    w.number("rssi", WiFi.RSSI());
+  }
+  w.endObject();
+  req.send(200, "application/json", w.c_str(), w.length());
+}
+
+// POST /wifi ssid=&password= (empty ssid: AP only)
+void handleSetWifi(HttpRequest& req) {
+  String newSsid = req.arg("ssid");
+  String newPass = req.arg("password");
+  if (newSsid.length() >= sizeof(wifiCreds.ssid) || newPass.length() >= sizeof(wifiCreds.password) || (newPass.length() && newPass.length() < 8)) {
+    req.send(400,"text/plain","Expected ssid= (up to 32 bytes) and password= (none or 8 to 64)");
+    return;
+  }
+  portENTER_CRITICAL(&wifiMux);
+  wifiCreds.version = wifiRecordVersion;
+  strcpy(wifiCreds.ssid, newSsid.c_str());
+  strcpy(wifiCreds.password, newPass.c_str());
+  portEXIT_CRITICAL(&wifiMux);
+  persistMarkDirty(PERSIST_WIFI);
+  connectStation();
+  redirectHome(req);
+}
+
+// POST /update?sha256=<hex>&release=<n>&sig=<hex HMAC of both>, the image
+// as a raw (not form) body. Flash writes happen as the upload streams in;
+// see ota.h.
+static const char* const otaNoBody = "Expected the image as the request body";
+static const char* otaError = otaNoBody; // server task, until the next upload begins
+static esp_timer_handle_t restartTimer = nullptr;
+bool httpReady = false; // httpBegin() succeeded
+
+// GET /status sent to ourselves over the softAP: true if it came back 200,
+// so the server task is up and answering
+bool httpSelfCheck() {
+  WiFiClient c;
+  if (!c.connect(WiFi.softAPIP(), 80)) return false;
+  c.setTimeout(2);
+  c.print("GET /status HTTP/1.1\r\nHost: self\r\nConnection: close\r\n\r\n");
+  char line[32];
+  size_t n = c.readBytesUntil('\n', line, sizeof(line) - 1);
+  line[n] = '\0';
+  c.stop();
+  return strncmp(line, "HTTP/1.", 7) == 0 && atoi(line + 9) == 200;
+}
+
+void onRestartTimer(void*) { esp_restart(); } // the persist shutdown handler flushes NVS
+
+void handleUpdateUpload(HttpRequest& req, HttpUploadStage stage, const uint8_t* data, size_t len) {
+  switch (stage) {
+    case HTTP_UPLOAD_BEGIN: otaError = otaStart(req.arg("sha256").c_str(), req.arg("release").c_str(), req.arg("sig").c_str()); break;
+    case HTTP_UPLOAD_DATA: if (!otaError) otaError = otaWrite(data, len); break;
+    case HTTP_UPLOAD_END: if (!otaError) otaError = otaFinish(); break;
+    case HTTP_UPLOAD_ABORT: otaAbort(); otaError = "Upload aborted"; break;
+  }
+}
+
+void handleUpdate(HttpRequest& req) {
+  const char* error = otaError;
+  otaError = otaNoBody; // a form body never reaches the upload handler
+  if (error) {
+    req.send(error == otaDenied ? 403 : error == otaNotNewer ? 409 : 400, "text/plain", error);
+    return;
+  }
+  req.send(200, "text/plain", "Update written, restarting");
+  // Give the response a moment to leave before the restart
+  esp_timer_create_args_t args = {};
+  args.callback = onRestartTimer;
+  args.name = "restart";
+  if (!restartTimer) esp_timer_create(&args, &restartTimer);
+  esp_timer_start_once(restartTimer, 1000000);
+}
+
+// Prometheus text format, streamed. Routes that were never hit are left
+// out to keep the page short.
+void handleMetrics(HttpRequest& req) {
+  char chunk[httpChunkSize];
+  req.beginStream(200, "text/plain; version=0.0.4");
+  MetricsWriter w(chunk, sizeof(chunk), httpStreamSink, &req);
+  w.gauge("esp32_heap_free_bytes", "Free heap", ESP.getFreeHeap());
+  w.gauge("esp32_heap_largest_free_block_bytes", "Largest allocatable block", ESP.getMaxAllocHeap());
+  w.gauge("esp32_heap_min_free_bytes", "Lowest free heap since boot", ESP.getMinFreeHeap());
+  w.gauge("esp32_uptime_seconds", "Time since boot", esp_timer_get_time() / 1000000);
+  w.counter("esp32_persist_writes_total", "NVS records written", persistWriteCount());
+  w.counter("esp32_persist_skipped_total", "NVS writes skipped as unchanged", persistSkipCount());
+  w.counter("esp32_persist_rtc_writes_total", "Record copies written to RTC memory", persistRtcWriteCount());
+  w.gauge("esp32_boot_warm", "State restored from RTC memory at boot (0/1)", persistWarmBoot());
+  w.gauge("esp32_event_streams", "Open /events streams", httpEventStreamCount());
+  w.gauge("esp32_timers_active", "Running countdown timers", timersActive);
+  w.gauge("esp32_clock_source", "Wall clock source (0 none, 1 rtc, 2 browser, 3 fleet, 4 ntp)", wallclockSource());
+  int64_t syncAgeMs = wallclockSyncAgeMs();
+  w.gauge("esp32_clock_sync_age_seconds", "Time since the last accepted clock sample (-1 never)", syncAgeMs < 0 ? -1 : syncAgeMs / 1000);
+  w.gauge("esp32_clock_offset_microseconds", "Correction measured at the last sample", wallclockLastOffsetUs());
+  w.gauge("esp32_clock_drift_ppb", "Crystal rate correction", wallclockDriftPpb());
+  w.gauge("esp32_wifi_station_connected", "Station interface associated (0/1)", WiFi.isConnected());
+  w.gauge("esp32_firmware_pending_verify", "Running an update not yet confirmed (0/1)", otaPendingVerify());
+  w.gauge("esp32_firmware_release", "Release counter of the running image (firmwareRelease)", firmwareRelease);
+  powerWriteMetrics(w);
+  httpWriteMetrics(w);
+  udpWriteMetrics(w);
+  fleetWriteMetrics(w);
+  w.histogramHelp("control_iteration_duration_seconds", "Control task work per wake-up");
+  w.histogram("control_iteration_duration_seconds", nullptr, controlIteration);
+  w.histogramHelp("trigger_lateness_seconds", "How late alarms and timers are acted on");
+  w.histogram("trigger_lateness_seconds", "source=\"alarm\"", alarmLateness);
+  w.histogram("trigger_lateness_seconds", "source=\"timer\"", timerLateness);
+  w.flush();
+  req.endStream();
+}
+
+// GET /trace[?since=<next>]: recent events as Chrome trace JSON, for
+// chrome://tracing or ui.perfetto.dev (see trace.h)
+void handleTrace(HttpRequest& req) {
+  char chunk[httpChunkSize];
+  req.beginStream(200, "application/json");
+  JsonWriter w(chunk, sizeof(chunk), httpStreamSink, &req);
+  traceWriteJson(w, strtoul(req.arg("since").c_str(), nullptr, 10));
+  w.flush();
+  req.endStream();
+}
+
+void handleNotFound(HttpRequest& req){ req.send(404,"text/plain","Not found"); }
+
+// ------------------- CONTROL TASK -------------------
+// Buzzer, timer and alarms. Sleeps until notified (commands, esp_timer
+// one-shots, SNTP), so HTTP load on the other core cannot delay it.
+
+// Point timerExpiry at the soonest timer; the 1 Hz tick runs while any is active.
+void armTimerExpiry() {
+  portENTER_CRITICAL(&timerMux);
+  const TimerEntry* next = timers.soonest();
+  int64_t deadline = next ? next->deadline : 0;
+  uint8_t active = timers.size();
+  portEXIT_CRITICAL(&timerMux);
+  esp_timer_stop(timerExpiry);
+  bool wasActive = timersActive > 0;
+  timersActive = active;
+  if (!active) { esp_timer_stop(tickTimer); return; }
+  int64_t delayUs = deadline - esp_timer_get_time();
+  esp_timer_start_once(timerExpiry, delayUs > 0 ? (uint64_t)delayUs : 1);
+  if (!wasActive) esp_timer_start_periodic(tickTimer, 1000000);
+}
+
+// Plain on/off stays on GPIO; anything dimmed or faded goes through LEDC.
+void setBrightness(uint8_t ch, uint8_t level, uint16_t fadeMs) {
+  uint32_t bit = 1u << ch;
+  uint8_t from = brightness[ch];
+  brightness[ch] = level;
+  outputBits = level ? outputBits | bit : outputBits & ~bit;
+  if (fadeMs == 0 && (level == 0 || level == 255)) {
+    outputs.write(bit, level ? bit : 0);
+    dimmerRelease(ch);
+  } else {
+    dimmerSet(ch, from, level, fadeMs);
+  }
 }
 
-void handleStopTimer(){ timerRunning=false; stopBuzzer(); server.sendHeader("Location","/"); server.send(302,"text/plain",""); }
-void handleNotFound(){ server.send(404,"text/plain","Not found"); }
+// Fades that ended fully on or off hand their pin back to GPIO
+void fadesFinished() {
+  uint32_t idle = dimmerService();
+  for (size_t i = 0; i < outputCount; ++i) {
+    if (!(idle >> i & 1)) continue;
+    outputs.write(1u << i, brightness[i] ? 1u << i : 0);
+    dimmerRelease(i);
+  }
+}
+
+// Switch the channels in mask fully on or off (bits), ending any dimming
+void applyOutputs(uint32_t mask, uint32_t bits) {
+  outputs.write(mask, bits);
+  outputBits = (outputBits & ~mask) | bits;
+  for (size_t i = 0; i < outputCount; ++i) {
+    if (!(mask >> i & 1)) continue;
+    brightness[i] = bits >> i & 1 ? 255 : 0;
+    dimmerRelease(i); // after the write, so a dimmed pin lands on its new level
+  }
+  persistMarkDirty(PERSIST_OUTPUTS);
+}
+
+// Sound and LEDs of a rule; it then rings until snoozed or dismissed
+void fireAlarm(const AlarmRule& rule) {
+  if (alarmSounds[rule.sound]) buzzerPlay(*alarmSounds[rule.sound]);
+  if (rule.leds) {
+    LedAction a = {esp_timer_get_time(), 0, rule.leds, (uint8_t)(rule.ledsOn() ? 255 : 0), ACTION_NOW};
+    queueLedAction(a);
+  }
+  ringingRule = rule;
+  alarmRinging = true;
+  snoozeUntilMs = 0;
+}
+
+void applyCommand(const ControlCmd& cmd) {
+  switch (cmd.op) {
+    case CMD_OUTPUTS:
+      applyOutputs(cmd.id, cmd.value);
+      break;
+    case CMD_BRIGHTNESS:
+      setBrightness(cmd.channel, cmd.value, cmd.id);
+      persistMarkDirty(PERSIST_OUTPUTS);
+      break;
+    case CMD_TIMER_START: {
+      // Same id restarts it (the legacy /startTimer timer)
+      int64_t deadline = esp_timer_get_time() + (int64_t)cmd.value * 1000;
+      portENTER_CRITICAL(&timerMux);
+      timers.cancel(cmd.id);
+      bool started = timers.start(cmd.id, deadline, cmd.label, cmd.action);
+      portEXIT_CRITICAL(&timerMux);
+      if (!started) Serial.printf("Timer %u dropped, table full\n", cmd.id);
+      persistMarkDirty(PERSIST_TIMER);
+      armTimerExpiry();
+      break;
+    }
+    case CMD_TIMER_CANCEL:
+      portENTER_CRITICAL(&timerMux);
+      timers.cancel(cmd.id);
+      portEXIT_CRITICAL(&timerMux);
+      persistMarkDirty(PERSIST_TIMER);
+      armTimerExpiry();
+      break;
+    case CMD_TIMER_STOP:
+      portENTER_CRITICAL(&timerMux);
+      timers.clear();
+      portEXIT_CRITICAL(&timerMux);
+      buzzerStop();
+      persistMarkDirty(PERSIST_TIMER);
+      armTimerExpiry();
+      break;
+    case CMD_ALARMS_CHANGED:
+      scheduleAlarms();
+      break;
+    case CMD_ALARM_SNOOZE: {
+      uint8_t minutes = ringingRule.snoozeMinutes();
+      if (!alarmRinging || snoozeUntilMs || !minutes) break; // not snoozable: keeps ringing
+      buzzerStop();
+      snoozeUntilMs = wallclockNowMs() + minutes * 60000LL;
+      esp_timer_start_once(snoozeTimer, minutes * 60000000ULL);
+      break;
+    }
+    case CMD_ALARM_DISMISS:
+      if (!snoozeUntilMs) buzzerStop(); // a snoozed alarm is quiet already
+      esp_timer_stop(snoozeTimer);
+      alarmRinging = false;
+      snoozeUntilMs = 0;
+      break;
+  }
+}
+
+void controlTask(void*) {
+  scheduleAlarms();
+  armTimerExpiry(); // timers restored from flash
+  runLedActions(esp_timer_get_time()); // a lead-in already under way
+  for (;;) {
+    uint32_t events = 0;
+    xTaskNotifyWait(0, UINT32_MAX, &events, portMAX_DELAY);
+    int64_t wokeUs = esp_timer_get_time();
+
+    ControlCmd cmd;
+    bool changed = false;
+    while (controlQueue.pop(cmd)) { applyCommand(cmd); changed = true; }
+
+    // Alarms: alarmTimer fires at the start of the alarm minute. One that
+    // is not due (early, or already handled) is only re-armed.
+    bool alarmDue = (events & EVT_ALARM) && arming.take(wallclockLocalMinute());
+    if ((events & EVT_ALARM) && !alarmDue) scheduleAlarms();
+    if (alarmDue) {
+      int32_t armedAt = arming.armedAt;
+      metricsObserve(alarmLateness, wokeUs - armedMonoUs);
+      portENTER_CRITICAL(&alarmsMux);
+      int i = alarms.find(armedAt % minutesPerDay);
+      AlarmRule rule = i >= 0 ? alarms[i] : AlarmRule();
+      portEXIT_CRITICAL(&alarmsMux);
+      if (i >= 0 && alarmNextFire(rule, armedAt - 1) == armedAt) { // still the rule it was armed for
+        esp_timer_stop(snoozeTimer); // a new alarm supersedes a snoozed one
+        trace(TRACE_ALARM_FIRE, rule.minute, wokeUs - armedMonoUs);
+        fireAlarm(rule);
+        if (rule.oneShot()) httpQueueWork(pruneAlarms, nullptr);
+        changed = true;
+      }
+      armAlarmAfter(armedAt, armedEpochMs);
+    }
+    if (events & EVT_SNOOZE) {
+      if (alarmRinging && snoozeUntilMs) fireAlarm(ringingRule);
+      changed = true;
+    }
+    if (events & EVT_CLOCK) scheduleAlarms();
+
+    // Timers: pop everything due (several can share a deadline), then
+    // re-arm for the new head. A stale expiry simply pops nothing.
+    if (events & EVT_TIMER) {
+      int64_t now = esp_timer_get_time();
+      TimerEntry fired;
+      bool any = false;
+      for (;;) {
+        portENTER_CRITICAL(&timerMux);
+        bool got = timers.popExpired(now, &fired);
+        portEXIT_CRITICAL(&timerMux);
+        if (!got) break;
+        metricsObserve(timerLateness, now - fired.deadline);
+        int64_t latenessMs = (now - fired.deadline) / 1000;
+        trace(TRACE_TIMER_FIRE, latenessMs > 0xFFFF ? 0xFFFF : latenessMs < 0 ? 0 : (uint16_t)latenessMs, fired.id);
+        Serial.printf("Timer %u (%s) finished\n", fired.id, fired.label);
+        if (fired.action & 0xFF) {
+          LedAction a = {now, 0, (uint8_t)fired.action, (uint8_t)(fired.action & timerLedsOn ? 255 : 0), ACTION_NOW};
+          queueLedAction(a);
+        }
+        any = true;
+      }
+      if (any) {
+        buzzerPlay(timerPattern);
+        persistMarkDirty(PERSIST_TIMER);
+        changed = true;
+      }
+      armTimerExpiry();
+    }
+    // Alarms and timers above only queue theirs, so this also runs them
+    if (runLedActions(esp_timer_get_time())) changed = true;
+    if (changed) {
+      stateVersion++;
+      statusChanged();
+    }
+    if (events & EVT_BUZZER) buzzerService();
+    if (events & EVT_FADE) fadesFinished();
+    if (events == EVT_POWER) powerSampleCurrent(); // nothing else to do: idle reading
+    int64_t busyUs = esp_timer_get_time() - wokeUs;
+    metricsObserve(controlIteration, busyUs);
+    if (busyUs > controlOverrunUs) trace(TRACE_LOOP_OVERRUN, 0, busyUs);
+  }
+}
+
+// ------------------- BENCH -------------------
+// Self-test for env:esp32dev-bench: drives the real server over loopback
+// (so both stacks are measured end to end), then timers and, when the clock
+// is synced, one alarm. Results go to Serial; test/load_test.py is the
+// matching over-the-air load generator.
+#ifdef BENCH
+const uint16_t benchRequests = 1000;   // per route, for rps and p99
+const uint16_t benchSoakIterations = 10000;
+const uint8_t benchTimerCount = 20;
+
+uint32_t benchLatencyUs[benchRequests];
+
+uint32_t percentileUs(uint32_t* samples, size_t n, uint8_t pct) {
+  std::sort(samples, samples + n);
+  return n ? samples[(n * pct - 1) / 100] : 0;
+}
+
+// Reads n body bytes (n < 0: until the server closes) and throws them away
+void benchDrain(WiFiClient& c, long n) {
+  uint8_t sink[256];
+  for (long left = n; left != 0;) {
+    size_t got = c.readBytes(sink, left < 0 ? sizeof(sink) : std::min<long>(left, sizeof(sink)));
+    if (got == 0) break;
+    if (left > 0) left -= got;
+  }
+}
+
+// One request on a fresh connection; reads exactly Content-Length bytes, or
+// the chunks of a streamed response, so it works with keep-alive
+// (HTTP_ASYNC) and Connection: close (WebServer) alike.
+int benchRequest(const char* method, const char* path, const char* body, uint32_t* elapsedUs) {
+  int64_t start = esp_timer_get_time();
+  WiFiClient c;
+  if (!c.connect(WiFi.softAPIP(), 80)) return -1;
+  c.setTimeout(2);
+  size_t bodyLen = body ? strlen(body) : 0;
+  c.printf("%s %s HTTP/1.1\r\nHost: bench\r\nConnection: close\r\n", method, path);
+  if (bodyLen) c.printf("Content-Type: application/x-www-form-urlencoded\r\nContent-Length: %u\r\n", (unsigned)bodyLen);
+  c.print("\r\n");
+  if (bodyLen) c.print(body);
+  int status = -1;
+  long contentLength = -1;
+  bool chunked = false;
+  char line[128];
+  for (;;) {
+    size_t n = c.readBytesUntil('\n', line, sizeof(line) - 1);
+    if (n == 0) break;
+    line[n] = '\0';
+    if (n && line[n - 1] == '\r') line[--n] = '\0';
+    if (n == 0) break; // end of headers
+    if (status < 0 && strncmp(line, "HTTP/1.", 7) == 0) status = atoi(line + 9);
+    else if (strncasecmp(line, "Content-Length:", 15) == 0) contentLength = atol(line + 15);
+    else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0) chunked = strstr(line + 18, "chunked") != nullptr;
+  }
+  if (!chunked) benchDrain(c, status == 304 || status == 204 ? 0 : contentLength);
+  while (chunked) {
+    size_t n = c.readBytesUntil('\n', line, sizeof(line) - 1);
+    if (n == 0) break;
+    line[n] = '\0';
+    long size = strtol(line, nullptr, 16);
+    benchDrain(c, size + 2); // data and its CRLF; the last chunk is just "0\r\n\r\n"
+    if (size == 0) break;
+  }
+  c.stop();
+  *elapsedUs = esp_timer_get_time() - start;
+  return status;
+}
+
+void benchRoute(const char* path) {
+  uint16_t ok = 0;
+  int64_t start = esp_timer_get_time();
+  for (uint16_t i = 0; i < benchRequests; ++i) {
+    uint32_t us = 0;
+    if (benchRequest("GET", path, nullptr, &us) == 200) ok++;
+    benchLatencyUs[i] = us;
+  }
+  float seconds = (esp_timer_get_time() - start) / 1e6f;
+  Serial.printf("[bench] GET %-8s %u/%u ok, %.1f req/s, p50 %u us, p99 %u us\n", path, ok, benchRequests,
+                benchRequests / seconds, percentileUs(benchLatencyUs, benchRequests, 50), percentileUs(benchLatencyUs, benchRequests, 99));
+}
+
+// Handler work alone, without the network: format /status JSON
+bool benchDiscard(void*, const char*, size_t) { return true; }
+
+void benchStatusJson() {
+  char chunk[httpChunkSize];
+  int64_t start = esp_timer_get_time();
+  for (uint16_t i = 0; i < benchSoakIterations; ++i) {
+    JsonWriter w(chunk, sizeof(chunk), benchDiscard, nullptr);
+    writeStatusJson(w, currentStatus(), nullptr);
+    w.flush();
+  }
+  Serial.printf("[bench] /status JSON: %.2f us each\n", (esp_timer_get_time() - start) / (float)benchSoakIterations);
+}
+
+void benchHeapSample(uint16_t iteration) {
+  uint32_t freeHeap = ESP.getFreeHeap(), largest = ESP.getMaxAllocHeap();
+  Serial.printf("[bench] heap @%5u: free %u, largest %u, fragmentation %.1f%%\n", iteration, freeHeap, largest,
+                100.0f * (1.0f - (float)largest / freeHeap));
+}
+
+void benchSoak() {
+  uint16_t failed = 0;
+  for (uint16_t i = 0; i < benchSoakIterations; ++i) {
+    if (i % 1000 == 0) benchHeapSample(i);
+    uint32_t us;
+    if (benchRequest("GET", i % 10 ? "/status" : "/", nullptr, &us) != 200) failed++;
+  }
+  benchHeapSample(benchSoakIterations);
+  Serial.printf("[bench] soak: %u/%u failed\n", failed, benchSoakIterations);
+}
+
+void benchPrintLateness(const char* what, const LatencyHistogram& live, const LatencyHistogram& before) {
+  LatencyHistogram h;
+  metricsSnapshot(live, &h);
+  uint32_t n = h.count - before.count;
+  if (!n) { Serial.printf("[bench] %s: none fired\n", what); return; }
+  // p99 as the bucket bound it falls under
+  uint32_t seen = 0, p99 = 0;
+  for (uint8_t b = 0; b <= metricsBucketCount; ++b) {
+    seen += h.buckets[b] - before.buckets[b];
+    if (seen * 100 >= n * 99) { p99 = b < metricsBucketCount ? metricsBucketUs[b] : UINT32_MAX; break; }
+  }
+  Serial.printf("[bench] %s: %u fired, mean error %llu us, p99 <= %u us\n", what, n,
+                (unsigned long long)((h.sumUs - before.sumUs) / n), p99);
+}
+
+void benchTimers() {
+  LatencyHistogram before;
+  metricsSnapshot(timerLateness, &before);
+  char body[48];
+  for (uint8_t i = 0; i < benchTimerCount; ++i) {
+    snprintf(body, sizeof(body), "ms=%u&label=bench%u", 250u + i * 150u, i);
+    uint32_t us;
+    benchRequest("POST", "/timers", body, &us);
+  }
+  vTaskDelay(pdMS_TO_TICKS(250 + benchTimerCount * 150 + 1000));
+  benchPrintLateness("timers", timerLateness, before);
+}
+
+void benchAlarm() {
+  if (!wallclockSynced()) { Serial.println("[bench] alarm: skipped, clock not synced"); return; }
+  LatencyHistogram before;
+  metricsSnapshot(alarmLateness, &before);
+  char body[16], path[20], hhmm[6];
+  formatHHMM((wallclockMinuteOfDay() + 1) % minutesPerDay, hhmm);
+  snprintf(body, sizeof(body), "time=%s", hhmm);
+  snprintf(path, sizeof(path), "/alarms/%s", hhmm);
+  uint32_t us;
+  bool added = benchRequest("POST", "/alarms", body, &us) == 201;
+  vTaskDelay(pdMS_TO_TICKS(61000 - wallclockNowMs() % 60000 + 1000));
+  if (added) benchRequest("DELETE", path, nullptr, &us); // leave the user's alarms as they were
+  benchPrintLateness("alarm", alarmLateness, before);
+}
+
+void benchTask(void*) {
+  vTaskDelay(pdMS_TO_TICKS(2000)); // let the server come up
+  Serial.println("[bench] start");
+  benchStatusJson();
+  benchRoute("/");
+  benchRoute("/status");
+  benchSoak();
+  benchTimers();
+  benchAlarm();
+  Serial.println("[bench] done");
+  vTaskDelete(nullptr);
+}
+#endif
 
 // ------------------- SETUP -------------------
+// Only what the first HTTP response needs runs here; loop() does the rest
+// once the server is up. A warm boot takes its state from RTC memory.
 void setup() {
   Serial.begin(115200);
-  delay(100);
-  pinMode(LED1pin, OUTPUT); pinMode(LED2pin, OUTPUT); pinMode(buzzerPin, OUTPUT);
-  digitalWrite(LED1pin, LOW); digitalWrite(LED2pin, LOW); digitalWrite(buzzerPin, LOW);
-
-  if(buzzerIsPassive){ ledcSetup(buzzerLedcChannel,buzzerLedcFreq,buzzerLedcResolution); ledcAttachPin(buzzerPin,buzzerLedcChannel); ledcWriteTone(buzzerLedcChannel,0); }
+  otaBegin(otaConfirmTimeoutMs, otaKey, firmwareRelease);
+  powerBegin(cpuMaxMhz, cpuMinMhz, currentSensePin, currentSenseMaPerMv);
+  outputs.begin();
+  static uint8_t dimmerPins[outputCount];
+  for (size_t i = 0; i < outputCount; ++i) dimmerPins[i] = outputChannels[i].pin;
+  dimmerBegin(dimmerPins, outputCount, onFadeEnd);
 
-  Serial.printf("Starting AP: %s\n", ssid);
-  WiFi.softAP(ssid,password);
-  Serial.println(WiFi.softAPIP());
-
-  // NTP
-  configTime(gmtOffset_sec,daylightOffset_sec,ntpServer);
+  buzzerBegin(buzzerPin, buzzerIsPassive, buzzerToneHz, onBuzzerNote);
 
   // Preferences
   prefs.begin(prefsNamespace,false);
+  persistBegin(&prefs,persistPriority);
+  persistRegister(PERSIST_ALARMS,prefsKey,encodeAlarmsRecord,alarmBlobSize(maxAlarms));
+  persistRegister(PERSIST_OUTPUTS,prefsOutputsKey,encodeOutputsRecord,sizeof(OutputsRecord));
+  persistRegister(PERSIST_TIMER,prefsTimerKey,encodeTimerRecord,timerRecordSize);
+  persistRegister(PERSIST_WIFI,prefsWifiKey,encodeWifiRecord);
+  persistRegister(PERSIST_CLOCK,prefsClockKey,encodeClockRecord,sizeof(ClockRecord));
+  loadClockFromPrefs();
   loadAlarmsFromPrefs();
+  loadTimersFromPrefs();
+  loadWifiFromPrefs();
+
+  Serial.printf("Starting AP: %s\n", ssid);
+  WiFi.softAP(ssid,password,1,0,maxApClients);
+  WiFi.setSleep(wifiPowerSave); // the AP itself stays awake to beacon
+  Serial.println(WiFi.softAPIP());
+
+  esp_timer_create_args_t alarmTimerArgs = {};
+  alarmTimerArgs.callback = onAlarmTimer;
+  alarmTimerArgs.name = "alarm";
+  esp_timer_create(&alarmTimerArgs, &alarmTimer);
+  esp_timer_create_args_t snoozeTimerArgs = {};
+  snoozeTimerArgs.callback = onSnoozeTimer;
+  snoozeTimerArgs.name = "snooze";
+  esp_timer_create(&snoozeTimerArgs, &snoozeTimer);
+  esp_timer_create_args_t actionTimerArgs = {};
+  actionTimerArgs.callback = onActionTimer;
+  actionTimerArgs.name = "ledaction";
+  esp_timer_create(&actionTimerArgs, &actionTimer);
+  esp_timer_create_args_t tickTimerArgs = {};
+  tickTimerArgs.callback = onTickTimer;
+  tickTimerArgs.name = "tick";
+  esp_timer_create(&tickTimerArgs, &tickTimer);
+  esp_timer_create_args_t timerExpiryArgs = {};
+  timerExpiryArgs.callback = onTimerExpiry;
+  timerExpiryArgs.name = "timer";
+  esp_timer_create(&timerExpiryArgs, &timerExpiry);
+  if (powerSensing()) {
+    esp_timer_create_args_t powerTimerArgs = {};
+    powerTimerArgs.callback = onPowerTimer;
+    powerTimerArgs.name = "power";
+    esp_timer_create(&powerTimerArgs, &powerTimer);
+  }
 
   // HTTP
-  server.on("/",HTTP_GET,handleRoot);
-  server.on("/status",HTTP_GET,handleStatus);
-  server.on("/led1on",HTTP_GET,handleLed1On);
-  server.on("/led1off",HTTP_GET,handleLed1Off);
-  server.on("/led2on",HTTP_GET,handleLed2On);
-  server.on("/led2off",HTTP_GET,handleLed2Off);
-  server.on("/setAlarms",HTTP_GET,handleSetAlarms);
-  server.on("/clearAlarms",HTTP_GET,handleClearAlarms);
-  server.on("/startTimer",HTTP_GET,handleStartTimer);
-  server.on("/stopTimer",HTTP_GET,handleStopTimer);
-  server.onNotFound(handleNotFound);
-  server.begin();
-  Serial.println("HTTP server started");
+  const char* headerKeys[] = {"If-None-Match", "Accept"};
+  httpCollectHeaders(headerKeys, 2);
+  bool routed = true; // false once a route did not fit the table
+  routed &= httpOn("/",HTTP_GET,handleRoot);
+  for (size_t i = 0; i < webAssetCount; ++i) {
+    const WebAsset* asset = &webAssets[i];
+    routed &= httpOn(asset->path,HTTP_GET,[asset](HttpRequest& req) { handleAsset(req, *asset); });
+  }
+  routed &= httpOn("/status",HTTP_GET,handleStatus);
+  routed &= httpOn("/events",HTTP_GET,handleEvents);
+  routed &= httpOn("/led",HTTP_GET,handleLed);
+  routed &= httpOn("/leds",HTTP_GET,handleGetLeds);
+  routed &= httpOn("/leds",HTTP_POST,handleSetLeds);
+  routed &= httpOn("/led*",HTTP_GET,handleLegacyLed); // after /led and /leds: first match wins
+  routed &= httpOn("/setAlarms",HTTP_GET,handleSetAlarms);
+  routed &= httpOn("/clearAlarms",HTTP_GET,handleClearAlarms);
+  routed &= httpOn("/alarms",HTTP_GET,handleGetAlarms);
+  routed &= httpOn("/alarms",HTTP_POST,handleAddAlarm);
+  routed &= httpOn("/alarms/*",HTTP_DELETE,handleDeleteAlarm);
+  routed &= httpOn("/alarms/*",HTTP_POST,handleAlarmAction); // snooze, dismiss
+  routed &= httpOn("/startTimer",HTTP_GET,handleStartTimer);
+  routed &= httpOn("/stopTimer",HTTP_GET,handleStopTimer);
+  routed &= httpOn("/timers",HTTP_GET,handleGetTimers);
+  routed &= httpOn("/timers",HTTP_POST,handleAddTimer);
+  routed &= httpOn("/timers/*",HTTP_DELETE,handleDeleteTimer);
+  routed &= httpOn("/time",HTTP_GET,handleGetTime);
+  routed &= httpOn("/time",HTTP_POST,handleSetTime);
+  routed &= httpOn("/wifi",HTTP_GET,handleGetWifi);
+  routed &= httpOn("/wifi",HTTP_POST,handleSetWifi);
+  routed &= httpOn("/batch",HTTP_POST,handleBatch);
+  routed &= httpOn("/metrics",HTTP_GET,handleMetrics);
+  routed &= httpOn("/trace",HTTP_GET,handleTrace);
+  routed &= httpOnUpload("/update",HTTP_POST,handleUpdateUpload,handleUpdate);
+  httpOnNotFound(handleNotFound);
+  if (!routed) Serial.println("HTTP route table full, raise maxRoutes in http.cpp");
+  assert(routed);
+
+  xTaskCreatePinnedToCore(controlTask,"control",4096,nullptr,controlPriority,&controlTaskHandle,controlCore);
+  if (powerTimer) esp_timer_start_periodic(powerTimer, currentSampleMs * 1000ULL);
+  wallclockOnChange(onClockChange);
+  restoreOutputs(); // queued before HTTP starts, so setup is the only producer
+  httpReady = httpBegin(80,networkCore,networkPriority,httpMaxSockets);
+  if (httpReady) Serial.printf("HTTP server started, %s boot, %lld ms\n", persistWarmBoot() ? "warm" : "cold", esp_timer_get_time() / 1000);
+  else Serial.println("HTTP server failed to start");
 }
 
 // ------------------- LOOP -------------------
+// Startup steps the first response does not wait for. After that all work
+// happens in controlTask/networkTask.
 void loop() {
-  server.handleClient();
-
-  // Timer handling
-  if(timerRunning && millis()>=timerTargetMs){
-    timerRunning=false;
-    triggerBuzzer(buzzerDurationMs);
-  }
-
-  // Non-blocking buzzer
-  if(buzzerActive && millis()>=buzzerEndMs) stopBuzzer();
-
-  // Alarm checking once per minute
-  struct tm timeinfo;
-  if(getLocalTime(&timeinfo)){
-    int curMinute = timeinfo.tm_min;
-    if(curMinute!=lastCheckedMinute){
-      lastCheckedMinute=curMinute;
-      String nowHHMM=getCurrentHHMM();
-      for(size_t i=0;i<alarms.size();++i){
-        if(alarms[i]==nowHHMM){ triggerBuzzer(buzzerDurationMs); break; }
-      }
+  // Clock (non-blocking; alarms stay idle until NTP, the browser or the RTC sets it)
+  wallclockBegin(gmtOffset_sec,daylightOffset_sec,ntpServer);
+
+  // Station (adds STA to the AP when credentials are set): NTP needs its uplink
+  WiFi.onEvent(onStationGotIp, ARDUINO_EVENT_WIFI_STA_GOT_IP);
+  connectStation();
+
+  if (udpControlKey[0]) {
+    if (udpControlBegin(udpControlPort, udpControlKey, handleUdpFrame, udpStatusGroup, udpStatusPort, networkCore, networkPriority)) {
+      Serial.printf("UDP control on port %u\n", udpControlPort);
+    } else {
+      Serial.println("UDP control failed to start");
     }
   }
-  delay(10);
-}
+  if (fleetRole != FLEET_OFF && fleetKey[0]) {
+    if (fleetBegin(fleetRole, fleetKey, encodeAlarmsRecord, applyFleetAlarms, &alarmsVersion, fleetBeaconMs)) {
+      Serial.printf("Fleet sync as %s\n", fleetRole == FLEET_MASTER ? "master" : "peer");
+    } else {
+      Serial.println("Fleet sync failed to start");
+    }
+  }
+#ifdef BENCH
+  // Same core as the server, below it: client and server share the CPU
+  xTaskCreatePinnedToCore(benchTask,"bench",6144,nullptr,1,nullptr,networkCore);
+#endif
 
+  // A new image is kept once its server answers; otherwise the rollback
+  // timer boots the previous one (ota.h)
+  if (httpReady && otaPendingVerify()) {
+    for (uint8_t i = 0; i < otaSelfCheckTries; ++i) {
+      if (httpSelfCheck()) { otaConfirm(); break; }
+      delay(1000);
+    }
+  }
+
+  persistCheckStored(); // NVS reads, only after a warm boot
+  vTaskDelete(nullptr);
+}
@@ -0,0 +1,61 @@
+#include "metrics.h"
+
+#include <Arduino.h>
+
+const uint32_t metricsBucketUs[metricsBucketCount] = {100, 500, 1000, 5000, 10000, 50000, 100000, 1000000};
+static const char* const bucketLabels[metricsBucketCount] = {"0.0001", "0.0005", "0.001", "0.005", "0.01", "0.05", "0.1", "1"};
+
+static portMUX_TYPE metricsMux = portMUX_INITIALIZER_UNLOCKED;
+
+void metricsObserve(LatencyHistogram& h, int64_t us) {
+  uint32_t v = us < 0 ? 0 : us > UINT32_MAX ? UINT32_MAX : (uint32_t)us;
+  uint8_t b = 0;
+  while (b < metricsBucketCount && v > metricsBucketUs[b]) ++b;
+  portENTER_CRITICAL(&metricsMux);
+  h.buckets[b]++;
+  h.count++;
+  h.sumUs += v;
+  portEXIT_CRITICAL(&metricsMux);
+}
+
+void metricsSnapshot(const LatencyHistogram& h, LatencyHistogram* out) {
+  portENTER_CRITICAL(&metricsMux);
+  *out = h;
+  portEXIT_CRITICAL(&metricsMux);
+}
+
+MetricsWriter::MetricsWriter(char* buf, size_t size, ChunkSink sink, void* ctx) : out(buf, size, sink, ctx) {}
+
+void MetricsWriter::gauge(const char* name, const char* help, int64_t value) {
+  out.appendf("# HELP %s %s\n# TYPE %s gauge\n%s %lld\n", name, help, name, name, (long long)value);
+}
+
+void MetricsWriter::counter(const char* name, const char* help, uint64_t value) {
+  out.appendf("# HELP %s %s\n# TYPE %s counter\n%s %llu\n", name, help, name, name, (unsigned long long)value);
+}
+
+void MetricsWriter::help(const char* name, const char* type, const char* help) {
+  out.appendf("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+void MetricsWriter::seconds(const char* name, const char* labels, uint64_t us) {
+  out.appendf("%s{%s} %llu.%06llu\n", name, labels, (unsigned long long)(us / 1000000), (unsigned long long)(us % 1000000));
+}
+
+void MetricsWriter::histogram(const char* name, const char* labels, const LatencyHistogram& live) {
+  LatencyHistogram h;
+  metricsSnapshot(live, &h);
+  const char* sep = labels && *labels ? "," : "";
+  if (!labels) labels = "";
+  uint32_t cumulative = 0;
+  for (uint8_t b = 0; b < metricsBucketCount; ++b) {
+    cumulative += h.buckets[b];
+    out.appendf("%s_bucket{%s%sle=\"%s\"} %u\n", name, labels, sep, bucketLabels[b], cumulative);
+  }
+  out.appendf("%s_bucket{%s%sle=\"+Inf\"} %u\n", name, labels, sep, h.count);
+  const char* open = *labels ? "{" : "";
+  const char* close = *labels ? "}" : "";
+  out.appendf("%s_sum%s%s%s %llu.%06llu\n", name, open, labels, close,
+          (unsigned long long)(h.sumUs / 1000000), (unsigned long long)(h.sumUs % 1000000));
+  out.appendf("%s_count%s%s%s %u\n", name, open, labels, close, h.count);
+}
@@ -0,0 +1,154 @@
+#include "ota.h"
+
+#include <Arduino.h>
+#include <string.h>
+#include "esp_ota_ops.h"
+#include "esp_timer.h"
+#include "mbedtls/md.h"
+#include "mbedtls/sha256.h"
+
+static esp_ota_handle_t handle = 0;
+static const esp_partition_t* target = nullptr; // non-null while an upload is open
+static mbedtls_sha256_context sha;
+static uint8_t expected[32];
+static uint32_t written = 0;
+static esp_timer_handle_t confirmTimer = nullptr;
+static volatile bool pendingVerify = false;
+static const char* key = "";
+static uint32_t runningRelease = 0;
+
+const char* const otaDenied = "Missing or wrong signature";
+const char* const otaNotNewer = "Release is not newer than the running one";
+
+// The Arduino core would confirm a pending image itself in initArduino();
+// returning true leaves that to otaConfirm().
+extern "C" bool verifyRollbackLater() { return true; }
+
+static void onConfirmTimeout(void*) {
+  log_e("New firmware not confirmed in time, rolling back");
+  esp_ota_mark_app_invalid_rollback_and_reboot();
+}
+
+void otaBegin(uint32_t confirmTimeoutMs, const char* k, uint32_t release) {
+  key = k;
+  runningRelease = release;
+  esp_ota_img_states_t state;
+  if (esp_ota_get_state_partition(esp_ota_get_running_partition(), &state) != ESP_OK) return;
+  if (state != ESP_OTA_IMG_PENDING_VERIFY) return;
+  pendingVerify = true;
+  esp_timer_create_args_t args = {};
+  args.callback = onConfirmTimeout;
+  args.name = "otaconfirm";
+  esp_timer_create(&args, &confirmTimer);
+  esp_timer_start_once(confirmTimer, confirmTimeoutMs * 1000ULL);
+}
+
+void otaConfirm() {
+  if (!pendingVerify) return;
+  esp_timer_stop(confirmTimer);
+  esp_ota_mark_app_valid_cancel_rollback();
+  pendingVerify = false;
+}
+
+bool otaPendingVerify() { return pendingVerify; }
+
+static bool parseSha256(const char* hex, uint8_t* out) {
+  if (!hex || strlen(hex) != 64) return false;
+  for (int i = 0; i < 64; ++i) {
+    char c = hex[i];
+    int v = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+    if (v < 0) return false;
+    out[i / 2] = i % 2 ? out[i / 2] | v : v << 4;
+  }
+  return true;
+}
+
+// Decimal digits only, no sign or spaces, within uint32_t
+static bool parseRelease(const char* s, uint32_t* out) {
+  if (!s || !*s || strlen(s) > 10) return false;
+  uint64_t v = 0;
+  for (; *s; ++s) {
+    if (*s < '0' || *s > '9') return false;
+    v = v * 10 + (*s - '0');
+  }
+  if (v > UINT32_MAX) return false;
+  *out = (uint32_t)v;
+  return true;
+}
+
+// Over "<sha256>:<release>". Constant time, so a wrong guess does not tell
+// how much of it was right.
+static bool signedBy(const char* sha256, const char* release, const char* sig) {
+  uint8_t given[32], mac[32];
+  char message[64 + 1 + 10 + 1];
+  if (!*key || !parseSha256(sig, given)) return false;
+  int n = snprintf(message, sizeof(message), "%s:%s", sha256, release);
+  mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), (const unsigned char*)key, strlen(key),
+                  (const unsigned char*)message, n, mac);
+  uint8_t diff = 0;
+  for (size_t i = 0; i < sizeof(mac); ++i) diff |= mac[i] ^ given[i];
+  return diff == 0;
+}
+
+const char* otaStart(const char* sha256, const char* release, const char* sig) {
+  otaAbort(); // one that never ended
+  written = 0;
+  uint32_t counter;
+  if (!parseSha256(sha256, expected)) return "Expected sha256=<64 hex digits>";
+  if (!parseRelease(release, &counter)) return "Expected release=<counter>";
+  if (!signedBy(sha256, release, sig)) return otaDenied;
+  if (counter <= runningRelease) return otaNotNewer;
+  // Writing the other slot now would overwrite the image we would roll back to
+  if (pendingVerify) return "Running firmware is not confirmed yet";
+  const esp_partition_t* next = esp_ota_get_next_update_partition(nullptr);
+  if (!next) return "No OTA partition";
+#ifdef OTA_WITH_SEQUENTIAL_WRITES
+  esp_err_t err = esp_ota_begin(next, OTA_WITH_SEQUENTIAL_WRITES, &handle); // erases as it goes
+#else
+  esp_err_t err = esp_ota_begin(next, OTA_SIZE_UNKNOWN, &handle);
+#endif
+  if (err != ESP_OK) return "Could not start the update";
+  target = next;
+  mbedtls_sha256_init(&sha);
+  mbedtls_sha256_starts_ret(&sha, 0);
+  return nullptr;
+}
+
+const char* otaWrite(const uint8_t* data, size_t len) {
+  if (!target) return "No update in progress";
+  mbedtls_sha256_update_ret(&sha, data, len);
+  if (esp_ota_write(handle, data, len) != ESP_OK) {
+    otaAbort();
+    return "Flash write failed";
+  }
+  written += len;
+  return nullptr;
+}
+
+const char* otaFinish() {
+  if (!target) return "No update in progress";
+  uint8_t digest[32];
+  mbedtls_sha256_finish_ret(&sha, digest);
+  mbedtls_sha256_free(&sha);
+  if (memcmp(digest, expected, sizeof(digest)) != 0) {
+    esp_ota_abort(handle);
+    target = nullptr;
+    return "SHA-256 mismatch";
+  }
+  const esp_partition_t* done = target;
+  target = nullptr;
+  esp_err_t err = esp_ota_end(handle); // checks the image header and its own hash
+  if (err == ESP_ERR_OTA_VALIDATE_FAILED) return "Not a valid firmware image";
+  if (err != ESP_OK || esp_ota_set_boot_partition(done) != ESP_OK) return "Could not finish the update";
+  log_i("Firmware written to %s, %u bytes", done->label, written);
+  return nullptr;
+}
+
+void otaAbort() {
+  if (!target) return;
+  esp_ota_abort(handle);
+  mbedtls_sha256_free(&sha);
+  target = nullptr;
+}
+
+uint32_t otaWritten() { return written; }
@@ -0,0 +1,184 @@
+#include "persist.h"
+
+#include <atomic>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_system.h"
+#include "esp_private/esp_clk.h" // esp_clk_rtc_time(): keeps counting through soft resets
+#include "snapshot_slot.h"
+#include "esp_timer.h"
+#include "trace.h"
+
+struct Record {
+  const char* key;
+  PersistEncoder encode;
+  uint32_t storedHash;
+  bool hashKnown;
+  uint8_t* rtc;         // snapshot slot, nullptr for NVS only
+  uint16_t rtcCapacity;
+  bool loadedFromRtc;   // NVS hash not read yet, see persistCheckStored()
+};
+
+static Preferences* store = nullptr;
+static Record records[PERSIST_COUNT];
+static std::atomic<uint32_t> dirtyMask(0);
+static volatile uint32_t lastChangeMs = 0;
+static TaskHandle_t persistTaskHandle = nullptr;
+static SemaphoreHandle_t writeLock = nullptr;
+static uint8_t scratch[persistMaxRecordSize]; // guarded by writeLock
+static uint32_t writes = 0, skips = 0, rtcWrites = 0;
+
+// Slots are carved out in registration order, so the layout is the same on
+// every boot of the same firmware. Not zeroed at startup: that is the point.
+RTC_NOINIT_ATTR static uint8_t rtcArea[persistRtcSize];
+static size_t rtcUsed = 0;
+static std::atomic<uint32_t> rtcDirtyMask(0);
+static bool warmBoot = false;
+
+static uint32_t fnv1a(const uint8_t* p, size_t n) {
+  uint32_t h = 2166136261u;
+  while (n--) { h ^= *p++; h *= 16777619u; }
+  return h;
+}
+
+static void writeRecord(Record& r) {
+  if (!r.encode) return;
+  size_t len = r.encode(scratch, sizeof(scratch));
+  uint32_t hash = fnv1a(scratch, len);
+  if (r.hashKnown && hash == r.storedHash) { skips++; return; }
+  int64_t start = esp_timer_get_time();
+  size_t put = store->putBytes(r.key, scratch, len);
+  trace(TRACE_NVS_WRITE, &r - records, esp_timer_get_time() - start);
+  if (put != len) { log_e("NVS write of %s failed", r.key); return; }
+  r.storedHash = hash;
+  r.hashKnown = true;
+  writes++;
+}
+
+// Caller holds writeLock
+static void writeSnapshots() {
+  uint32_t mask = rtcDirtyMask.exchange(0);
+  for (uint8_t id = 0; id < PERSIST_COUNT; ++id) {
+    Record& r = records[id];
+    if (!(mask & (1u << id)) || !r.rtc) continue;
+    size_t len = r.encode(scratch, sizeof(scratch));
+    if (snapshotWrite(r.rtc, r.rtcCapacity, scratch, len, esp_clk_rtc_time())) rtcWrites++;
+    else log_e("%s outgrew its RTC slot (%u bytes)", r.key, len);
+  }
+}
+
+void persistFlush() {
+  if (!writeLock) return;
+  xSemaphoreTake(writeLock, portMAX_DELAY);
+  writeSnapshots(); // first, so the RTC copy is never older than NVS
+  uint32_t mask = dirtyMask.exchange(0);
+  for (uint8_t id = 0; id < PERSIST_COUNT; ++id) {
+    if (mask & (1u << id)) writeRecord(records[id]);
+  }
+  xSemaphoreGive(writeLock);
+}
+
+static void persistTask(void*) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    // Debounce: every further change restarts the quiet period. RTC copies
+    // are cheap and are what a crash leaves, so they follow every change.
+    for (;;) {
+      xSemaphoreTake(writeLock, portMAX_DELAY);
+      writeSnapshots();
+      xSemaphoreGive(writeLock);
+      uint32_t quiet = millis() - lastChangeMs;
+      if (quiet >= persistDebounceMs) break;
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(persistDebounceMs - quiet));
+    }
+    persistFlush();
+  }
+}
+
+// esp_restart(): write anything still pending. Unchanged records are skipped
+// by hash, so marking everything dirty only costs the encode.
+static void onShutdown() {
+  dirtyMask |= (1u << PERSIST_COUNT) - 1;
+  rtcDirtyMask |= (1u << PERSIST_COUNT) - 1;
+  persistFlush();
+}
+
+void persistBegin(Preferences* prefs, UBaseType_t priority) {
+  // Power-on: RTC memory holds noise (the CRCs would reject it, but be sure)
+  esp_reset_reason_t reason = esp_reset_reason();
+  if (reason == ESP_RST_POWERON || reason == ESP_RST_UNKNOWN) memset(rtcArea, 0, sizeof(rtcArea));
+  store = prefs;
+  writeLock = xSemaphoreCreateMutex();
+  xTaskCreate(persistTask, "persist", 3072, nullptr, priority, &persistTaskHandle);
+  esp_register_shutdown_handler(onShutdown);
+}
+
+void persistRegister(PersistRecord id, const char* key, PersistEncoder encode, size_t rtcCapacity) {
+  Record& r = records[id];
+  r.key = key;
+  r.encode = encode;
+  if (!rtcCapacity) return;
+  if (rtcUsed + snapshotSlotSize(rtcCapacity) > sizeof(rtcArea) || rtcCapacity > 0xFFFF) {
+    log_e("No RTC room for %s, NVS only", key);
+    return;
+  }
+  r.rtc = rtcArea + rtcUsed;
+  r.rtcCapacity = rtcCapacity;
+  rtcUsed += snapshotSlotSize(rtcCapacity);
+}
+
+size_t persistLoad(PersistRecord id, uint8_t* buf, size_t size, int64_t* ageUs) {
+  Record& r = records[id];
+  if (ageUs) *ageUs = -1;
+  int64_t savedAtUs;
+  size_t len = r.rtc ? snapshotRead(r.rtc, r.rtcCapacity, buf, size, &savedAtUs) : 0;
+  if (len) {
+    int64_t age = (int64_t)esp_clk_rtc_time() - savedAtUs;
+    if (ageUs && age >= 0) *ageUs = age;
+    r.loadedFromRtc = true;
+    warmBoot = true;
+    return len;
+  }
+  len = store->getBytesLength(r.key);
+  if (len == 0 || len > size || store->getBytes(r.key, buf, len) != len) return 0;
+  r.storedHash = fnv1a(buf, len);
+  r.hashKnown = true;
+  return len;
+}
+
+bool persistWarmBoot() { return warmBoot; }
+
+void persistCheckStored() {
+  for (uint8_t id = 0; id < PERSIST_COUNT; ++id) {
+    Record& r = records[id];
+    if (!r.loadedFromRtc) continue;
+    xSemaphoreTake(writeLock, portMAX_DELAY);
+    size_t len = store->getBytesLength(r.key);
+    if (len && len <= sizeof(scratch) && store->getBytes(r.key, scratch, len) == len) {
+      r.storedHash = fnv1a(scratch, len);
+      r.hashKnown = true;
+    }
+    r.loadedFromRtc = false;
+    xSemaphoreGive(writeLock);
+    // Re-encodes the current state; skipped by hash if NVS already has it
+    dirtyMask |= 1u << id;
+  }
+  if (dirtyMask) xTaskNotifyGive(persistTaskHandle);
+}
+
+void persistMarkDirty(PersistRecord id) {
+  lastChangeMs = millis();
+  dirtyMask |= 1u << id;
+  rtcDirtyMask |= 1u << id;
+  if (persistTaskHandle) xTaskNotifyGive(persistTaskHandle);
+}
+
+void persistRefreshSnapshot(PersistRecord id) {
+  rtcDirtyMask |= 1u << id;
+  if (persistTaskHandle) xTaskNotifyGive(persistTaskHandle);
+}
+
+uint32_t persistWriteCount() { return writes; }
+uint32_t persistSkipCount() { return skips; }
+uint32_t persistRtcWriteCount() { return rtcWrites; }
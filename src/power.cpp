@@ -0,0 +1,91 @@
+#include "power.h"
+
+#include <Arduino.h>
+#include "esp_pm.h"
+#include "esp_freertos_hooks.h"
+
+static const uint8_t senseSamples = 16;
+
+static bool dfsEnabled = false;
+static bool lightSleepEnabled = false;
+static esp_pm_lock_handle_t awakeLock = nullptr;
+static uint32_t holdMask = 0;
+static portMUX_TYPE holdMux = portMUX_INITIALIZER_UNLOCKED;
+
+static TaskHandle_t idleTasks[portNUM_PROCESSORS];
+static volatile uint32_t busyTicks[portNUM_PROCESSORS];
+
+static int sensePin = -1;
+static float senseMaPerMv = 0;
+static int64_t idleCurrentUa = -1; // smoothed, -1 until the first reading
+
+// Sampling: whichever task the tick interrupted ran during that tick
+static void IRAM_ATTR onTick() {
+  BaseType_t core = xPortGetCoreID();
+  if (xTaskGetCurrentTaskHandle() != idleTasks[core]) busyTicks[core]++;
+}
+
+void powerBegin(uint16_t maxMhz, uint16_t minMhz, int pin, float maPerMv) {
+  for (BaseType_t core = 0; core < portNUM_PROCESSORS; ++core) {
+    idleTasks[core] = xTaskGetIdleTaskHandleForCPU(core);
+    esp_register_freertos_tick_hook_for_cpu(onTick, core);
+  }
+  sensePin = pin;
+  senseMaPerMv = maPerMv;
+  if (sensePin >= 0) analogSetPinAttenuation(sensePin, ADC_11db);
+
+#if CONFIG_PM_ENABLE
+  esp_pm_config_esp32_t cfg = {};
+  cfg.max_freq_mhz = maxMhz;
+  cfg.min_freq_mhz = minMhz;
+  cfg.light_sleep_enable = true;
+  esp_err_t err = esp_pm_configure(&cfg);
+  if (err == ESP_ERR_NOT_SUPPORTED) { // no tickless idle in this SDK build
+    cfg.light_sleep_enable = false;
+    err = esp_pm_configure(&cfg);
+  }
+  dfsEnabled = err == ESP_OK;
+  lightSleepEnabled = dfsEnabled && cfg.light_sleep_enable;
+  if (lightSleepEnabled && esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "awake", &awakeLock) == ESP_OK) {
+    portENTER_CRITICAL(&holdMux);
+    if (holdMask) esp_pm_lock_acquire(awakeLock); // held since before powerBegin()
+    portEXIT_CRITICAL(&holdMux);
+  }
+#endif
+  Serial.printf("Power: %s, %u-%u MHz\n", lightSleepEnabled ? "DFS + light sleep" : dfsEnabled ? "DFS" : "fixed clock",
+                dfsEnabled ? minMhz : maxMhz, maxMhz);
+}
+
+void IRAM_ATTR powerHold(uint32_t reason, bool hold) {
+  portENTER_CRITICAL_SAFE(&holdMux);
+  uint32_t before = holdMask;
+  holdMask = hold ? holdMask | reason : holdMask & ~reason;
+  if (awakeLock && !before != !holdMask) {
+    if (holdMask) esp_pm_lock_acquire(awakeLock);
+    else esp_pm_lock_release(awakeLock);
+  }
+  portEXIT_CRITICAL_SAFE(&holdMux);
+}
+
+bool powerSensing() { return sensePin >= 0; }
+
+void powerSampleCurrent() {
+  if (sensePin < 0 || holdMask) return;
+  uint32_t mv = 0;
+  for (uint8_t i = 0; i < senseSamples; ++i) mv += analogReadMilliVolts(sensePin);
+  int64_t ua = (int64_t)(mv * senseMaPerMv * 1000 / senseSamples);
+  idleCurrentUa = idleCurrentUa < 0 ? ua : (idleCurrentUa * 7 + ua) / 8;
+}
+
+void powerWriteMetrics(MetricsWriter& w) {
+  w.gauge("esp32_power_dfs_enabled", "Dynamic frequency scaling active (0/1)", dfsEnabled);
+  w.gauge("esp32_power_light_sleep_enabled", "Automatic light sleep active (0/1)", lightSleepEnabled);
+  w.gauge("esp32_power_holds", "Reasons keeping the chip out of light sleep (1 buzzer, 2 PWM)", holdMask);
+  w.help("esp32_cpu_busy_seconds_total", "counter", "Time a core ran anything but its idle task, sampled per tick");
+  char labels[16];
+  for (int core = 0; core < portNUM_PROCESSORS; ++core) {
+    snprintf(labels, sizeof(labels), "core=\"%d\"", core);
+    w.seconds("esp32_cpu_busy_seconds_total", labels, (uint64_t)busyTicks[core] * portTICK_PERIOD_MS * 1000);
+  }
+  if (idleCurrentUa >= 0) w.gauge("esp32_idle_current_microamps", "Supply current while idle, smoothed", idleCurrentUa);
+}
@@ -0,0 +1,119 @@
+#include "trace.h"
+
+#include <Arduino.h>
+#include "esp_timer.h"
+#include "http.h"
+#include "trace_ring.h"
+
+// Chrome trace tracks (tid), each named by a metadata event
+enum TraceTrack : uint8_t { TRACK_HTTP = 1, TRACK_CONTROL, TRACK_BUZZER, TRACK_PERSIST };
+static const char* const trackNames[] = {nullptr, "http", "control", "buzzer", "persist"};
+
+static TraceRing<traceCapacity> ring;
+
+void IRAM_ATTR trace(TraceEvent event, uint16_t a, uint32_t b) {
+  ring.write(event, xPortGetCoreID(), esp_timer_get_time(), a, b);
+}
+
+static void writeEvent(JsonWriter& w, const char* name, const char* phase, int64_t ts, TraceTrack track) {
+  w.string("name", name);
+  w.string("ph", phase);
+  w.number("ts", ts);
+  w.number("pid", 1);
+  w.number("tid", track);
+}
+
+static void writeRecord(JsonWriter& w, const TraceRecord& r) {
+  char name[48];
+  w.beginObject();
+  switch (r.event) {
+    case TRACE_REQUEST_BEGIN:
+    case TRACE_REQUEST_END: {
+      const char* uri = httpRouteUri(r.a);
+      if (uri) snprintf(name, sizeof(name), "%s %s", httpRouteMethod(r.a), uri);
+      else strcpy(name, "<not found>");
+      writeEvent(w, name, r.event == TRACE_REQUEST_BEGIN ? "B" : "E", r.timeUs, TRACK_HTTP);
+      break;
+    }
+    case TRACE_ALARM_FIRE:
+      writeEvent(w, "alarm", "i", r.timeUs, TRACK_CONTROL);
+      w.string("s", "t");
+      w.beginObject("args");
+      snprintf(name, sizeof(name), "%02u:%02u", r.a / 60, r.a % 60);
+      w.string("rule", name);
+      w.number("latenessUs", r.b);
+      w.endObject();
+      break;
+    case TRACE_TIMER_FIRE:
+      writeEvent(w, "timer", "i", r.timeUs, TRACK_CONTROL);
+      w.string("s", "t");
+      w.beginObject("args");
+      w.number("id", r.b);
+      w.number("latenessMs", r.a);
+      w.endObject();
+      break;
+    case TRACE_BUZZER_ON:
+      writeEvent(w, "buzzer", "B", r.timeUs, TRACK_BUZZER);
+      w.beginObject("args");
+      w.number("steps", r.a);
+      w.endObject();
+      break;
+    case TRACE_BUZZER_OFF:
+      writeEvent(w, "buzzer", "E", r.timeUs, TRACK_BUZZER);
+      w.beginObject("args");
+      w.boolean("finished", r.a);
+      w.endObject();
+      break;
+    case TRACE_NVS_WRITE:
+    case TRACE_LOOP_OVERRUN: {
+      // Recorded at the end: complete events start their duration earlier
+      bool nvs = r.event == TRACE_NVS_WRITE;
+      writeEvent(w, nvs ? "nvs write" : "overrun", "X", r.timeUs - r.b, nvs ? TRACK_PERSIST : TRACK_CONTROL);
+      w.number("dur", r.b);
+      if (nvs) {
+        w.beginObject("args");
+        w.number("record", r.a);
+        w.endObject();
+      }
+      break;
+    }
+    default:
+      writeEvent(w, "unknown", "i", r.timeUs, TRACK_CONTROL);
+      break;
+  }
+  w.endObject();
+}
+
+void traceWriteJson(JsonWriter& w, uint32_t since) {
+  uint32_t written = ring.written();
+  uint32_t from = ring.oldest(written);
+  if (since > from && since <= written) from = since;
+  uint32_t lost = from - (since < from ? since : from); // overwritten before this dump
+  w.beginObject();
+  w.string("displayTimeUnit", "ms");
+  w.beginArray("traceEvents");
+  for (uint8_t t = TRACK_HTTP; t <= TRACK_PERSIST; ++t) {
+    w.beginObject();
+    w.string("name", "thread_name");
+    w.string("ph", "M");
+    w.number("pid", 1);
+    w.number("tid", t);
+    w.beginObject("args");
+    w.string("name", trackNames[t]);
+    w.endObject();
+    w.endObject();
+  }
+  TraceRecord r;
+  uint32_t skipped = 0;
+  for (uint32_t ticket = from; ticket != written; ++ticket) {
+    if (ring.read(ticket, &r)) writeRecord(w, r);
+    else skipped++; // being written, or overwritten while we streamed
+  }
+  w.endArray();
+  w.beginObject("otherData");
+  w.number("next", written);
+  w.number("lost", lost + skipped);
+  w.number("nowUs", esp_timer_get_time());
+  w.endObject();
+  w.endObject();
+}
@@ -0,0 +1,154 @@
+#include "udp_control.h"
+
+#include <atomic>
+#include <string.h>
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include "mbedtls/md.h"
+#include "http.h"
+#include "snapshot_slot.h"
+#include "spsc_queue.h"
+#include "wallclock.h"
+
+static const uint8_t maxPeers = 8; // senders with their own replay window
+static const int64_t nonceToleranceUs = 60LL * 1000000; // panel clocks vs ours, once ours is set
+
+struct Pending {
+  UdpFrame frame;
+  sockaddr_in from;
+  int64_t receivedUs;
+};
+
+static int sock = -1;
+static const char* macKey = "";
+static size_t macKeyLen = 0;
+static UdpHandler handler = nullptr;
+static sockaddr_in statusAddr;
+static bool statusEnabled = false;
+
+static SpscQueue<Pending, 8> pending; // producer: receive task, consumer: server task
+static std::atomic<uint8_t> drainQueued(0);
+static ReplayWindow<maxPeers> replay;  // receive task only
+static uint64_t lastNonce = 0;         // ours, server task only
+
+// The replay window outlives soft resets here (snapshot_slot.h), so a
+// restart does not make captured frames fresh again
+RTC_NOINIT_ATTR static uint8_t rtcReplay[snapshotSlotSize(sizeof(replay))];
+
+static volatile uint32_t received = 0, rejected = 0, replayed = 0, dropped = 0;
+static LatencyHistogram ackLatency; // datagram in -> ack sent
+
+static void sign(const uint8_t* header, uint8_t* mac) {
+  uint8_t full[32];
+  mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), (const unsigned char*)macKey, macKeyLen, header,
+                  udpFrameHeaderSize, full);
+  memcpy(mac, full, udpFrameMacSize);
+}
+
+// Either task: lwIP sockets take concurrent sends
+static void sendFrame(const UdpFrame& f, const sockaddr_in& to) {
+  uint8_t buf[udpFrameSize];
+  encodeUdpFrame(f, buf);
+  sign(buf, buf + udpFrameHeaderSize);
+  sendto(sock, buf, sizeof(buf), 0, (const sockaddr*)&to, sizeof(to));
+}
+
+static UdpFrame ackFor(const UdpFrame& request, uint8_t status) {
+  UdpFrame ack = {(uint8_t)(request.opcode | udpAck), request.channel, status, 0, request.sender, request.nonce};
+  return ack;
+}
+
+// Server task
+static void drain(void*) {
+  drainQueued = 0;
+  Pending p;
+  while (pending.pop(p)) {
+    UdpFrame ack = ackFor(p.frame, UDP_OK);
+    handler(p.frame, &ack);
+    sendFrame(ack, p.from);
+    metricsObserve(ackLatency, esp_timer_get_time() - p.receivedUs);
+  }
+}
+
+static void receiveTask(void*) {
+  uint8_t buf[udpFrameSize + 1]; // one spare byte, so longer datagrams show as such
+  for (;;) {
+    sockaddr_in from;
+    socklen_t fromLen = sizeof(from);
+    int n = recvfrom(sock, buf, sizeof(buf), 0, (sockaddr*)&from, &fromLen);
+    if (n < 0) { vTaskDelay(pdMS_TO_TICKS(100)); continue; } // interface going down
+    Pending p;
+    p.receivedUs = esp_timer_get_time();
+    p.from = from;
+    received++;
+    uint8_t mac[udpFrameMacSize];
+    // Sender 0 is us: our own status frames sent back are not requests
+    if (!decodeUdpFrame(buf, n, &p.frame) || (p.frame.opcode & udpAck) || !p.frame.sender) { rejected++; continue; }
+    sign(buf, mac);
+    if (!udpMacEqual(mac, buf + udpFrameHeaderSize)) { rejected++; continue; }
+    int64_t nowUs = wallclockNowUs();
+    if (nowUs > nonceToleranceUs) replay.raiseFloor(nowUs - nonceToleranceUs);
+    if (!replay.accept(p.frame.sender, p.frame.nonce)) { replayed++; continue; }
+    snapshotWrite(rtcReplay, sizeof(replay), (const uint8_t*)&replay, sizeof(replay), p.receivedUs);
+    if (!pending.push(p)) {
+      dropped++;
+      sendFrame(ackFor(p.frame, UDP_BUSY), from);
+      continue;
+    }
+    if (drainQueued.exchange(1) == 0 && !httpQueueWork(drain, nullptr)) drainQueued = 0;
+  }
+}
+
+bool udpControlBegin(uint16_t port, const char* key, UdpHandler h, const char* statusGroup, uint16_t statusPort,
+                     BaseType_t core, UBaseType_t priority) {
+  macKey = key;
+  macKeyLen = strlen(key);
+  handler = h;
+  esp_reset_reason_t reason = esp_reset_reason();
+  if (reason == ESP_RST_POWERON || reason == ESP_RST_UNKNOWN) snapshotClear(rtcReplay, sizeof(replay));
+  uint8_t saved[sizeof(replay)];
+  if (snapshotRead(rtcReplay, sizeof(replay), saved, sizeof(saved), nullptr) == sizeof(replay)) memcpy(&replay, saved, sizeof(replay));
+  sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (sock < 0) return false;
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (bind(sock, (const sockaddr*)&addr, sizeof(addr)) < 0) {
+    closesocket(sock);
+    sock = -1;
+    return false;
+  }
+  if (statusGroup && statusPort) {
+    statusAddr = {};
+    statusAddr.sin_family = AF_INET;
+    statusAddr.sin_port = htons(statusPort);
+    statusEnabled = inet_pton(AF_INET, statusGroup, &statusAddr.sin_addr) == 1;
+    uint8_t ttl = 1; // the local network only
+    setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+  }
+  return xTaskCreatePinnedToCore(receiveTask, "udp", 3072, nullptr, priority, nullptr, core) == pdPASS;
+}
+
+void udpMulticast(const UdpFrame& frame) {
+  if (!statusEnabled) return;
+  UdpFrame f = frame;
+  uint64_t now = wallclockNowUs();
+  lastNonce = now > lastNonce ? now : lastNonce + 1;
+  f.sender = 0;
+  f.nonce = lastNonce;
+  sendFrame(f, statusAddr);
+}
+
+void udpWriteMetrics(MetricsWriter& w) {
+  if (sock < 0) return;
+  w.counter("esp32_udp_frames_received_total", "UDP control datagrams received", received);
+  w.counter("esp32_udp_frames_rejected_total", "UDP datagrams dropped for size, version or MAC", rejected);
+  w.counter("esp32_udp_frames_replayed_total", "Authentic UDP frames dropped as replays", replayed);
+  w.counter("esp32_udp_frames_busy_total", "UDP frames answered busy, queue full", dropped);
+  w.histogramHelp("udp_ack_duration_seconds", "UDP frame received -> ack sent");
+  w.histogram("udp_ack_duration_seconds", nullptr, ackLatency);
+}
@@ -0,0 +1,208 @@
+#include "wallclock.h"
+
+#include <Arduino.h>
+#include <algorithm>
+#include <time.h>
+#include <sys/time.h>
+#include "esp_sntp.h"
+#include "esp_timer.h"
+#include "calendar.h"
+
+// Anything before 2021-01-01 means the RTC was never set.
+static const time_t minValidEpoch = 1609459200;
+static const int64_t stepThresholdUs = 2000000; // larger offsets are stepped
+static const int64_t slewPpm = 500;
+static const int64_t driftIntervalUs = 600LL * 1000000;  // between NTP samples
+static const int32_t maxDriftPpb = 200000; // beyond 200 ppm the sample is wrong, not the crystal
+static const int64_t ntpTrustUs = 12LL * 3600 * 1000000; // browser and fleet time ignored meanwhile
+
+// wall time = epochUs + elapsed * (1 + driftPpb / 1e9), plus slewUs phased
+// in at slewPpm, where elapsed is esp_timer_get_time() - monoUs
+struct Reference {
+  int64_t epochUs;
+  int64_t monoUs;
+  int64_t slewUs;
+  int32_t driftPpb;
+};
+
+static portMUX_TYPE clockMux = portMUX_INITIALIZER_UNLOCKED;
+static volatile bool clockSynced = false;
+static void (*changeListener)() = nullptr;
+static Reference ref = {};
+static WallclockSource source = WALLCLOCK_NONE;
+static int64_t syncMonoUs = 0;                 // last accepted sample
+static int64_t lastOffsetUs = 0;
+static int64_t anchorEpochUs = 0, anchorMonoUs = 0; // NTP sample drift is measured from
+static bool driftKnown = false;
+
+// Local minute number cache (day * 1440 + minute of day), recomputed only
+// when the minute rolls over. Both fields are read and written under
+// clockMux; localtime_r() may block, so the recompute runs outside it and
+// is only stored if no sample moved the reference meanwhile (generation).
+static int32_t cachedMinute = -1;
+static int64_t cachedMinuteEndMono = 0;
+static uint32_t generation = 0;
+
+static int64_t epochAt(int64_t mono) {
+  int64_t elapsed = mono - ref.monoUs;
+  int64_t slewed = std::min(elapsed * slewPpm / 1000000, ref.slewUs < 0 ? -ref.slewUs : ref.slewUs);
+  return ref.epochUs + elapsed + elapsed * ref.driftPpb / 1000000000 + (ref.slewUs < 0 ? -slewed : slewed);
+}
+
+// Only NTP samples are precise enough to measure the crystal
+static void updateDrift(int64_t epochUs, int64_t mono) {
+  if (anchorMonoUs && mono - anchorMonoUs < driftIntervalUs) return;
+  if (anchorMonoUs) {
+    int64_t monoDelta = mono - anchorMonoUs;
+    int64_t ppb = (epochUs - anchorEpochUs - monoDelta) * 1000000000 / monoDelta;
+    if (ppb >= -maxDriftPpb && ppb <= maxDriftPpb) {
+      ref.driftPpb = driftKnown ? (int32_t)((ref.driftPpb * 3LL + ppb) / 4) : (int32_t)ppb;
+      driftKnown = true;
+    }
+  }
+  anchorEpochUs = epochUs;
+  anchorMonoUs = mono;
+}
+
+static void applySample(int64_t epochUs, WallclockSource from) {
+  int64_t mono = esp_timer_get_time();
+  portENTER_CRITICAL(&clockMux);
+  if (from == WALLCLOCK_NTP) updateDrift(epochUs, mono);
+  int64_t predicted = epochAt(mono);
+  int64_t offset = epochUs - predicted;
+  bool step = !clockSynced || from > source || offset > stepThresholdUs || offset < -stepThresholdUs;
+  // Rebase on the current prediction so a slew starts from where we are
+  // (elapsed restarts at 0, and the drift term with it)
+  ref.epochUs = step ? epochUs : predicted;
+  ref.monoUs = mono;
+  ref.slewUs = step ? 0 : offset;
+  lastOffsetUs = clockSynced ? offset : 0;
+  source = from;
+  syncMonoUs = mono;
+  cachedMinuteEndMono = 0; // force a recompute
+  generation++;
+  clockSynced = true;
+  portEXIT_CRITICAL(&clockMux);
+  if (step && (from == WALLCLOCK_BROWSER || from == WALLCLOCK_FLEET)) {
+    // SNTP sets the system RTC itself; these should outlive a reset too
+    struct timeval tv = {(time_t)(epochUs / 1000000), (suseconds_t)(epochUs % 1000000)};
+    settimeofday(&tv, nullptr);
+  }
+  if (changeListener) changeListener();
+}
+
+// Runs in the SNTP (lwIP) task
+static void onTimeSync(struct timeval* tv) {
+  applySample((int64_t)tv->tv_sec * 1000000LL + tv->tv_usec, WALLCLOCK_NTP);
+}
+
+void wallclockBegin(long gmtOffsetSec, int daylightOffsetSec, const char* ntpServer) {
+  sntp_set_time_sync_notification_cb(onTimeSync);
+  configTime(gmtOffsetSec, daylightOffsetSec, ntpServer);
+
+  // After a soft reset the RTC still holds the time from before
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  if (tv.tv_sec >= minValidEpoch) applySample((int64_t)tv.tv_sec * 1000000LL + tv.tv_usec, WALLCLOCK_RTC);
+}
+
+void wallclockRestore(int32_t driftPpb, bool known) {
+  if (driftPpb < -maxDriftPpb || driftPpb > maxDriftPpb) return;
+  portENTER_CRITICAL(&clockMux);
+  ref.driftPpb = driftPpb;
+  driftKnown = known;
+  cachedMinuteEndMono = 0;
+  generation++;
+  portEXIT_CRITICAL(&clockMux);
+}
+
+bool wallclockSynced() { return clockSynced; }
+
+WallclockSource wallclockSource() { return source; }
+
+const char* wallclockSourceName(WallclockSource s) {
+  switch (s) {
+    case WALLCLOCK_RTC: return "rtc";
+    case WALLCLOCK_BROWSER: return "browser";
+    case WALLCLOCK_FLEET: return "fleet";
+    case WALLCLOCK_NTP: return "ntp";
+    default: return "none";
+  }
+}
+
+static bool ntpTrusted() { return source == WALLCLOCK_NTP && esp_timer_get_time() - syncMonoUs < ntpTrustUs; }
+
+bool wallclockSetFromClient(int64_t epochMs) {
+  if (epochMs < (int64_t)minValidEpoch * 1000 || ntpTrusted()) return false;
+  applySample(epochMs * 1000, WALLCLOCK_BROWSER);
+  return true;
+}
+
+bool wallclockSetFromFleet(int64_t epochUs, int64_t atUs) {
+  if (epochUs < (int64_t)minValidEpoch * 1000000 || ntpTrusted()) return false;
+  applySample(epochUs + (esp_timer_get_time() - atUs), WALLCLOCK_FLEET);
+  return true;
+}
+
+void wallclockResync() {
+  if (sntp_enabled()) sntp_restart();
+}
+
+int64_t wallclockSyncAgeMs() { return clockSynced ? (esp_timer_get_time() - syncMonoUs) / 1000 : -1; }
+int64_t wallclockLastOffsetUs() { return lastOffsetUs; }
+int32_t wallclockDriftPpb() { return ref.driftPpb; }
+bool wallclockDriftKnown() { return driftKnown; }
+
+void wallclockOnChange(void (*listener)()) { changeListener = listener; }
+
+static int64_t nowUs(int64_t mono) {
+  portENTER_CRITICAL(&clockMux);
+  int64_t epochUs = epochAt(mono);
+  portEXIT_CRITICAL(&clockMux);
+  return epochUs;
+}
+
+int64_t wallclockNowMs() { return wallclockNowUs() / 1000; }
+
+int64_t wallclockNowUs() {
+  if (!clockSynced) return 0;
+  return nowUs(esp_timer_get_time());
+}
+
+int32_t wallclockLocalMinute() {
+  if (!clockSynced) return -1;
+  for (;;) {
+    int64_t mono = esp_timer_get_time();
+    portENTER_CRITICAL(&clockMux);
+    if (mono < cachedMinuteEndMono) {
+      int32_t minute = cachedMinute;
+      portEXIT_CRITICAL(&clockMux);
+      return minute;
+    }
+    int64_t epochUs = epochAt(mono);
+    uint32_t seen = generation;
+    portEXIT_CRITICAL(&clockMux);
+
+    time_t secs = (time_t)(epochUs / 1000000LL);
+    struct tm t;
+    localtime_r(&secs, &t);
+    int32_t minute = daysFromCivil(t.tm_year + 1900, t.tm_mon + 1, t.tm_mday) * 1440 + t.tm_hour * 60 + t.tm_min;
+    // Time left in this minute, measured on the monotonic clock
+    int64_t intoMinuteUs = (int64_t)t.tm_sec * 1000000LL + epochUs % 1000000LL;
+
+    portENTER_CRITICAL(&clockMux);
+    bool current = seen == generation;
+    if (current) {
+      cachedMinute = minute;
+      cachedMinuteEndMono = mono + (60000000LL - intoMinuteUs);
+    }
+    portEXIT_CRITICAL(&clockMux);
+    if (current) return minute;
+    // Stepped or slewed while we converted: again, against the new reference
+  }
+}
+
+int wallclockMinuteOfDay() {
+  int32_t minute = wallclockLocalMinute();
+  return minute < 0 ? -1 : minute % 1440;
+}
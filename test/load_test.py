@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+"""Over-the-air load test, the host-side counterpart of env:esp32dev-bench.
+
+Join the board's softAP, then for example:
+
+    python3 test/load_test.py --host 192.168.4.1 -n 500 -c 4
+
+Hits each path with `-c` concurrent clients (one connection per worker,
+keep-alive when the server allows it) and prints requests/s and latency
+percentiles. --conditional revalidates with If-None-Match like a browser
+does, so unchanged responses come back as bodiless 304s. Pass --metrics to
+dump the board's own /metrics afterwards.
+Standard library only.
+"""
+
+import argparse
+import http.client
+import threading
+import time
+
+
+def worker(host, port, path, count, timeout, conditional, latencies, errors, lock):
+    conn = None
+    local, failed, not_modified, etag = [], 0, 0, None
+    for _ in range(count):
+        start = time.perf_counter()
+        try:
+            if conn is None:
+                conn = http.client.HTTPConnection(host, port, timeout=timeout)
+            headers = {"Accept-Encoding": "gzip"}
+            if conditional and etag:
+                headers["If-None-Match"] = etag
+            conn.request("GET", path, headers=headers)
+            resp = conn.getresponse()
+            resp.read()
+            if resp.status == 304:
+                not_modified += 1
+            elif resp.status != 200:
+                failed += 1
+            etag = resp.getheader("ETag", etag)
+            if resp.getheader("Connection", "").lower() == "close" or resp.will_close:
+                conn.close()
+                conn = None
+        except (OSError, http.client.HTTPException):
+            failed += 1
+            if conn is not None:
+                conn.close()
+            conn = None
+        local.append(time.perf_counter() - start)
+    if conn is not None:
+        conn.close()
+    with lock:
+        latencies.extend(local)
+        errors[0] += failed
+        errors[1] += not_modified
+
+
+def percentile(sorted_values, pct):
+    if not sorted_values:
+        return 0.0
+    index = max(0, (len(sorted_values) * pct + 99) // 100 - 1)
+    return sorted_values[index]
+
+
+def run(host, port, path, total, concurrency, timeout, conditional):
+    latencies, errors, lock = [], [0, 0], threading.Lock()
+    per_worker = [total // concurrency + (1 if i < total % concurrency else 0) for i in range(concurrency)]
+    threads = [threading.Thread(target=worker, args=(host, port, path, n, timeout, conditional, latencies, errors, lock))
+               for n in per_worker]
+    start = time.perf_counter()
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    elapsed = time.perf_counter() - start
+    latencies.sort()
+    ms = lambda s: s * 1000.0
+    print("GET %-8s %4d req, %3d failed, %4d 304, %7.1f req/s, p50 %6.1f ms, p99 %6.1f ms, max %6.1f ms" % (
+        path, total, errors[0], errors[1], total / elapsed, ms(percentile(latencies, 50)),
+        ms(percentile(latencies, 99)), ms(latencies[-1] if latencies else 0)))
+    return errors[0]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--host", default="192.168.4.1")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("-n", "--requests", type=int, default=500, help="requests per path")
+    parser.add_argument("-c", "--concurrency", type=int, default=4, help="parallel clients")
+    parser.add_argument("--timeout", type=float, default=5.0)
+    parser.add_argument("--path", action="append", help="path to load (repeatable, default / and /status)")
+    parser.add_argument("--conditional", action="store_true", help="send If-None-Match with the last ETag")
+    parser.add_argument("--metrics", action="store_true", help="print /metrics when done")
+    args = parser.parse_args()
+
+    failed = 0
+    for path in args.path or ["/", "/status"]:
+        failed += run(args.host, args.port, path, args.requests, max(1, args.concurrency), args.timeout,
+                      args.conditional)
+
+    if args.metrics:
+        conn = http.client.HTTPConnection(args.host, args.port, timeout=args.timeout)
+        conn.request("GET", "/metrics")
+        print(conn.getresponse().read().decode())
+        conn.close()
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
@@ -0,0 +1,60 @@
+#include <unity.h>
+#include "action_queue.h"
+
+void setUp() {}
+void tearDown() {}
+
+static LedAction action(int64_t due, uint8_t level, uint8_t tag = 0) {
+  LedAction a = {due, 0, 1, level, tag};
+  return a;
+}
+
+void test_pops_in_due_order() {
+  ActionQueue<4> q;
+  TEST_ASSERT_NULL(q.soonest());
+  q.push(action(300, 3));
+  q.push(action(100, 1));
+  q.push(action(200, 2));
+  TEST_ASSERT_EQUAL_INT64(100, q.soonest()->due);
+  LedAction out;
+  TEST_ASSERT_FALSE(q.popDue(99, &out));
+  TEST_ASSERT_TRUE(q.popDue(250, &out));
+  TEST_ASSERT_EQUAL_UINT8(1, out.level);
+  TEST_ASSERT_TRUE(q.popDue(250, &out));
+  TEST_ASSERT_EQUAL_UINT8(2, out.level);
+  TEST_ASSERT_FALSE(q.popDue(250, &out));
+  TEST_ASSERT_EQUAL_UINT8(1, q.size());
+}
+
+void test_equal_due_keeps_push_order() {
+  ActionQueue<4> q;
+  q.push(action(100, 1));
+  q.push(action(100, 2));
+  q.push(action(50, 0));
+  q.push(action(100, 3));
+  LedAction out;
+  for (uint8_t level = 0; level < 4; ++level) {
+    TEST_ASSERT_TRUE(q.popDue(100, &out));
+    TEST_ASSERT_EQUAL_UINT8(level, out.level);
+  }
+}
+
+void test_full_and_remove_tag() {
+  ActionQueue<3> q;
+  TEST_ASSERT_TRUE(q.push(action(10, 1, 7)));
+  TEST_ASSERT_TRUE(q.push(action(20, 2, 0)));
+  TEST_ASSERT_TRUE(q.push(action(30, 3, 7)));
+  TEST_ASSERT_TRUE(q.full());
+  TEST_ASSERT_FALSE(q.push(action(5, 9)));
+  TEST_ASSERT_EQUAL_UINT8(2, q.removeTag(7));
+  TEST_ASSERT_EQUAL_UINT8(1, q.size());
+  TEST_ASSERT_EQUAL_UINT8(2, q.soonest()->level);
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_pops_in_due_order);
+  RUN_TEST(test_equal_due_keeps_push_order);
+  RUN_TEST(test_full_and_remove_tag);
+  return UNITY_END();
+}
@@ -0,0 +1,109 @@
+#include <unity.h>
+#include "alarm_blob.h"
+
+void setUp() {}
+void tearDown() {}
+
+static AlarmSet<8> sample() {
+  AlarmSet<8> set;
+  set.add(450);
+  set.add(5);
+  set.add(1439);
+  AlarmRule weekend = {600, 0, alarmWeekends, ALARM_SOUND_BEEPS, 10, 0x3, alarmLedsOn | 15};
+  set.add(weekend);
+  AlarmRule once = {1200, 20741, 0, ALARM_SOUND_NONE, 0, 0x1, 0}; // 2026-10-15
+  set.add(once);
+  return set;
+}
+
+void test_round_trip() {
+  uint8_t blob[alarmBlobSize(8)];
+  size_t len = encodeAlarmBlob(sample(), blob, sizeof(blob));
+  TEST_ASSERT_EQUAL_size_t(alarmBlobSize(5), len);
+  AlarmSet<8> in = sample(), out;
+  TEST_ASSERT_TRUE(decodeAlarmBlob(blob, len, &out));
+  TEST_ASSERT_EQUAL_UINT16(5, out.size());
+  for (uint16_t i = 0; i < out.size(); ++i) TEST_ASSERT_EQUAL_MEMORY(&in[i], &out[i], sizeof(AlarmRule));
+  TEST_ASSERT_EQUAL_UINT16(5, out[0].minute);
+  TEST_ASSERT_EQUAL_UINT16(1439, out[4].minute);
+}
+
+void test_decodes_v1_as_daily_alarms() {
+  uint8_t blob[10] = {1, 0, 2, 0, 0, 0, 0x05, 0x00, 0xC2, 0x01}; // 00:05, 07:30
+  uint16_t crc = crc16(blob + alarmBlobHeaderSize, 4);
+  blob[4] = crc & 0xFF;
+  blob[5] = crc >> 8;
+  AlarmSet<8> out;
+  TEST_ASSERT_TRUE(decodeAlarmBlob(blob, sizeof(blob), &out));
+  TEST_ASSERT_EQUAL_UINT16(2, out.size());
+  TEST_ASSERT_EQUAL_UINT16(450, out[1].minute);
+  TEST_ASSERT_EQUAL_UINT8(alarmDaily, out[1].days);
+  TEST_ASSERT_EQUAL_UINT8(ALARM_SOUND_TUNE, out[1].sound);
+}
+
+void test_empty_round_trip() {
+  uint8_t blob[alarmBlobSize(0)];
+  AlarmSet<8> empty, out;
+  out.add(1);
+  size_t len = encodeAlarmBlob(empty, blob, sizeof(blob));
+  TEST_ASSERT_TRUE(decodeAlarmBlob(blob, len, &out));
+  TEST_ASSERT_EQUAL_UINT16(0, out.size());
+}
+
+void test_encode_needs_room() {
+  uint8_t blob[alarmBlobSize(4)];
+  TEST_ASSERT_EQUAL_size_t(0, encodeAlarmBlob(sample(), blob, sizeof(blob)));
+}
+
+void test_rejects_corruption() {
+  uint8_t blob[alarmBlobSize(8)];
+  size_t len = encodeAlarmBlob(sample(), blob, sizeof(blob));
+  AlarmSet<8> out;
+  out.add(99);
+
+  uint8_t bad[sizeof(blob)];
+  memcpy(bad, blob, len); bad[0] = alarmBlobVersion + 1;
+  TEST_ASSERT_FALSE(decodeAlarmBlob(bad, len, &out));
+  memcpy(bad, blob, len); bad[len - 1] ^= 0x01; // payload bit flip
+  TEST_ASSERT_FALSE(decodeAlarmBlob(bad, len, &out));
+  TEST_ASSERT_FALSE(decodeAlarmBlob(blob, len - 1, &out)); // truncated
+  TEST_ASSERT_FALSE(decodeAlarmBlob(blob, 3, &out));
+
+  AlarmSet<2> small;
+  TEST_ASSERT_FALSE(decodeAlarmBlob(blob, len, &small)); // more than Capacity
+
+  memcpy(bad, blob, len); bad[alarmBlobHeaderSize + 4] = 0x80; // invalid weekday bits
+  uint16_t crc = crc16(bad + alarmBlobHeaderSize, len - alarmBlobHeaderSize);
+  bad[4] = crc & 0xFF; bad[5] = crc >> 8;
+  TEST_ASSERT_FALSE(decodeAlarmBlob(bad, len, &out));
+
+  TEST_ASSERT_EQUAL_UINT16(1, out.size()); // never half applied
+  TEST_ASSERT_EQUAL_UINT16(99, out[0].minute);
+}
+
+void test_rejects_unsorted_even_with_valid_crc() {
+  uint8_t blob[alarmBlobSize(2)] = {alarmBlobVersion, 0, 2, 0, 0, 0, 0x10, 0x00, 0, 0, alarmDaily, 1, 0, 0,
+                                    0x05, 0x00, 0, 0, alarmDaily, 1, 0, 0};
+  uint16_t crc = crc16(blob + alarmBlobHeaderSize, 2 * alarmBlobRuleSize);
+  blob[4] = crc & 0xFF;
+  blob[5] = crc >> 8;
+  AlarmSet<8> out;
+  TEST_ASSERT_FALSE(decodeAlarmBlob(blob, sizeof(blob), &out));
+}
+
+void test_crc16_check_value() {
+  const uint8_t check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+  TEST_ASSERT_EQUAL_HEX16(0x29B1, crc16(check, sizeof(check))); // CRC-16/CCITT-FALSE
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_decodes_v1_as_daily_alarms);
+  RUN_TEST(test_empty_round_trip);
+  RUN_TEST(test_encode_needs_room);
+  RUN_TEST(test_rejects_corruption);
+  RUN_TEST(test_rejects_unsorted_even_with_valid_crc);
+  RUN_TEST(test_crc16_check_value);
+  return UNITY_END();
+}
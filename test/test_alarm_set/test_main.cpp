@@ -0,0 +1,220 @@
+#include <unity.h>
+#include "alarm_set.h"
+
+void setUp() {}
+void tearDown() {}
+
+void test_parse_valid() {
+  uint16_t m = 0;
+  TEST_ASSERT_TRUE(parseHHMM("00:00", &m));
+  TEST_ASSERT_EQUAL_UINT16(0, m);
+  TEST_ASSERT_TRUE(parseHHMM("07:30", &m));
+  TEST_ASSERT_EQUAL_UINT16(450, m);
+  TEST_ASSERT_TRUE(parseHHMM("23:59", &m));
+  TEST_ASSERT_EQUAL_UINT16(1439, m);
+}
+
+void test_parse_rejects() {
+  const char* bad[] = {nullptr, "", "7:30", "07:3", "07-30", "24:00", "12:60", "07:30 ", "ab:cd", "07:300"};
+  uint16_t m = 1234;
+  for (const char* s : bad) TEST_ASSERT_FALSE_MESSAGE(parseHHMM(s, &m), s ? s : "null");
+  TEST_ASSERT_EQUAL_UINT16(1234, m); // untouched on failure
+}
+
+void test_format_round_trip() {
+  char out[6];
+  for (uint16_t m = 0; m < minutesPerDay; ++m) {
+    uint16_t back;
+    formatHHMM(m, out);
+    TEST_ASSERT_TRUE(parseHHMM(out, &back));
+    TEST_ASSERT_EQUAL_UINT16(m, back);
+  }
+}
+
+void test_add_keeps_sorted_and_unique() {
+  AlarmSet<8> set;
+  uint16_t in[] = {600, 60, 1200, 60, 5};
+  for (uint16_t m : in) set.add(m);
+  TEST_ASSERT_EQUAL_UINT16(4, set.size());
+  TEST_ASSERT_EQUAL_UINT16(5, set[0].minute);
+  TEST_ASSERT_EQUAL_UINT16(60, set[1].minute);
+  TEST_ASSERT_EQUAL_UINT16(600, set[2].minute);
+  TEST_ASSERT_EQUAL_UINT16(1200, set[3].minute);
+  TEST_ASSERT_FALSE(set.add(minutesPerDay));
+}
+
+void test_full_and_remove() {
+  AlarmSet<3> set;
+  TEST_ASSERT_TRUE(set.add(1));
+  TEST_ASSERT_TRUE(set.add(2));
+  TEST_ASSERT_TRUE(set.add(3));
+  TEST_ASSERT_TRUE(set.full());
+  TEST_ASSERT_FALSE(set.add(4));
+  TEST_ASSERT_TRUE(set.remove(2));
+  TEST_ASSERT_FALSE(set.remove(2));
+  TEST_ASSERT_FALSE(set.contains(2));
+  TEST_ASSERT_TRUE(set.contains(3));
+  TEST_ASSERT_EQUAL_UINT16(2, set.size());
+}
+
+// Minute number of a local date and time
+static int32_t at(int y, unsigned m, unsigned d, int hh, int mm) {
+  return daysFromCivil(y, m, d) * minutesPerDay + hh * 60 + mm;
+}
+
+void test_daily_rule_fires_next_minute_of_day() {
+  AlarmRule r = dailyAlarm(450);
+  TEST_ASSERT_EQUAL_INT32(at(2026, 10, 14, 7, 30), alarmNextFire(r, at(2026, 10, 14, 7, 29)));
+  TEST_ASSERT_EQUAL_INT32(at(2026, 10, 15, 7, 30), alarmNextFire(r, at(2026, 10, 14, 7, 30))); // strictly after
+  TEST_ASSERT_EQUAL_INT32(at(2027, 1, 1, 7, 30), alarmNextFire(r, at(2026, 12, 31, 23, 59)));
+}
+
+void test_weekday_rule_skips_other_days() {
+  AlarmRule r = dailyAlarm(420);
+  r.days = alarmWeekdays;
+  // 2026-10-16 is a Friday
+  TEST_ASSERT_EQUAL_INT32(at(2026, 10, 16, 7, 0), alarmNextFire(r, at(2026, 10, 16, 6, 0)));
+  TEST_ASSERT_EQUAL_INT32(at(2026, 10, 19, 7, 0), alarmNextFire(r, at(2026, 10, 16, 7, 0))); // Monday
+  r.days = 1 << 6; // Saturdays only
+  TEST_ASSERT_EQUAL_INT32(at(2026, 10, 24, 7, 0), alarmNextFire(r, at(2026, 10, 17, 7, 0)));
+}
+
+void test_one_shot_fires_once() {
+  AlarmRule r = dailyAlarm(1200);
+  r.days = 0;
+  r.date = daysFromCivil(2026, 10, 15);
+  TEST_ASSERT_EQUAL_INT32(at(2026, 10, 15, 20, 0), alarmNextFire(r, at(2026, 10, 1, 0, 0)));
+  TEST_ASSERT_EQUAL_INT32(-1, alarmNextFire(r, at(2026, 10, 15, 20, 0)));
+  r.date = 0;
+  TEST_ASSERT_FALSE(alarmRuleValid(r));
+}
+
+void test_next_fire_picks_soonest_rule() {
+  AlarmSet<4> set;
+  TEST_ASSERT_EQUAL_INT32(-1, set.nextFire(0));
+  AlarmRule weekend = dailyAlarm(540);
+  weekend.days = alarmWeekends;
+  set.add(weekend);
+  set.add(dailyAlarm(720));
+  int index = -1;
+  // Friday 13:00: Saturday 09:00 comes before Saturday noon
+  TEST_ASSERT_EQUAL_INT32(at(2026, 10, 17, 9, 0), set.nextFire(at(2026, 10, 16, 13, 0), &index));
+  TEST_ASSERT_EQUAL_INT(0, index);
+  TEST_ASSERT_EQUAL_INT32(at(2026, 10, 19, 12, 0), set.nextFire(at(2026, 10, 18, 12, 0), &index));
+  TEST_ASSERT_EQUAL_INT(1, index);
+}
+
+void test_put_replaces_and_remove_expired() {
+  AlarmSet<4> set;
+  set.add(dailyAlarm(60));
+  AlarmRule once = dailyAlarm(60);
+  once.days = 0;
+  once.date = daysFromCivil(2026, 10, 15);
+  TEST_ASSERT_FALSE(set.add(once)); // same minute
+  TEST_ASSERT_TRUE(set.put(once));
+  TEST_ASSERT_EQUAL_UINT16(1, set.size());
+  TEST_ASSERT_TRUE(set[0].oneShot());
+  set.add(dailyAlarm(90));
+  TEST_ASSERT_EQUAL_UINT16(0, set.removeExpired(at(2026, 10, 15, 0, 59)));
+  TEST_ASSERT_EQUAL_UINT16(1, set.removeExpired(at(2026, 10, 15, 1, 0)));
+  TEST_ASSERT_EQUAL_UINT16(1, set.size());
+  TEST_ASSERT_EQUAL_UINT16(90, set[0].minute);
+}
+
+void test_same_schedule() {
+  AlarmRule daily = dailyAlarm(450), louder = dailyAlarm(450);
+  louder.sound = ALARM_SOUND_BEEPS;
+  TEST_ASSERT_TRUE(alarmSameSchedule(daily, louder)); // an edit
+  AlarmRule weekdays = dailyAlarm(450);
+  weekdays.days = alarmWeekdays;
+  TEST_ASSERT_FALSE(alarmSameSchedule(daily, weekdays));
+  AlarmRule once = dailyAlarm(450), other = dailyAlarm(450);
+  once.days = other.days = 0;
+  once.date = daysFromCivil(2026, 12, 24);
+  other.date = once.date + 1;
+  TEST_ASSERT_FALSE(alarmSameSchedule(daily, once));
+  TEST_ASSERT_FALSE(alarmSameSchedule(once, other));
+  other.date = once.date;
+  TEST_ASSERT_TRUE(alarmSameSchedule(once, other));
+  TEST_ASSERT_FALSE(alarmSameSchedule(daily, dailyAlarm(451)));
+}
+
+// The control task, one wake at a time: arm, then re-arm from `now` like
+// scheduleAlarms() after an edit or a clock sample
+static void rearm(AlarmArming& a, const AlarmSet<8>& set, int32_t now) { a.armedAt = set.nextFire(a.searchFrom(now)); }
+
+void test_rearm_before_the_due_alarm_is_handled() {
+  AlarmSet<8> set;
+  set.add(450);
+  set.add(600);
+  int32_t day = daysFromCivil(2026, 10, 14) * minutesPerDay;
+  AlarmArming a;
+  rearm(a, set, day + 449);
+  TEST_ASSERT_EQUAL_INT32(day + 450, a.armedAt);
+  // The timer fires at 07:30, but an edit on the same wake re-arms first
+  rearm(a, set, day + 450);
+  TEST_ASSERT_EQUAL_INT32(day + 450, a.armedAt); // not stepped to 10:00
+  // ... and a fleet clock sample on the next wake, still before EVT_ALARM
+  rearm(a, set, day + 450);
+  TEST_ASSERT_TRUE(a.take(day + 450));
+  TEST_ASSERT_FALSE(a.take(day + 450)); // once
+  a.armedAt = set.nextFire(a.armedAt);
+  TEST_ASSERT_EQUAL_INT32(day + 600, a.armedAt);
+  // A stale event for 07:30 must not fire 10:00 early
+  TEST_ASSERT_FALSE(a.take(day + 450));
+  rearm(a, set, day + 450); // fired: re-arms on
+  TEST_ASSERT_EQUAL_INT32(day + 600, a.armedAt);
+  TEST_ASSERT_TRUE(a.take(day + 601)); // late is still due
+}
+
+void test_lead_in_window() {
+  AlarmSet<4> set;
+  set.add(dailyAlarm(420)); // no LEDs: no lead-in
+  TEST_ASSERT_EQUAL_INT32(-1, set.nextLeadIn(at(2026, 10, 14, 0, 0)));
+  AlarmRule sunrise = dailyAlarm(390);
+  sunrise.leds = 1;
+  sunrise.flags |= alarmLedsOn;
+  sunrise.lead = 10;
+  set.add(sunrise);
+  int index = -1;
+  TEST_ASSERT_EQUAL_INT32(at(2026, 10, 14, 6, 20), set.nextLeadIn(at(2026, 10, 14, 0, 0), &index));
+  TEST_ASSERT_EQUAL_UINT16(390, set[index].minute);
+  // Already inside the window: it started in the past
+  TEST_ASSERT_EQUAL_INT32(at(2026, 10, 14, 6, 20), set.nextLeadIn(at(2026, 10, 14, 6, 25)));
+  TEST_ASSERT_EQUAL_INT32(at(2026, 10, 15, 6, 20), set.nextLeadIn(at(2026, 10, 14, 6, 30)));
+}
+
+void test_weekday_names_round_trip() {
+  uint8_t days = 0;
+  char out[28];
+  TEST_ASSERT_TRUE(parseWeekdays("mon,wed,sat", &days));
+  TEST_ASSERT_EQUAL_HEX8(0x4A, days);
+  formatWeekdays(days, out);
+  TEST_ASSERT_EQUAL_STRING("mon,wed,sat", out);
+  TEST_ASSERT_TRUE(parseWeekdays("weekdays", &days));
+  formatWeekdays(days, out);
+  TEST_ASSERT_EQUAL_STRING("weekdays", out);
+  formatWeekdays(0x7F, out);
+  TEST_ASSERT_EQUAL_STRING("daily", out);
+  const char* bad[] = {nullptr, "", "mon,", "monday", "mon;tue", "xyz"};
+  for (const char* s : bad) TEST_ASSERT_FALSE_MESSAGE(parseWeekdays(s, &days), s ? s : "null");
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_parse_valid);
+  RUN_TEST(test_parse_rejects);
+  RUN_TEST(test_format_round_trip);
+  RUN_TEST(test_add_keeps_sorted_and_unique);
+  RUN_TEST(test_full_and_remove);
+  RUN_TEST(test_daily_rule_fires_next_minute_of_day);
+  RUN_TEST(test_weekday_rule_skips_other_days);
+  RUN_TEST(test_one_shot_fires_once);
+  RUN_TEST(test_next_fire_picks_soonest_rule);
+  RUN_TEST(test_put_replaces_and_remove_expired);
+  RUN_TEST(test_same_schedule);
+  RUN_TEST(test_rearm_before_the_due_alarm_is_handled);
+  RUN_TEST(test_lead_in_window);
+  RUN_TEST(test_weekday_names_round_trip);
+  return UNITY_END();
+}
@@ -0,0 +1,131 @@
+/*
+  Host microbenchmarks for the hot paths in lib/core. Each prints ns/op; the
+  asserts only keep the optimizer from dropping the work. For a profile:
+
+    pio test -e native -f test_bench_core
+    perf record -g .pio/build/native/program
+*/
+
+#include <unity.h>
+#include <stdio.h>
+#include <chrono>
+#include "alarm_blob.h"
+#include "json_writer.h"
+#include "spsc_queue.h"
+#include "timer_table.h"
+
+void setUp() {}
+void tearDown() {}
+
+static volatile uint32_t sink;
+
+template <typename F>
+static void bench(const char* name, uint32_t iterations, F body) {
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < iterations; ++i) body(i);
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+  printf("%-28s %10.1f ns/op\n", name, (double)ns / iterations);
+}
+
+static AlarmSet<64> fullSet() {
+  AlarmSet<64> set;
+  for (uint16_t i = 0; i < 64; ++i) {
+    AlarmRule r = dailyAlarm(i * 22);
+    r.days = i % 3 ? alarmWeekdays : 1 << (i % 7); // mixed schedules
+    set.add(r);
+  }
+  return set;
+}
+
+void test_bench_alarms() {
+  AlarmSet<64> set = fullSet();
+  const char* times[] = {"07:30", "23:59", "12:00", "bad!!"};
+  bench("parseHHMM", 1000000, [&](uint32_t i) {
+    uint16_t m = 0;
+    sink += parseHHMM(times[i & 3], &m) + m;
+  });
+  // Every rule is evaluated on each re-arm, so this is the whole scheduler
+  int32_t start = daysFromCivil(2026, 10, 14) * minutesPerDay;
+  bench("AlarmSet<64>::nextFire", 100000, [&](uint32_t i) { sink += set.nextFire(start + (int32_t)(i * 37 % 20160)); });
+  bench("AlarmSet<64> add+remove", 200000, [&](uint32_t i) {
+    AlarmSet<64> s = set;
+    s.remove((i % 64) * 22);
+    sink += s.add(1439);
+  });
+  TEST_ASSERT_EQUAL_UINT16(64, set.size());
+}
+
+void test_bench_alarm_blob() {
+  AlarmSet<64> set = fullSet(), out;
+  uint8_t blob[alarmBlobSize(64)];
+  size_t len = encodeAlarmBlob(set, blob, sizeof(blob));
+  bench("encodeAlarmBlob (64)", 100000, [&](uint32_t) { sink += encodeAlarmBlob(set, blob, sizeof(blob)); });
+  bench("decodeAlarmBlob (64)", 100000, [&](uint32_t) { sink += decodeAlarmBlob(blob, len, &out); });
+  TEST_ASSERT_EQUAL_UINT16(64, out.size());
+}
+
+// Same shape as the /status document
+void test_bench_status_json() {
+  AlarmSet<64> set = fullSet();
+  char buf[1024];
+  size_t len = 0;
+  bench("status JSON (64 alarms)", 100000, [&](uint32_t i) {
+    JsonWriter w(buf, sizeof(buf));
+    char hhmm[6];
+    w.beginObject();
+    w.boolean("timeSynced", true);
+    w.number("minute", i % minutesPerDay);
+    w.beginArray("alarms");
+    for (uint16_t a = 0; a < set.size(); ++a) {
+      formatHHMM(set[a].minute, hhmm);
+      w.string(nullptr, hhmm);
+    }
+    w.endArray();
+    w.beginObject("leds");
+    w.boolean("led1", i & 1);
+    w.boolean("led2", i & 2);
+    w.endObject();
+    w.endObject();
+    len = w.length();
+  });
+  TEST_ASSERT_TRUE(len > 0 && len < sizeof(buf));
+}
+
+void test_bench_timers() {
+  TimerTable<32> t;
+  uint32_t id = 0;
+  for (; id < 31; ++id) t.start(id, id * 1000, "t");
+  bench("TimerTable<32> start+pop", 1000000, [&](uint32_t i) {
+    TimerEntry e;
+    t.start(id++, (int64_t)i * 1000 + 31000, "t");
+    sink += t.popExpired((int64_t)i * 1000, &e);
+  });
+  bench("TimerTable<32> cancel+start", 1000000, [&](uint32_t) {
+    uint32_t victim = t.at(t.size() / 2).id;
+    t.cancel(victim);
+    sink += t.start(victim, t.soonest()->deadline + 500, "t");
+  });
+  TEST_ASSERT_EQUAL_UINT8(31, t.size());
+}
+
+void test_bench_spsc() {
+  SpscQueue<uint64_t, 16> q;
+  bench("SpscQueue push+pop", 10000000, [&](uint32_t i) {
+    uint64_t v = 0;
+    q.push(i);
+    q.pop(v);
+    sink += (uint32_t)v;
+  });
+  uint64_t v;
+  TEST_ASSERT_FALSE(q.pop(v));
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_bench_alarms);
+  RUN_TEST(test_bench_alarm_blob);
+  RUN_TEST(test_bench_status_json);
+  RUN_TEST(test_bench_timers);
+  RUN_TEST(test_bench_spsc);
+  return UNITY_END();
+}
@@ -0,0 +1,48 @@
+#include <unity.h>
+#include "calendar.h"
+
+void setUp() {}
+void tearDown() {}
+
+void test_known_days() {
+  TEST_ASSERT_EQUAL_INT32(0, daysFromCivil(1970, 1, 1));
+  TEST_ASSERT_EQUAL_INT32(20740, daysFromCivil(2026, 10, 14));
+  TEST_ASSERT_EQUAL_INT32(11016, daysFromCivil(2000, 2, 29));
+  TEST_ASSERT_EQUAL_INT32(-1, daysFromCivil(1969, 12, 31));
+}
+
+void test_round_trip_and_weekday() {
+  uint8_t expected = 4; // 1970-01-01 was a Thursday
+  for (int32_t z = 0; z < 200 * 366; ++z) {
+    int y;
+    unsigned m, d;
+    civilFromDays(z, &y, &m, &d);
+    TEST_ASSERT_EQUAL_INT32(z, daysFromCivil(y, m, d));
+    TEST_ASSERT_EQUAL_UINT8(expected, weekdayOfDay(z));
+    expected = (expected + 1) % daysPerWeek;
+  }
+  TEST_ASSERT_EQUAL_UINT8(3, weekdayOfDay(-1));
+  TEST_ASSERT_EQUAL_UINT8(4, weekdayOfDay(-7));
+}
+
+void test_parse_and_format() {
+  int32_t day = 0;
+  char out[11];
+  TEST_ASSERT_TRUE(parseDate("2026-10-14", &day));
+  TEST_ASSERT_EQUAL_INT32(20740, day);
+  formatDate(day, out);
+  TEST_ASSERT_EQUAL_STRING("2026-10-14", out);
+  TEST_ASSERT_TRUE(parseDate("2028-02-29", &day));
+  const char* bad[] = {nullptr, "", "2026-02-29", "2026-13-01", "2026-00-10", "2026-1-01", "2026/10/14", "2026-10-14 "};
+  day = 7;
+  for (const char* s : bad) TEST_ASSERT_FALSE_MESSAGE(parseDate(s, &day), s ? s : "null");
+  TEST_ASSERT_EQUAL_INT32(7, day);
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_known_days);
+  RUN_TEST(test_round_trip_and_weekday);
+  RUN_TEST(test_parse_and_format);
+  return UNITY_END();
+}
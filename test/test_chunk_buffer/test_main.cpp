@@ -0,0 +1,89 @@
+#include <unity.h>
+#include <string>
+#include "chunk_buffer.h"
+
+struct Collector {
+  std::string data;
+  size_t calls = 0;
+  size_t empty = 0;
+  size_t failAfter = SIZE_MAX; // calls that succeed
+};
+
+static bool collect(void* ctx, const char* data, size_t len) {
+  Collector* c = (Collector*)ctx;
+  if (len == 0) c->empty++;
+  if (c->calls++ >= c->failAfter) return false;
+  c->data.append(data, len);
+  return true;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_bounded_without_sink() {
+  char buf[8];
+  ChunkBuffer b(buf, sizeof(buf));
+  b.append("abc", 3);
+  b.appendf("%d", 1234);
+  TEST_ASSERT_FALSE(b.overflowed());
+  TEST_ASSERT_EQUAL_STRING("abc1234", buf);
+  b.append("x", 1); // needs a ninth byte for the NUL
+  TEST_ASSERT_TRUE(b.overflowed());
+  TEST_ASSERT_EQUAL_STRING("abc1234", buf);
+  TEST_ASSERT_TRUE(b.flush() == false);
+}
+
+void test_streams_through_small_buffer() {
+  char buf[8];
+  Collector c;
+  ChunkBuffer b(buf, sizeof(buf), collect, &c);
+  std::string expected;
+  for (int i = 0; i < 50; ++i) {
+    b.append("ab", 2);
+    b.appendf("[%d]", i);
+    expected += "ab[" + std::to_string(i) + "]";
+  }
+  b.append("0123456789abcdefghij", 20); // longer than the buffer
+  expected += "0123456789abcdefghij";
+  TEST_ASSERT_TRUE(b.flush());
+  TEST_ASSERT_FALSE(b.overflowed());
+  TEST_ASSERT_EQUAL_STRING(expected.c_str(), c.data.c_str());
+  TEST_ASSERT_EQUAL_size_t(expected.size(), b.total());
+  TEST_ASSERT_EQUAL_size_t(0, b.length());
+  size_t calls = c.calls;
+  TEST_ASSERT_TRUE(b.flush()); // nothing staged: no empty chunk
+  TEST_ASSERT_EQUAL_size_t(calls, c.calls);
+  TEST_ASSERT_EQUAL_size_t(0, c.empty);
+}
+
+void test_formatted_longer_than_buffer_overflows() {
+  char buf[8];
+  Collector c;
+  ChunkBuffer b(buf, sizeof(buf), collect, &c);
+  b.append("ab", 2);
+  b.appendf("%s", "does not fit at all");
+  TEST_ASSERT_TRUE(b.overflowed());
+  TEST_ASSERT_EQUAL_STRING("ab", c.data.c_str()); // flushed before the retry
+}
+
+void test_sink_failure_drops_the_rest() {
+  char buf[4];
+  Collector c;
+  c.failAfter = 1;
+  ChunkBuffer b(buf, sizeof(buf), collect, &c);
+  b.append("abcdefghij", 10);
+  TEST_ASSERT_TRUE(b.overflowed());
+  TEST_ASSERT_EQUAL_STRING("abc", c.data.c_str());
+  b.append("x", 1);
+  TEST_ASSERT_FALSE(b.flush());
+  TEST_ASSERT_EQUAL_size_t(2, c.calls);
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_bounded_without_sink);
+  RUN_TEST(test_streams_through_small_buffer);
+  RUN_TEST(test_formatted_longer_than_buffer_overflows);
+  RUN_TEST(test_sink_failure_drops_the_rest);
+  return UNITY_END();
+}
@@ -0,0 +1,123 @@
+#include <unity.h>
+#include "fleet_frame.h"
+
+void setUp() {}
+void tearDown() {}
+
+static size_t finish(uint8_t* buf, size_t n) {
+  memset(buf + n, 0xA5, fleetMacSize); // the MAC is not checked here
+  return n + fleetMacSize;
+}
+
+void test_beacon_round_trip() {
+  FleetFrame f = {FLEET_BEACON, 518, 0xBEEF, 0, 1700000000123456LL, 42, 1700000000000001LL, nullptr, 0};
+  uint8_t buf[fleetFrameMaxSize];
+  size_t n = encodeFleetFrame(f, buf);
+  TEST_ASSERT_EQUAL_UINT32(fleetFrameHeaderSize + fleetBeaconBodySize, n);
+  const uint8_t expected[] = {0x46, FLEET_BEACON, 0x06, 0x02, 0xEF, 0xBE, 0, 0};
+  TEST_ASSERT_EQUAL_MEMORY(expected, buf, sizeof(expected));
+  FleetFrame back;
+  TEST_ASSERT_TRUE(decodeFleetFrame(buf, finish(buf, n), &back));
+  TEST_ASSERT_EQUAL_UINT8(FLEET_BEACON, back.type);
+  TEST_ASSERT_EQUAL_UINT16(518, back.tableLen);
+  TEST_ASSERT_EQUAL_HEX16(0xBEEF, back.tableCrc);
+  TEST_ASSERT_TRUE(back.sentAtUs == f.sentAtUs);
+  TEST_ASSERT_EQUAL_UINT32(42, back.seq);
+  TEST_ASSERT_TRUE(back.prevTxUs == f.prevTxUs);
+}
+
+void test_rejects_bad_frames() {
+  FleetFrame f = {FLEET_BEACON, 6, 0, 0, 1, 1, 0, nullptr, 0};
+  uint8_t buf[fleetFrameMaxSize + 1];
+  size_t n = finish(buf, encodeFleetFrame(f, buf));
+  FleetFrame back;
+  TEST_ASSERT_FALSE(decodeFleetFrame(buf, n - 1, &back));
+  TEST_ASSERT_FALSE(decodeFleetFrame(buf, n + 1, &back));
+  buf[0] ^= 1;
+  TEST_ASSERT_FALSE(decodeFleetFrame(buf, n, &back));
+  buf[0] ^= 1;
+  buf[1] = 9; // unknown type
+  TEST_ASSERT_FALSE(decodeFleetFrame(buf, n, &back));
+}
+
+void test_fragment_bounds() {
+  uint8_t data[fleetFragmentSize] = {};
+  uint8_t buf[fleetFrameMaxSize];
+  FleetFrame back;
+  // Last fragment of a 250-byte table: 50 bytes at 200
+  FleetFrame f = {FLEET_TABLE, 250, 0, 200, 1, 0, 0, data, 50};
+  TEST_ASSERT_TRUE(decodeFleetFrame(buf, finish(buf, encodeFleetFrame(f, buf)), &back));
+  TEST_ASSERT_EQUAL_UINT8(50, back.dataLen);
+  f.dataLen = 40; // short, but not the last
+  TEST_ASSERT_FALSE(decodeFleetFrame(buf, finish(buf, encodeFleetFrame(f, buf)), &back));
+  f.offset = 100; f.dataLen = 50; // not on a fragment boundary
+  TEST_ASSERT_FALSE(decodeFleetFrame(buf, finish(buf, encodeFleetFrame(f, buf)), &back));
+  f.offset = 400; // past the end
+  TEST_ASSERT_FALSE(decodeFleetFrame(buf, finish(buf, encodeFleetFrame(f, buf)), &back));
+  f.dataLen = fleetFragmentSize + 1;
+  TEST_ASSERT_EQUAL_UINT32(0, encodeFleetFrame(f, buf));
+}
+
+static size_t makeTable(uint8_t* table, uint16_t count) {
+  AlarmSet<64> alarms;
+  for (uint16_t i = 0; i < count; ++i) alarms.add(i * 20);
+  return encodeAlarmBlob(alarms, table, fleetMaxTableSize);
+}
+
+static FleetFrame fragment(const uint8_t* table, size_t len, uint16_t offset) {
+  size_t n = len - offset < fleetFragmentSize ? len - offset : fleetFragmentSize;
+  FleetFrame f = {FLEET_TABLE, (uint16_t)len, crc16(table, len), offset, 1, 0, 0, table + offset, (uint8_t)n};
+  return f;
+}
+
+void test_assembles_in_any_order() {
+  uint8_t table[fleetMaxTableSize];
+  size_t len = makeTable(table, 64); // 518 bytes, 3 fragments
+  static FleetAssembler a;
+  TEST_ASSERT_FALSE(a.add(fragment(table, len, 400)));
+  TEST_ASSERT_FALSE(a.add(fragment(table, len, 0)));
+  TEST_ASSERT_FALSE(a.add(fragment(table, len, 0))); // duplicate
+  TEST_ASSERT_TRUE(a.add(fragment(table, len, 200)));
+  TEST_ASSERT_EQUAL_UINT32(len, a.size());
+  TEST_ASSERT_EQUAL_MEMORY(table, a.data(), len);
+  AlarmSet<64> decoded;
+  TEST_ASSERT_TRUE(decodeAlarmBlob(a.data(), a.size(), &decoded));
+  TEST_ASSERT_EQUAL_UINT16(64, decoded.size());
+  TEST_ASSERT_FALSE(a.add(fragment(table, len, 0))); // reported once
+}
+
+void test_new_table_starts_over() {
+  uint8_t first[fleetMaxTableSize], second[fleetMaxTableSize];
+  size_t len1 = makeTable(first, 30), len2 = makeTable(second, 40);
+  static FleetAssembler a;
+  TEST_ASSERT_FALSE(a.add(fragment(first, len1, 0)));
+  TEST_ASSERT_FALSE(a.add(fragment(second, len2, 200))); // the master changed it meanwhile
+  TEST_ASSERT_TRUE(a.add(fragment(second, len2, 0)));
+  TEST_ASSERT_EQUAL_MEMORY(second, a.data(), len2);
+}
+
+void test_time_pairing() {
+  FleetTimePairing p;
+  int64_t epoch = 0, at = 0;
+  FleetFrame b = {FLEET_BEACON, 6, 0, 0, 0, 7, 123, nullptr, 0};
+  TEST_ASSERT_FALSE(p.add(b, 1000, &epoch, &at)); // nothing to pair with yet
+  b.seq = 8; b.prevTxUs = 5000;
+  TEST_ASSERT_TRUE(p.add(b, 2000, &epoch, &at));
+  TEST_ASSERT_TRUE(epoch == 5000);
+  TEST_ASSERT_TRUE(at == 1000); // when seq 7 arrived
+  b.seq = 10; // 9 was lost: its stamp has no match
+  TEST_ASSERT_FALSE(p.add(b, 4000, &epoch, &at));
+  b.seq = 11; b.prevTxUs = 0; // the master missed the send callback
+  TEST_ASSERT_FALSE(p.add(b, 5000, &epoch, &at));
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_beacon_round_trip);
+  RUN_TEST(test_rejects_bad_frames);
+  RUN_TEST(test_fragment_bounds);
+  RUN_TEST(test_assembles_in_any_order);
+  RUN_TEST(test_new_table_starts_over);
+  RUN_TEST(test_time_pairing);
+  return UNITY_END();
+}
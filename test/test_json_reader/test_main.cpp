@@ -0,0 +1,83 @@
+#include <unity.h>
+#include <string>
+#include "json_reader.h"
+
+void setUp() {}
+void tearDown() {}
+
+void test_objects_and_literals() {
+  std::string s = "[ {\"op\":\"led\", \"ch\": \"led1\",\"on\":true} ,{\"op\":\"timer\",\"ms\":-1500}, {} ]";
+  JsonArrayReader r(&s[0], s.size());
+  TEST_ASSERT_TRUE(r.next());
+  TEST_ASSERT_EQUAL_UINT8(3, r.size());
+  TEST_ASSERT_EQUAL_STRING("led", r.find("op"));
+  TEST_ASSERT_EQUAL_STRING("led1", r.find("ch"));
+  TEST_ASSERT_EQUAL_STRING("true", r.find("on"));
+  TEST_ASSERT_NULL(r.find("ms"));
+  TEST_ASSERT_TRUE(r.next());
+  TEST_ASSERT_EQUAL_STRING("timer", r.value(0));
+  TEST_ASSERT_EQUAL_STRING("ms", r.key(1));
+  TEST_ASSERT_EQUAL_STRING("-1500", r.find("ms"));
+  TEST_ASSERT_TRUE(r.next());
+  TEST_ASSERT_EQUAL_UINT8(0, r.size());
+  TEST_ASSERT_FALSE(r.next());
+  TEST_ASSERT_FALSE(r.failed());
+}
+
+void test_escapes_decoded_in_place() {
+  std::string s = "[{\"label\":\"tea \\\"green\\\"\\n\\u00e9\\u20ac\\/\"}]";
+  JsonArrayReader r(&s[0], s.size());
+  TEST_ASSERT_TRUE(r.next());
+  TEST_ASSERT_EQUAL_STRING("tea \"green\"\n\xC3\xA9\xE2\x82\xAC/", r.find("label"));
+  TEST_ASSERT_FALSE(r.next());
+  TEST_ASSERT_FALSE(r.failed());
+}
+
+void test_empty_array() {
+  std::string s = " [ ] ";
+  JsonArrayReader r(&s[0], s.size());
+  TEST_ASSERT_FALSE(r.next());
+  TEST_ASSERT_FALSE(r.failed());
+}
+
+// Not NUL terminated: nothing may be read past len
+void test_truncated_input() {
+  const char* cases[] = {"[{\"op\":\"led\"", "[{\"op\":\"le", "[{\"op\":", "[{\"op\":1", "[{\"a\":1},", "[", ""};
+  for (const char* c : cases) {
+    std::string s(c);
+    JsonArrayReader r(&s[0], s.size());
+    while (r.next()) {}
+    TEST_ASSERT_TRUE_MESSAGE(r.failed(), c);
+  }
+}
+
+void test_malformed_input() {
+  const char* cases[] = {"{\"op\":1}", "[{\"op\":{\"x\":1}}]", "[{\"op\":[1]}]", "[{op:1}]", "[{\"op\" 1}]", "[{\"op\":1;}]",
+                         "[{\"op\":\"\\q\"}]", "[{\"op\":\"\\u12\"}]", "[{\"op\":\"\\ud800\"}]", "[1]", "[{\"a\":1} {\"b\":2}]"};
+  for (const char* c : cases) {
+    std::string s(c);
+    JsonArrayReader r(&s[0], s.size());
+    while (r.next()) {}
+    TEST_ASSERT_TRUE_MESSAGE(r.failed(), c);
+  }
+}
+
+void test_too_many_fields() {
+  std::string s = "[{";
+  for (int i = 0; i <= jsonReaderMaxFields; ++i) s += (i ? ",\"k" : "\"k") + std::to_string(i) + "\":1";
+  s += "}]";
+  JsonArrayReader r(&s[0], s.size());
+  TEST_ASSERT_FALSE(r.next());
+  TEST_ASSERT_EQUAL_STRING("Too many fields", r.error());
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_objects_and_literals);
+  RUN_TEST(test_escapes_decoded_in_place);
+  RUN_TEST(test_empty_array);
+  RUN_TEST(test_truncated_input);
+  RUN_TEST(test_malformed_input);
+  RUN_TEST(test_too_many_fields);
+  return UNITY_END();
+}
@@ -0,0 +1,102 @@
+#include <unity.h>
+#include <string>
+#include "json_writer.h"
+
+void setUp() {}
+void tearDown() {}
+
+void test_nested_document() {
+  char buf[128];
+  JsonWriter w(buf, sizeof(buf));
+  w.beginObject();
+  w.boolean("ok", true);
+  w.number("n", -42);
+  w.beginArray("a");
+  w.string(nullptr, "07:30");
+  w.number(nullptr, 1);
+  w.beginObject(nullptr);
+  w.endObject();
+  w.endArray();
+  w.beginObject("o");
+  w.boolean("f", false);
+  w.endObject();
+  w.endObject();
+  TEST_ASSERT_FALSE(w.overflowed());
+  TEST_ASSERT_EQUAL_STRING("{\"ok\":true,\"n\":-42,\"a\":[\"07:30\",1,{}],\"o\":{\"f\":false}}", w.c_str());
+  TEST_ASSERT_EQUAL_size_t(strlen(buf), w.length());
+}
+
+void test_string_escaping() {
+  char buf[64];
+  JsonWriter w(buf, sizeof(buf));
+  w.string(nullptr, "a\"b\\c\n\x01");
+  TEST_ASSERT_EQUAL_STRING("\"a\\\"b\\\\c\\u000a\\u0001\"", w.c_str());
+}
+
+void test_int64_range() {
+  char buf[64];
+  JsonWriter w(buf, sizeof(buf));
+  w.beginArray();
+  w.number(nullptr, INT64_MAX);
+  w.number(nullptr, INT64_MIN);
+  w.endArray();
+  TEST_ASSERT_EQUAL_STRING("[9223372036854775807,-9223372036854775808]", w.c_str());
+}
+
+void test_overflow_is_sticky_and_terminated() {
+  char buf[16];
+  JsonWriter w(buf, sizeof(buf));
+  w.beginObject();
+  w.string("key", "a value that does not fit");
+  w.number("n", 1); // dropped
+  w.endObject();
+  TEST_ASSERT_TRUE(w.overflowed());
+  TEST_ASSERT_TRUE(w.length() < sizeof(buf));
+  TEST_ASSERT_EQUAL_size_t(strlen(buf), w.length());
+}
+
+void test_exact_fit() {
+  char buf[3]; // "{}" + NUL
+  JsonWriter w(buf, sizeof(buf));
+  w.beginObject();
+  w.endObject();
+  TEST_ASSERT_FALSE(w.overflowed());
+  TEST_ASSERT_EQUAL_STRING("{}", buf);
+}
+
+static bool collect(void* ctx, const char* data, size_t len) {
+  ((std::string*)ctx)->append(data, len);
+  return true;
+}
+
+void test_streamed_document_matches_buffered() {
+  char big[512], small[16];
+  std::string streamed;
+  JsonWriter a(big, sizeof(big));
+  JsonWriter b(small, sizeof(small), collect, &streamed);
+  JsonWriter* both[2] = {&a, &b};
+  for (JsonWriter* w : both) {
+    w->beginObject();
+    w->beginArray("alarms");
+    for (int i = 0; i < 20; ++i) w->string(nullptr, "07:30");
+    w->endArray();
+    w->string("label", "tea \"kettle\"");
+    w->endObject();
+    w->flush();
+  }
+  TEST_ASSERT_FALSE(a.overflowed());
+  TEST_ASSERT_FALSE(b.overflowed());
+  TEST_ASSERT_EQUAL_STRING(a.c_str(), streamed.c_str());
+  TEST_ASSERT_EQUAL_size_t(a.total(), b.total());
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_nested_document);
+  RUN_TEST(test_string_escaping);
+  RUN_TEST(test_int64_range);
+  RUN_TEST(test_overflow_is_sticky_and_terminated);
+  RUN_TEST(test_exact_fit);
+  RUN_TEST(test_streamed_document_matches_buffered);
+  return UNITY_END();
+}
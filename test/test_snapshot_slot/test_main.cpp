@@ -0,0 +1,112 @@
+#include <unity.h>
+#include "snapshot_slot.h"
+
+void setUp() {}
+void tearDown() {}
+
+static const size_t capacity = 32;
+static uint8_t slot[snapshotSlotSize(capacity)];
+
+static void fill(uint8_t* p, size_t n, uint8_t seed) {
+  for (size_t i = 0; i < n; ++i) p[i] = (uint8_t)(seed + i);
+}
+
+void test_empty_slot_reads_nothing() {
+  snapshotClear(slot, capacity);
+  uint8_t out[capacity];
+  TEST_ASSERT_EQUAL_size_t(0, snapshotRead(slot, capacity, out, sizeof(out), nullptr));
+}
+
+void test_round_trip() {
+  snapshotClear(slot, capacity);
+  uint8_t data[20], out[capacity];
+  fill(data, sizeof(data), 7);
+  TEST_ASSERT_TRUE(snapshotWrite(slot, capacity, data, sizeof(data), 123456789012LL));
+  int64_t savedAt = 0;
+  TEST_ASSERT_EQUAL_size_t(sizeof(data), snapshotRead(slot, capacity, out, sizeof(out), &savedAt));
+  TEST_ASSERT_EQUAL_MEMORY(data, out, sizeof(data));
+  TEST_ASSERT_TRUE(savedAt == 123456789012LL);
+}
+
+void test_newest_write_wins_and_copies_alternate() {
+  snapshotClear(slot, capacity);
+  uint8_t data[8], out[capacity];
+  SnapshotHeader h;
+  for (uint8_t i = 0; i < 5; ++i) {
+    fill(data, sizeof(data), i * 16);
+    TEST_ASSERT_TRUE(snapshotWrite(slot, capacity, data, sizeof(data), i));
+    TEST_ASSERT_EQUAL_INT(i % 2, snapshotNewest(slot, capacity, &h));
+  }
+  int64_t savedAt;
+  TEST_ASSERT_EQUAL_size_t(sizeof(data), snapshotRead(slot, capacity, out, sizeof(out), &savedAt));
+  TEST_ASSERT_EQUAL_MEMORY(data, out, sizeof(data));
+  TEST_ASSERT_TRUE(savedAt == 4);
+}
+
+void test_torn_write_keeps_previous_record() {
+  snapshotClear(slot, capacity);
+  uint8_t first[8], second[8], out[capacity];
+  fill(first, sizeof(first), 1);
+  fill(second, sizeof(second), 100);
+  snapshotWrite(slot, capacity, first, sizeof(first), 1);
+  snapshotWrite(slot, capacity, second, sizeof(second), 2);
+  // Reset partway through the second write: its data is half there
+  slot[sizeof(SnapshotHeader) + capacity + sizeof(SnapshotHeader) + 5] ^= 0xFF;
+  TEST_ASSERT_EQUAL_size_t(sizeof(first), snapshotRead(slot, capacity, out, sizeof(out), nullptr));
+  TEST_ASSERT_EQUAL_MEMORY(first, out, sizeof(first));
+  // The next write replaces the broken copy, not the good one
+  snapshotWrite(slot, capacity, second, sizeof(second), 3);
+  TEST_ASSERT_EQUAL_size_t(sizeof(second), snapshotRead(slot, capacity, out, sizeof(out), nullptr));
+  TEST_ASSERT_EQUAL_MEMORY(second, out, sizeof(second));
+}
+
+void test_rejects_garbage_and_other_layouts() {
+  for (size_t i = 0; i < sizeof(slot); ++i) slot[i] = (uint8_t)(i * 37 + 11); // power-on content
+  uint8_t out[capacity];
+  TEST_ASSERT_EQUAL_size_t(0, snapshotRead(slot, capacity, out, sizeof(out), nullptr));
+
+  snapshotClear(slot, capacity);
+  uint8_t data[8];
+  fill(data, sizeof(data), 3);
+  snapshotWrite(slot, capacity, data, sizeof(data), 0);
+  // Firmware with a smaller slot here reads the same bytes differently
+  TEST_ASSERT_EQUAL_size_t(0, snapshotRead(slot, 16, out, sizeof(out), nullptr));
+  // A record larger than the caller's buffer is not returned
+  TEST_ASSERT_EQUAL_size_t(0, snapshotRead(slot, capacity, out, 4, nullptr));
+}
+
+void test_write_needs_room() {
+  snapshotClear(slot, capacity);
+  uint8_t data[capacity + 1] = {};
+  TEST_ASSERT_FALSE(snapshotWrite(slot, capacity, data, sizeof(data), 0));
+  TEST_ASSERT_TRUE(snapshotWrite(slot, capacity, data, capacity, 0));
+}
+
+void test_sequence_wraps() {
+  snapshotClear(slot, capacity);
+  uint8_t a[4] = {1, 2, 3, 4}, b[4] = {5, 6, 7, 8}, out[capacity];
+  snapshotWrite(slot, capacity, a, sizeof(a), 0);
+  // Pretend copy 0 was written 2^32 - 1 times
+  SnapshotHeader h;
+  memcpy(&h, slot, sizeof(h));
+  h.seq = 0xFFFFFFFF;
+  h.crc = snapshotCrc(h, slot + sizeof(h));
+  memcpy(slot, &h, sizeof(h));
+  snapshotWrite(slot, capacity, b, sizeof(b), 0); // seq 0 in copy 1
+  TEST_ASSERT_EQUAL_INT(1, snapshotNewest(slot, capacity, &h));
+  TEST_ASSERT_EQUAL_UINT32(0, h.seq);
+  snapshotRead(slot, capacity, out, sizeof(out), nullptr);
+  TEST_ASSERT_EQUAL_MEMORY(b, out, sizeof(b));
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_empty_slot_reads_nothing);
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_newest_write_wins_and_copies_alternate);
+  RUN_TEST(test_torn_write_keeps_previous_record);
+  RUN_TEST(test_rejects_garbage_and_other_layouts);
+  RUN_TEST(test_write_needs_room);
+  RUN_TEST(test_sequence_wraps);
+  return UNITY_END();
+}
@@ -0,0 +1,107 @@
+#include <unity.h>
+#include <thread>
+#include "spsc_queue.h"
+
+void setUp() {}
+void tearDown() {}
+
+void test_fifo_full_empty() {
+  SpscQueue<int, 4> q;
+  int v;
+  TEST_ASSERT_FALSE(q.pop(v));
+  for (int i = 0; i < 4; ++i) TEST_ASSERT_TRUE(q.push(i));
+  TEST_ASSERT_FALSE(q.push(99));
+  for (int i = 0; i < 4; ++i) {
+    TEST_ASSERT_TRUE(q.pop(v));
+    TEST_ASSERT_EQUAL_INT(i, v);
+  }
+  TEST_ASSERT_FALSE(q.pop(v));
+}
+
+void test_wraps_many_times() {
+  SpscQueue<uint32_t, 8> q;
+  uint32_t v;
+  for (uint32_t i = 0; i < 1000; ++i) {
+    TEST_ASSERT_TRUE(q.push(i));
+    TEST_ASSERT_TRUE(q.pop(v));
+    TEST_ASSERT_EQUAL_UINT32(i, v);
+  }
+}
+
+void test_push_all_or_nothing() {
+  SpscQueue<int, 8> q;
+  int batch[] = {1, 2, 3, 4, 5, 6};
+  int v;
+  TEST_ASSERT_TRUE(q.push(0));
+  TEST_ASSERT_TRUE(q.pushAll(batch, 6));
+  TEST_ASSERT_EQUAL_UINT32(1, q.space());
+  TEST_ASSERT_FALSE(q.pushAll(batch, 2));
+  TEST_ASSERT_TRUE(q.pushAll(batch, 1));
+  for (int i = 0; i < 7; ++i) {
+    TEST_ASSERT_TRUE(q.pop(v));
+    TEST_ASSERT_EQUAL_INT(i, v);
+  }
+  TEST_ASSERT_TRUE(q.pop(v));
+  TEST_ASSERT_EQUAL_INT(1, v);
+  TEST_ASSERT_FALSE(q.pop(v));
+  TEST_ASSERT_TRUE(q.pushAll(batch, 0));
+  TEST_ASSERT_FALSE(q.pop(v));
+}
+
+// Batches pushed whole are popped whole: the consumer never sees a partial
+// one, however the two threads interleave
+void test_push_all_two_threads() {
+  static SpscQueue<uint32_t, 16> q;
+  const uint32_t batches = 20000, n = 5;
+  std::thread producer([&] {
+    for (uint32_t b = 0; b < batches;) {
+      uint32_t batch[n];
+      for (uint32_t i = 0; i < n; ++i) batch[i] = b * n + i;
+      if (q.pushAll(batch, n)) ++b;
+      else std::this_thread::yield();
+    }
+  });
+  uint32_t expected = 0, v;
+  bool torn = false;
+  while (expected < batches * n && !torn) {
+    if (!q.pop(v)) { std::this_thread::yield(); continue; }
+    if (v != expected++) break;
+    // The rest of this batch must already be there
+    for (uint32_t i = v % n + 1; i < n; ++i) {
+      if (!q.pop(v) || v != expected++) { torn = true; break; }
+    }
+  }
+  producer.join();
+  TEST_ASSERT_FALSE(torn);
+  TEST_ASSERT_EQUAL_UINT32(batches * n, expected);
+}
+
+// One producer thread, one consumer thread: every item arrives once, in order
+void test_two_threads() {
+  static SpscQueue<uint32_t, 16> q;
+  const uint32_t n = 100000;
+  std::thread producer([&] {
+    for (uint32_t i = 0; i < n;) {
+      if (q.push(i)) ++i;
+      else std::this_thread::yield();
+    }
+  });
+  uint32_t expected = 0, v;
+  while (expected < n) {
+    if (!q.pop(v)) { std::this_thread::yield(); continue; }
+    if (v != expected) break;
+    ++expected;
+  }
+  producer.join();
+  TEST_ASSERT_EQUAL_UINT32(n, expected);
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_fifo_full_empty);
+  RUN_TEST(test_wraps_many_times);
+  RUN_TEST(test_push_all_or_nothing);
+  RUN_TEST(test_two_threads);
+  RUN_TEST(test_push_all_two_threads);
+  return UNITY_END();
+}
@@ -0,0 +1,102 @@
+#include <unity.h>
+#include <stdlib.h>
+#include <map>
+#include "timer_table.h"
+
+void setUp() {}
+void tearDown() {}
+
+void test_soonest_and_pop_order() {
+  TimerTable<8> t;
+  TEST_ASSERT_NULL(t.soonest());
+  t.start(1, 300, "c");
+  t.start(2, 100, "a");
+  t.start(3, 200, "b");
+  TEST_ASSERT_EQUAL_UINT32(2, t.soonest()->id);
+  TimerEntry e;
+  TEST_ASSERT_FALSE(t.popExpired(99, &e));
+  TEST_ASSERT_TRUE(t.popExpired(250, &e));
+  TEST_ASSERT_EQUAL_STRING("a", e.label);
+  TEST_ASSERT_TRUE(t.popExpired(250, &e));
+  TEST_ASSERT_EQUAL_STRING("b", e.label);
+  TEST_ASSERT_FALSE(t.popExpired(250, &e));
+  TEST_ASSERT_EQUAL_UINT8(1, t.size());
+}
+
+void test_cancel_and_full() {
+  TimerTable<2> t;
+  TEST_ASSERT_TRUE(t.start(1, 10, nullptr));
+  TEST_ASSERT_TRUE(t.start(2, 20, "x"));
+  TEST_ASSERT_FALSE(t.start(3, 30, "y"));
+  TEST_ASSERT_TRUE(t.cancel(1));
+  TEST_ASSERT_FALSE(t.cancel(1));
+  TEST_ASSERT_EQUAL_UINT32(2, t.soonest()->id);
+  TEST_ASSERT_TRUE(t.start(3, 5, "y"));
+  TEST_ASSERT_EQUAL_UINT32(3, t.soonest()->id);
+  t.clear();
+  TEST_ASSERT_EQUAL_UINT8(0, t.size());
+}
+
+void test_label_truncated() {
+  TimerTable<1> t;
+  t.start(1, 0, "a label that is far too long");
+  TEST_ASSERT_EQUAL_size_t(timerLabelSize - 1, strlen(t.soonest()->label));
+}
+
+void test_action_carried_along() {
+  TimerTable<2> t;
+  t.start(1, 10, "plain");
+  t.start(2, 5, "lights", 0x1ff);
+  TimerEntry e;
+  TEST_ASSERT_TRUE(t.popExpired(10, &e));
+  TEST_ASSERT_EQUAL_UINT16(0x1ff, e.action);
+  TEST_ASSERT_TRUE(t.popExpired(10, &e));
+  TEST_ASSERT_EQUAL_UINT16(0, e.action);
+}
+
+// Random start/cancel/pop against std::multimap as a reference
+void test_matches_reference() {
+  TimerTable<32> t;
+  std::multimap<int64_t, uint32_t> ref;
+  srand(1);
+  uint32_t nextId = 1;
+  for (int step = 0; step < 20000; ++step) {
+    int op = rand() % 3;
+    if (op == 0 && !t.full()) {
+      int64_t d = rand() % 1000;
+      TEST_ASSERT_TRUE(t.start(nextId, d, "t"));
+      ref.insert(std::make_pair(d, nextId++));
+    } else if (op == 1 && !ref.empty()) {
+      auto it = ref.begin();
+      std::advance(it, rand() % ref.size());
+      TEST_ASSERT_TRUE(t.cancel(it->second));
+      ref.erase(it);
+    } else {
+      int64_t now = rand() % 1000;
+      TimerEntry e;
+      while (t.popExpired(now, &e)) {
+        TEST_ASSERT_FALSE(ref.empty());
+        TEST_ASSERT_TRUE(e.deadline <= now);
+        TEST_ASSERT_EQUAL_INT64(ref.begin()->first, e.deadline);
+        auto range = ref.equal_range(e.deadline);
+        bool found = false;
+        for (auto it = range.first; it != range.second; ++it) {
+          if (it->second == e.id) { ref.erase(it); found = true; break; }
+        }
+        TEST_ASSERT_TRUE(found);
+      }
+      TEST_ASSERT_TRUE(ref.empty() || ref.begin()->first > now);
+    }
+    TEST_ASSERT_EQUAL_UINT8(ref.size(), t.size());
+  }
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_soonest_and_pop_order);
+  RUN_TEST(test_cancel_and_full);
+  RUN_TEST(test_label_truncated);
+  RUN_TEST(test_action_carried_along);
+  RUN_TEST(test_matches_reference);
+  return UNITY_END();
+}
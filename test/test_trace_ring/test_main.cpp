@@ -0,0 +1,97 @@
+#include <unity.h>
+#include <thread>
+#include "trace_ring.h"
+
+void setUp() {}
+void tearDown() {}
+
+void test_round_trip() {
+  static TraceRing<8> ring;
+  TraceRecord r;
+  TEST_ASSERT_FALSE(ring.read(0, &r));
+  ring.write(3, 1, 0x123456789ABCLL, 0xBEEF, 0xDEADBEEF);
+  TEST_ASSERT_EQUAL_UINT32(1, ring.written());
+  TEST_ASSERT_TRUE(ring.read(0, &r));
+  TEST_ASSERT_TRUE(r.timeUs == 0x123456789ABCLL); // 48 bits survive
+  TEST_ASSERT_EQUAL_UINT8(3, r.event);
+  TEST_ASSERT_EQUAL_UINT8(1, r.cpu);
+  TEST_ASSERT_EQUAL_HEX16(0xBEEF, r.a);
+  TEST_ASSERT_EQUAL_HEX32(0xDEADBEEF, r.b);
+  TEST_ASSERT_FALSE(ring.read(1, &r)); // not written yet
+}
+
+void test_overwrites_oldest() {
+  static TraceRing<8> ring;
+  for (uint32_t i = 0; i < 20; ++i) ring.write(1, 0, i * 10, i, i);
+  uint32_t n = ring.written();
+  TEST_ASSERT_EQUAL_UINT32(12, ring.oldest(n));
+  TraceRecord r;
+  TEST_ASSERT_FALSE(ring.read(11, &r)); // its slot holds ticket 19
+  for (uint32_t t = ring.oldest(n); t < n; ++t) {
+    TEST_ASSERT_TRUE(ring.read(t, &r));
+    TEST_ASSERT_EQUAL_UINT32(t, r.b);
+    TEST_ASSERT_TRUE(r.timeUs == t * 10);
+  }
+}
+
+void test_ticket_laps_are_told_apart() {
+  static TraceRing<4> ring;
+  TraceRecord r;
+  for (uint32_t i = 0; i < 5000; ++i) {
+    ring.write(2, 0, i, 0, i);
+    TEST_ASSERT_TRUE(ring.read(i, &r));
+    TEST_ASSERT_EQUAL_UINT32(i, r.b);
+    if (i >= 4) TEST_ASSERT_FALSE(ring.read(i - 4, &r));
+  }
+}
+
+// Writers on several threads while a reader scans: every record read is
+// one a writer wrote, never a mix of two
+void test_concurrent_writers_and_reader() {
+  static TraceRing<64> ring;
+  const uint32_t perThread = 50000, threads = 4;
+  static std::atomic<bool> started(false);
+  std::atomic<bool> done(false);
+  uint32_t torn = 0;
+  std::thread reader([&] {
+    TraceRecord r;
+    started = true;
+    while (!done.load()) {
+      uint32_t n = ring.written();
+      for (uint32_t t = ring.oldest(n); t < n; ++t) {
+        if (!ring.read(t, &r)) continue;
+        // Each writer makes the words agree with each other
+        if (r.b != ((uint32_t)r.event << 24 | (uint32_t)r.a) || r.timeUs != (int64_t)r.b * 3) torn++;
+      }
+    }
+  });
+  std::thread writers[threads];
+  for (uint32_t w = 0; w < threads; ++w) {
+    writers[w] = std::thread([w] {
+      while (!started.load()) {}
+      for (uint32_t i = 0; i < perThread; ++i) {
+        uint16_t a = (uint16_t)i;
+        uint32_t b = (w + 1) << 24 | a;
+        ring.write(w + 1, w & 1, (int64_t)b * 3, a, b);
+      }
+    });
+  }
+  for (uint32_t w = 0; w < threads; ++w) writers[w].join();
+  done = true;
+  reader.join();
+  TEST_ASSERT_EQUAL_UINT32(perThread * threads, ring.written());
+  TEST_ASSERT_EQUAL_UINT32(0, torn);
+  // Quiet again: the whole ring reads back
+  TraceRecord r;
+  uint32_t n = ring.written();
+  for (uint32_t t = ring.oldest(n); t < n; ++t) TEST_ASSERT_TRUE(ring.read(t, &r));
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_overwrites_oldest);
+  RUN_TEST(test_ticket_laps_are_told_apart);
+  RUN_TEST(test_concurrent_writers_and_reader);
+  return UNITY_END();
+}
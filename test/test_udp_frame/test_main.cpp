@@ -0,0 +1,116 @@
+#include <unity.h>
+#include "udp_frame.h"
+
+void setUp() {}
+void tearDown() {}
+
+void test_round_trip() {
+  UdpFrame f = {UDP_BRIGHTNESS, 3, UDP_OK, 128 | 750 << 8, 7, 0x0102030405060708ULL};
+  uint8_t buf[udpFrameSize] = {};
+  encodeUdpFrame(f, buf);
+  const uint8_t expected[] = {0x4C, UDP_BRIGHTNESS, 3, 0, 0x80, 0xEE, 0x02, 0x00, 7, 0, 0, 0,
+                              0x08, 0x07, 0x06, 0x05, 0x04, 0x03, 0x02, 0x01};
+  TEST_ASSERT_EQUAL_MEMORY(expected, buf, sizeof(expected));
+  UdpFrame back;
+  TEST_ASSERT_TRUE(decodeUdpFrame(buf, sizeof(buf), &back));
+  TEST_ASSERT_EQUAL_UINT8(f.opcode, back.opcode);
+  TEST_ASSERT_EQUAL_UINT8(f.channel, back.channel);
+  TEST_ASSERT_EQUAL_UINT32(f.value, back.value);
+  TEST_ASSERT_EQUAL_UINT32(f.sender, back.sender);
+  TEST_ASSERT_TRUE(back.nonce == f.nonce);
+}
+
+void test_rejects_wrong_size_and_version() {
+  uint8_t buf[udpFrameSize + 1] = {udpFrameMagic};
+  UdpFrame f;
+  TEST_ASSERT_FALSE(decodeUdpFrame(buf, udpFrameSize - 1, &f));
+  TEST_ASSERT_FALSE(decodeUdpFrame(buf, udpFrameSize + 1, &f));
+  TEST_ASSERT_TRUE(decodeUdpFrame(buf, udpFrameSize, &f));
+  buf[0] = udpFrameMagic + 1;
+  TEST_ASSERT_FALSE(decodeUdpFrame(buf, udpFrameSize, &f));
+}
+
+void test_mac_compare() {
+  uint8_t a[udpFrameMacSize] = {1, 2, 3}, b[udpFrameMacSize] = {1, 2, 3};
+  TEST_ASSERT_TRUE(udpMacEqual(a, b));
+  b[udpFrameMacSize - 1] ^= 1;
+  TEST_ASSERT_FALSE(udpMacEqual(a, b));
+}
+
+void test_replay_window() {
+  ReplayWindow<4> w;
+  TEST_ASSERT_TRUE(w.accept(1, 100));
+  TEST_ASSERT_FALSE(w.accept(1, 100)); // replayed
+  TEST_ASSERT_TRUE(w.accept(1, 103));
+  TEST_ASSERT_TRUE(w.accept(1, 101));  // late, still in the window
+  TEST_ASSERT_FALSE(w.accept(1, 101));
+  TEST_ASSERT_TRUE(w.accept(1, 102));
+  TEST_ASSERT_TRUE(w.accept(2, 100));  // another sender has its own
+  TEST_ASSERT_TRUE(w.accept(1, 200));
+  TEST_ASSERT_FALSE(w.accept(1, 136)); // 64 behind: too old to tell
+  TEST_ASSERT_TRUE(w.accept(1, 137));
+  TEST_ASSERT_FALSE(w.accept(1, 137));
+  TEST_ASSERT_TRUE(w.accept(1, 1000)); // a jump clears the window
+  TEST_ASSERT_FALSE(w.accept(1, 999 - 63));
+  TEST_ASSERT_TRUE(w.accept(1, 999));
+}
+
+void test_least_recently_used_sender_evicted() {
+  ReplayWindow<2> w;
+  TEST_ASSERT_TRUE(w.accept(1, 10));
+  TEST_ASSERT_TRUE(w.accept(2, 20));
+  TEST_ASSERT_TRUE(w.accept(1, 11)); // 2 is now the oldest
+  TEST_ASSERT_TRUE(w.accept(3, 30)); // evicts 2, whose nonces up to 20 stay spent
+  TEST_ASSERT_FALSE(w.accept(1, 11));
+  TEST_ASSERT_FALSE(w.accept(3, 30));
+  TEST_ASSERT_FALSE(w.accept(2, 20)); // forgotten, but not fresh again
+  TEST_ASSERT_TRUE(w.accept(2, 21));  // its next frame is (evicts 1)
+  TEST_ASSERT_FALSE(w.accept(1, 11));
+  TEST_ASSERT_TRUE(w.accept(1, 40));
+}
+
+void test_floor() {
+  ReplayWindow<4> w;
+  w.raiseFloor(1000); // e.g. the clock minus the tolerance
+  TEST_ASSERT_FALSE(w.accept(1, 1000));
+  TEST_ASSERT_TRUE(w.accept(1, 1001));
+  w.raiseFloor(500); // never lowered
+  TEST_ASSERT_FALSE(w.accept(2, 900));
+}
+
+// The receive path: the window is keyed on what the MAC covers, never on
+// where the datagram came from
+static bool receive(ReplayWindow<8>& w, const uint8_t* datagram, uint32_t fromAddress) {
+  (void)fromAddress;
+  UdpFrame f;
+  return decodeUdpFrame(datagram, udpFrameSize, &f) && w.accept(f.sender, f.nonce);
+}
+
+void test_replay_from_another_address_rejected() {
+  ReplayWindow<8> w;
+  UdpFrame f = {UDP_LED, 0, UDP_OK, 1, 5, 1700000000000000ULL};
+  uint8_t captured[udpFrameSize] = {};
+  encodeUdpFrame(f, captured);
+  TEST_ASSERT_TRUE(receive(w, captured, 0x0104A8C0));  // 192.168.4.1
+  TEST_ASSERT_FALSE(receive(w, captured, 0x0204A8C0)); // 192.168.4.2
+  // Flushing the sender out with other panels' frames does not help either
+  for (uint32_t sender = 100; sender < 120; ++sender) {
+    UdpFrame other = {UDP_PING, 0, UDP_OK, 0, sender, 1700000000000000ULL + sender};
+    uint8_t buf[udpFrameSize];
+    encodeUdpFrame(other, buf);
+    receive(w, buf, 0x0304A8C0);
+  }
+  TEST_ASSERT_FALSE(receive(w, captured, 0x0404A8C0));
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_rejects_wrong_size_and_version);
+  RUN_TEST(test_mac_compare);
+  RUN_TEST(test_replay_window);
+  RUN_TEST(test_least_recently_used_sender_evicted);
+  RUN_TEST(test_floor);
+  RUN_TEST(test_replay_from_another_address_rejected);
+  return UNITY_END();
+}
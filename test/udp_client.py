@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+"""UDP control client and round-trip test for the board's UDP listener.
+
+Set udpControlKey in src/main.cpp, join the board's softAP, then e.g.:
+
+    python3 test/udp_client.py --key secret led 0 on
+    python3 test/udp_client.py --key secret ping -n 200
+    python3 test/udp_client.py --key secret watch
+
+Frames are the 36 bytes of lib/core/src/udp_frame.h. Nonces are the
+clock in microseconds, so restarts never reuse one; give each panel its own
+--sender id. `watch` prints the status multicasts. Standard library only.
+"""
+
+import argparse
+import hashlib
+import hmac
+import socket
+import struct
+import time
+
+MAGIC = 0x4C
+HEADER = "<BBBBIIQ"
+ACK = 0x80
+OPS = {"ping": 0, "led": 1, "outputs": 2, "brightness": 3, "timer": 4, "stop": 5, "snooze": 6, "dismiss": 7}
+STATUS = 0x40
+RESULTS = ["ok", "busy", "bad request", "unknown op"]
+
+
+def frame(key, opcode, channel, value, sender, nonce, status=0):
+    header = struct.pack(HEADER, MAGIC, opcode, channel, status, value & 0xFFFFFFFF, sender, nonce)
+    return header + hmac.new(key, header, hashlib.sha256).digest()[:16]
+
+
+def parse(key, data):
+    if len(data) != 36:
+        return None
+    header, mac = data[:20], data[20:]
+    if not hmac.compare_digest(mac, hmac.new(key, header, hashlib.sha256).digest()[:16]):
+        return None
+    magic, opcode, channel, status, value, sender, nonce = struct.unpack(HEADER, header)
+    return None if magic != MAGIC else (opcode, channel, status, value, sender, nonce)
+
+
+def next_nonce(last):
+    return max(time.time_ns() // 1000, last + 1)
+
+
+def request(sock, key, addr, opcode, channel, value, sender, nonce, timeout):
+    sock.settimeout(timeout)
+    start = time.perf_counter()
+    sock.sendto(frame(key, opcode, channel, value, sender, nonce), addr)
+    while True:
+        data, _ = sock.recvfrom(64)
+        reply = parse(key, data)
+        if reply and reply[0] == opcode | ACK and reply[4:] == (sender, nonce):
+            return reply, time.perf_counter() - start
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--host", default="192.168.4.1")
+    parser.add_argument("--port", type=int, default=4210)
+    parser.add_argument("--key", required=True)
+    parser.add_argument("--sender", type=int, default=1, help="this panel's id, 1 or more")
+    parser.add_argument("--group", default="239.255.42.1")
+    parser.add_argument("--status-port", type=int, default=4211)
+    parser.add_argument("--timeout", type=float, default=1.0)
+    parser.add_argument("-n", type=int, default=1, help="repeat, reporting round trip percentiles")
+    parser.add_argument("op", choices=sorted(OPS) + ["watch"])
+    parser.add_argument("args", nargs="*", help="led: <channel> on|off; brightness: <channel> <level> [fadeMs]; "
+                                                "outputs: <bits> <mask>; timer: <ms>")
+    args = parser.parse_args()
+    key = args.key.encode()
+
+    if args.op == "watch":
+        sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+        sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        sock.bind(("", args.status_port))
+        sock.setsockopt(socket.IPPROTO_IP, socket.IP_ADD_MEMBERSHIP,
+                        socket.inet_aton(args.group) + socket.inet_aton("0.0.0.0"))
+        while True:
+            reply = parse(key, sock.recv(64))
+            if reply and reply[0] == STATUS:
+                print("nonce %u outputs 0x%04x flags 0x%02x" % (reply[5], reply[3], reply[1]))
+
+    channel, value, a = 0, 0, args.args
+    if args.op == "led":
+        channel, value = int(a[0]), 1 if a[1] == "on" else 0
+    elif args.op == "brightness":
+        channel, value = int(a[0]), int(a[1]) | (int(a[2]) if len(a) > 2 else 0) << 8
+    elif args.op == "outputs":
+        value = int(a[0], 0) | int(a[1], 0) << 16
+    elif args.op == "timer":
+        value = int(a[0])
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    nonce = 0
+    rtts, lost = [], 0
+    for _ in range(args.n):
+        nonce = next_nonce(nonce)
+        try:
+            reply, rtt = request(sock, key, (args.host, args.port), OPS[args.op], channel, value, args.sender, nonce,
+                                 args.timeout)
+        except socket.timeout:
+            lost += 1
+            continue
+        rtts.append(rtt)
+        if args.n == 1:
+            print("%s, value %u, %.2f ms" % (RESULTS[reply[2]] if reply[2] < len(RESULTS) else reply[2], reply[3],
+                                             rtt * 1000))
+    if args.n > 1 and rtts:
+        rtts.sort()
+        pct = lambda p: rtts[max(0, (len(rtts) * p + 99) // 100 - 1)] * 1000
+        print("%d sent, %d lost, p50 %.2f ms, p99 %.2f ms, max %.2f ms" % (args.n, lost, pct(50), pct(99), rtts[-1] * 1000))
+    return 1 if lost else 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
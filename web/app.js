@@ -0,0 +1,25 @@
+// The page itself is static; everything that changes comes from /events (or /status).
+var alarmsLoaded=false;
+function addAlarm(value){var list=document.getElementById('alarmList');var idx=list.children.length;var div=document.createElement('div');div.className='alarm-item';var input=document.createElement('input');input.type='time';input.name='alarm'+idx;input.required=true;if(value) input.value=value;var btn=document.createElement('button');btn.type='button';btn.className='small-btn';btn.innerText='Delete';btn.onclick=function(){div.remove();renumberAlarms();};div.appendChild(input);div.appendChild(btn);list.appendChild(div);}
+function renumberAlarms(){var list=document.getElementById('alarmList');for(var i=0;i<list.children.length;i++){var inp=list.children[i].querySelector('input');if(inp) inp.name='alarm'+i;}}
+function clearAlarms(){fetch('/clearAlarms').then(()=>location.reload());}
+function alarmAction(a){fetch('/alarms/'+a,{method:'POST'}).then(function(){if(poll) fetchStatus();});}
+function renderRinging(j){document.getElementById('ringing').style.display=j.alarmRinging?'':'none';document.getElementById('snoozeBtn').style.display=j.snoozed?'none':'';}
+function renderAlarms(a){var list=document.getElementById('alarmList');list.innerHTML='';for(var i=0;i<a.length;i++) addAlarm(a[i]);if(a.length==0) addAlarm();}
+function renderLed(id,on){var el=document.getElementById(id);el.href='/led?ch='+id+'&state='+(on?'off':'on');el.firstElementChild.className=on?'slider on':'slider';}
+function toggleLed(e){e.preventDefault();fetch(this.href,{headers:{Accept:'application/json'}}).then(function(){if(poll) fetchStatus();});}
+// State pushed over /events is a delta; merge it into what we have.
+var state={},timerEnd=0;
+function fmtRemaining(ms){var s=Math.max(0,Math.round(ms/1000));return Math.floor(s/3600)+'h '+Math.floor(s%3600/60)+'m '+(s%60)+'s';}
+function renderText(){var j=state;var s=document.getElementById('statusArea');var txt='';txt+='Clock: '+(j.timeSynced?j.time+' ('+j.clockSource+')':'not synced')+'<br>';txt+='Timer: '+(j.timerRunning?('running, remaining: '+fmtRemaining(timerEnd-Date.now())):'stopped')+'<br>';txt+='Alarms stored: '+j.alarmsCount+'<br>';txt+='LED1: '+(j.led1?'ON':'OFF')+' | LED2: '+(j.led2?'ON':'OFF')+'<br>';s.innerHTML=txt;}
+// Without NTP the board takes its time from us; it ignores this while NTP is fresh
+var timeSent=false;
+function sendTime(){timeSent=true;fetch('/time',{method:'POST',headers:{'Content-Type':'application/x-www-form-urlencoded'},body:'ms='+Date.now()}).catch(e=>{});}
+function render(j){for(var k in j) state[k]=j[k];if(!timeSent&&'timeSynced' in j&&state.clockSource!='ntp') sendTime();if('remainingMs' in j) timerEnd=Date.now()+j.remainingMs;j=state;renderLed('led1',j.led1);renderLed('led2',j.led2);renderRinging(j);if(!alarmsLoaded&&j.alarms){alarmsLoaded=true;renderAlarms(j.alarms);}renderText();}
+// Count down locally between server updates
+setInterval(function(){if(state.timerRunning) renderText();},1000);
+function fetchStatus(){fetch('/status').then(r=>r.json()).then(render).catch(e=>{});}
+var poll=null;
+function startPolling(){if(!poll) poll=setInterval(fetchStatus,2000);fetchStatus();}
+document.getElementById('led1').onclick=toggleLed;document.getElementById('led2').onclick=toggleLed;
+if(window.EventSource){var es=new EventSource('/events');es.addEventListener('status',function(e){render(JSON.parse(e.data));});es.onerror=function(){if(es.readyState==EventSource.CLOSED) startPolling();};}else startPolling();